@@ -10,7 +10,7 @@ _seccomp_tools() {
   cur="${COMP_WORDS[COMP_CWORD]}"
   prev="${COMP_WORDS[COMP_CWORD-1]}"
 
-  local commands="asm audit completion disasm dump emu explain"
+  local commands="asm audit cache completion cost disasm dump emu explain merge optimize serve"
   local arches="aarch64 amd64 i386 riscv64 s390x"
 
   # Position 1: the subcommand.
@@ -24,11 +24,11 @@ _seccomp_tools() {
   # The previous word expects a value: complete just that value.
   case "$prev" in
     -a|--arch) COMPREPLY=( $(compgen -W "$arches" -- "$cur") ); return ;;
-    -o|--output) COMPREPLY=( $(compgen -f -- "$cur") ); return ;;
+    -o|--output|--profile|--batch|-s|--socket) COMPREPLY=( $(compgen -f -- "$cur") ); return ;;
     -f|--format)
       case "$cmd" in
-        asm)   COMPREPLY=( $(compgen -W "inspect raw c_array c_source assembly" -- "$cur") ) ;;
-        audit) COMPREPLY=( $(compgen -W "human json" -- "$cur") ) ;;
+        asm|merge|optimize) COMPREPLY=( $(compgen -W "inspect raw c_array c_source assembly" -- "$cur") ) ;;
+        audit|cache|cost) COMPREPLY=( $(compgen -W "human json" -- "$cur") ) ;;
         dump)  COMPREPLY=( $(compgen -W "disasm raw inspect" -- "$cur") ) ;;
       esac
       return ;;
@@ -42,12 +42,17 @@ _seccomp_tools() {
   # Otherwise: this subcommand's flags (when typing a -flag) or a file.
   local opts="-h --help"
   case "$cmd" in
-    asm)     opts+=" -o --output -f --format -a --arch" ;;
+    asm)     opts+=" -o --output -f --format -a --arch -O --optimize" ;;
     disasm)  opts+=" -o --output -a --arch --bpf --no-bpf --arg-infer --no-arg-infer --asm-able" ;;
-    dump)    opts+=" -c --sh-exec -l --limit -p --pid -t --timeout -f --format -o --output" ;;
+    dump)    opts+=" -c --sh-exec -l --limit -p --pid -t --timeout --trap -f --format --all -o --output" ;;
     emu)     opts+=" -a --arch -q --no-quiet -i --ip" ;;
-    explain) opts+=" -c --sh-exec -l --limit -p --pid -t --timeout -a --arch" ;;
-    audit)   opts+=" -c --sh-exec -l --limit -p --pid -t --timeout -a --arch -f --format" ;;
+    explain) opts+=" -c --sh-exec -l --limit -p --pid -t --timeout --trap -a --arch --cache --batch -j --jobs --unordered" ;;
+    audit)   opts+=" -c --sh-exec -l --limit -p --pid -t --timeout --trap -a --arch --cache --batch -j --jobs --unordered -f --format" ;;
+    cache)   opts+=" -c --sh-exec -l --limit -p --pid -t --timeout --trap -a --arch -f --format" ;;
+    cost)    opts+=" -c --sh-exec -l --limit -p --pid -t --timeout --trap -a --arch -f --format -n --top --profile" ;;
+    merge)   opts+=" -c --sh-exec -l --limit -p --pid -t --timeout --trap -o --output -f --format -a --arch -n --top --profile" ;;
+    optimize) opts+=" -o --output -f --format -a --arch --profile" ;;
+    serve)   opts+=" -s --socket" ;;
   esac
 
   if [[ $cur == -* ]]; then
@@ -10,31 +10,59 @@ complete -c seccomp-tools -f
 # Subcommands (offered only when none has been given yet).
 complete -c seccomp-tools -n __fish_use_subcommand -a asm        -d 'Seccomp bpf assembler'
 complete -c seccomp-tools -n __fish_use_subcommand -a audit      -d 'Assess a filter for weaknesses and escape routes'
+complete -c seccomp-tools -n __fish_use_subcommand -a cache      -d 'Report which allowed syscalls the kernel action cache skips'
 complete -c seccomp-tools -n __fish_use_subcommand -a completion -d 'Print a shell completion script'
+complete -c seccomp-tools -n __fish_use_subcommand -a cost       -d 'Report the instructions a filter executes per syscall'
 complete -c seccomp-tools -n __fish_use_subcommand -a disasm     -d 'Disassemble seccomp bpf'
 complete -c seccomp-tools -n __fish_use_subcommand -a dump       -d 'Automatically dump seccomp bpf from executable(s)'
 complete -c seccomp-tools -n __fish_use_subcommand -a emu        -d 'Emulate seccomp rules'
 complete -c seccomp-tools -n __fish_use_subcommand -a explain    -d 'Summarize a filter as a per-action policy'
+complete -c seccomp-tools -n __fish_use_subcommand -a merge      -d 'Merge stacked filters into a single equivalent one'
+complete -c seccomp-tools -n __fish_use_subcommand -a optimize   -d 'Rewrite a filter so the most frequent syscalls are decided first'
+complete -c seccomp-tools -n __fish_use_subcommand -a serve      -d 'Keep the library loaded and run the commands of other invocations'
 complete -c seccomp-tools -n __fish_use_subcommand -l version    -d 'Show version'
 complete -c seccomp-tools -s h -l help -d 'Show help'
 
 # --arch, shared by the analysis commands.
-complete -c seccomp-tools -n '__fish_seen_subcommand_from asm disasm emu explain audit' \
+complete -c seccomp-tools -n '__fish_seen_subcommand_from asm disasm emu explain audit cache cost merge optimize' \
   -s a -l arch -x -a 'aarch64 amd64 i386 riscv64 s390x' -d Architecture
 
 # --format, whose valid values differ per command.
-complete -c seccomp-tools -n '__fish_seen_subcommand_from asm'   -s f -l format -x -a 'inspect raw c_array c_source assembly' -d 'Output format'
+complete -c seccomp-tools -n '__fish_seen_subcommand_from asm merge optimize' -s f -l format -x -a 'inspect raw c_array c_source assembly' -d 'Output format'
 complete -c seccomp-tools -n '__fish_seen_subcommand_from dump'  -s f -l format -x -a 'disasm raw inspect' -d 'Output format'
-complete -c seccomp-tools -n '__fish_seen_subcommand_from audit' -s f -l format -x -a 'human json' -d 'Output format'
+complete -c seccomp-tools -n '__fish_seen_subcommand_from audit cache cost' -s f -l format -x -a 'human json' -d 'Output format'
 
 # --output takes a file.
-complete -c seccomp-tools -n '__fish_seen_subcommand_from asm disasm dump' -s o -l output -r -d 'Write output to FILE'
+complete -c seccomp-tools -n '__fish_seen_subcommand_from asm disasm dump merge optimize' -s o -l output -r -d 'Write output to FILE'
 
 # Options shared by the commands that read from a process.
-complete -c seccomp-tools -n '__fish_seen_subcommand_from dump explain audit' -s c -l sh-exec -x -d 'Run command via sh and analyze its seccomp'
-complete -c seccomp-tools -n '__fish_seen_subcommand_from dump explain audit' -s p -l pid     -x -d 'Analyze a running process'
-complete -c seccomp-tools -n '__fish_seen_subcommand_from dump explain audit' -s l -l limit   -x -d 'Analyze only the first N filters'
-complete -c seccomp-tools -n '__fish_seen_subcommand_from dump explain audit' -s t -l timeout -x -d 'Timeout in seconds'
+complete -c seccomp-tools -n '__fish_seen_subcommand_from dump explain audit cache cost merge' -s c -l sh-exec -x -d 'Run command via sh and analyze its seccomp'
+complete -c seccomp-tools -n '__fish_seen_subcommand_from dump explain audit cache cost merge' -s p -l pid     -x -d 'Analyze a running process'
+complete -c seccomp-tools -n '__fish_seen_subcommand_from dump explain audit cache cost merge' -s l -l limit   -x -d 'Analyze only the first N filters'
+complete -c seccomp-tools -n '__fish_seen_subcommand_from dump explain audit cache cost merge' -s t -l timeout -x -d 'Timeout in seconds'
+complete -c seccomp-tools -n '__fish_seen_subcommand_from dump explain audit cache cost merge' -l trap -d 'Stop only at seccomp installations'
+
+# explain and audit flags.
+complete -c seccomp-tools -n '__fish_seen_subcommand_from explain audit' -l cache -r -a '(__fish_complete_directories)' -d 'Reuse results kept in DIR'
+complete -c seccomp-tools -n '__fish_seen_subcommand_from explain audit' -l batch -r -d 'Analyze every file under DIR or listed in @LIST'
+complete -c seccomp-tools -n '__fish_seen_subcommand_from explain audit' -s j -l jobs -x -d 'Worker processes for --batch'
+complete -c seccomp-tools -n '__fish_seen_subcommand_from explain audit' -l unordered -d 'Print --batch results as they complete'
+
+# dump-only flags.
+complete -c seccomp-tools -n '__fish_seen_subcommand_from dump' -l all -d 'Dump the filters of every process'
+
+# cost-only flags.
+complete -c seccomp-tools -n '__fish_seen_subcommand_from cost' -s n -l top -x -d 'List only the N most expensive syscalls'
+complete -c seccomp-tools -n '__fish_seen_subcommand_from cost' -l profile -r -d 'Weight by a syscall frequency profile'
+
+# merge-only flags.
+complete -c seccomp-tools -n '__fish_seen_subcommand_from merge' -s n -l top -x -d 'Report only the N dearest syscalls'
+
+# merge and optimize flags.
+complete -c seccomp-tools -n '__fish_seen_subcommand_from merge optimize' -l profile -r -d 'Decide the most frequent syscalls first'
+
+# asm-only flags.
+complete -c seccomp-tools -n '__fish_seen_subcommand_from asm' -s O -l optimize -d 'Shorten the output without changing its results'
 
 # disasm-only flags.
 complete -c seccomp-tools -n '__fish_seen_subcommand_from disasm' -l asm-able     -d 'Emit output that is valid input for asm'
@@ -45,8 +73,11 @@ complete -c seccomp-tools -n '__fish_seen_subcommand_from disasm' -l no-arg-infe
 complete -c seccomp-tools -n '__fish_seen_subcommand_from emu' -s i -l ip    -x -d 'Set the instruction pointer'
 complete -c seccomp-tools -n '__fish_seen_subcommand_from emu' -s q -l quiet -d 'Only show the emulation result'
 
+# serve-only flags.
+complete -c seccomp-tools -n '__fish_seen_subcommand_from serve' -s s -l socket -r -d 'Listen on the Unix socket PATH'
+
 # completion takes a shell name.
 complete -c seccomp-tools -n '__fish_seen_subcommand_from completion' -a 'bash zsh fish' -d Shell
 
 # The commands whose positional argument is a file/executable get file completion.
-complete -c seccomp-tools -n '__fish_seen_subcommand_from asm disasm dump emu explain audit' -F
+complete -c seccomp-tools -n '__fish_seen_subcommand_from asm disasm dump emu explain audit cache cost merge optimize' -F
@@ -0,0 +1,182 @@
+// Native decoding of raw seccomp BPF, see SeccompTools::Disasm::Program.
+//
+// decode turns a buffer of struct sock_filter into the four columns of a
+// Program in one pass over the bytes, with no object allocated per
+// instruction. check applies the rules the kernel enforces when a filter is
+// installed (bpf_check_classic, then seccomp_check_filter), and must report the
+// same verdicts as Program#check_in_ruby.
+
+#include <stdint.h>
+
+#include "ruby.h"
+
+// BPF_MAXINSNS
+#define MAX_INSNS 4096
+// BPF_MEMWORDS
+#define MEMWORDS 16
+// sizeof(struct seccomp_data)
+#define DATA_SIZE 64
+
+static inline uint32_t
+load(const unsigned char *p, int bytes, int big) {
+  uint32_t v = 0;
+
+  for (int i = 0; i < bytes; i++)
+    v |= (uint32_t)p[big ? i : bytes - 1 - i] << (8 * (bytes - 1 - i));
+  return v;
+}
+
+/*
+ * Splits raw BPF into its fields. Trailing bytes short of an instruction are
+ * ignored.
+ *
+ * @param raw [String]
+ * @param big_endian [Boolean]
+ * @return [Array(Array<Integer>, Array<Integer>, Array<Integer>, Array<Integer>)]
+ *   The code, jt, jf and k of every instruction.
+ */
+static VALUE
+decoder_decode(VALUE _mod, VALUE raw, VALUE big_endian) {
+  StringValue(raw);
+  const unsigned char *p = (const unsigned char *)RSTRING_PTR(raw);
+  long n = RSTRING_LEN(raw) / 8;
+  int big = RTEST(big_endian);
+  VALUE code = rb_ary_new_capa(n), jt = rb_ary_new_capa(n), jf = rb_ary_new_capa(n), k = rb_ary_new_capa(n);
+
+  for (long i = 0; i < n; i++, p += 8) {
+    rb_ary_push(code, INT2FIX(load(p, 2, big)));
+    rb_ary_push(jt, INT2FIX(p[2]));
+    rb_ary_push(jf, INT2FIX(p[3]));
+    rb_ary_push(k, UINT2NUM(load(p + 4, 4, big)));
+  }
+  return rb_ary_new_from_args(4, code, jt, jf, k);
+}
+
+struct insn {
+  uint16_t code;
+  uint8_t jt, jf;
+  uint32_t k;
+};
+
+static VALUE
+failure(long line, const char *reason) {
+  return rb_ary_new_from_args(2, line < 0 ? Qnil : LONG2NUM(line), rb_str_new_cstr(reason));
+}
+
+// Why the instruction at pc can't be installed, NULL when it can.
+static const char *
+check_insn(const struct insn *f, uint32_t pc, uint32_t len) {
+  switch (f->code) {
+  case 0x20: // A = data[k]
+    return f->k >= DATA_SIZE || f->k & 3 ? "invalid seccomp_data offset" : NULL;
+  case 0x34: // A /= k
+    return f->k == 0 ? "division by zero" : NULL;
+  case 0x64: case 0x74: // A <<= k, A >>= k
+    return f->k >= 32 ? "shift out of range" : NULL;
+  case 0x60: case 0x61: case 0x02: case 0x03: // mem[k]
+    return f->k >= MEMWORDS ? "scratch memory index out of range" : NULL;
+  case 0x05: // goto
+    return f->k >= len - pc - 1 ? "jump out of range" : NULL;
+  case 0x15: case 0x1d: case 0x25: case 0x2d: case 0x35: case 0x3d: case 0x45: case 0x4d:
+    return pc + f->jt + 1 >= len || pc + f->jf + 1 >= len ? "jump out of range" : NULL;
+  case 0x80: case 0x81: // A = len, X = len
+  case 0x06: case 0x16: // return
+  case 0x04: case 0x0c: case 0x14: case 0x1c: case 0x24: case 0x2c: case 0x3c:
+  case 0x44: case 0x4c: case 0x54: case 0x5c: case 0x6c: case 0x7c: case 0x84: case 0xa4: case 0xac:
+  case 0x00: case 0x01: case 0x07: case 0x87: // A = k, X = k, X = A, A = X
+    return NULL;
+  default:
+    return "invalid opcode";
+  }
+}
+
+// check_load_and_stores of the kernel: whether some path reads a scratch
+// memory slot it has not written. Returns the line, or -1.
+static long
+check_memory(const struct insn *prog, uint32_t len) {
+  uint16_t masks[MAX_INSNS], valid = 0;
+
+  for (uint32_t pc = 0; pc < len; pc++)
+    masks[pc] = 0xffff;
+  for (uint32_t pc = 0; pc < len; pc++) {
+    const struct insn *f = &prog[pc];
+
+    valid &= masks[pc];
+    switch (f->code) {
+    case 0x02: case 0x03:
+      valid |= 1 << f->k;
+      break;
+    case 0x60: case 0x61:
+      if (!(valid & (1 << f->k)))
+        return pc;
+      break;
+    case 0x05:
+      masks[pc + 1 + f->k] &= valid;
+      valid = 0xffff;
+      break;
+    case 0x15: case 0x1d: case 0x25: case 0x2d: case 0x35: case 0x3d: case 0x45: case 0x4d:
+      masks[pc + 1 + f->jt] &= valid;
+      masks[pc + 1 + f->jf] &= valid;
+      valid = 0xffff;
+      break;
+    }
+  }
+  return -1;
+}
+
+/*
+ * Whether the kernel would accept raw BPF as a seccomp filter.
+ *
+ * @param raw [String]
+ * @param big_endian [Boolean]
+ * @return [Array(Integer?, String)?]
+ *   nil when it would, else the first offending line (nil for the filter as a
+ *   whole) and why.
+ */
+static VALUE
+decoder_check(VALUE _mod, VALUE raw, VALUE big_endian) {
+  StringValue(raw);
+  long n = RSTRING_LEN(raw) / 8;
+  int big = RTEST(big_endian);
+  struct insn prog[MAX_INSNS];
+
+  if (n == 0)
+    return failure(-1, "empty filter");
+  if (n > MAX_INSNS)
+    return failure(-1, "too many instructions");
+
+  const unsigned char *p = (const unsigned char *)RSTRING_PTR(raw);
+  uint32_t len = (uint32_t)n;
+
+  for (uint32_t pc = 0; pc < len; pc++, p += 8) {
+    prog[pc].code = (uint16_t)load(p, 2, big);
+    prog[pc].jt = p[2];
+    prog[pc].jf = p[3];
+    prog[pc].k = load(p + 4, 4, big);
+  }
+  for (uint32_t pc = 0; pc < len; pc++) {
+    const char *reason = check_insn(&prog[pc], pc, len);
+
+    if (reason)
+      return failure(pc, reason);
+  }
+  if (prog[len - 1].code != 0x06 && prog[len - 1].code != 0x16)
+    return failure(len - 1, "last instruction is not a return");
+
+  long line = check_memory(prog, len);
+
+  return line < 0 ? Qnil : failure(line, "scratch memory read before written");
+}
+
+void Init_decoder(void) {
+  VALUE mSeccompTools = rb_define_module("SeccompTools");
+  VALUE mDisasm = rb_define_module_under(mSeccompTools, "Disasm");
+  VALUE cProgram = rb_define_class_under(mDisasm, "Program", rb_cObject);
+  /* Native decoder and checker of raw BPF. */
+  VALUE mNative = rb_define_module_under(cProgram, "Native");
+
+  /* Splits raw BPF into its fields. */
+  rb_define_module_function(mNative, "decode", decoder_decode, 2);
+  /* Whether the kernel would accept raw BPF as a seccomp filter. */
+  rb_define_module_function(mNative, "check", decoder_check, 2);
+}
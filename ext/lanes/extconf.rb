@@ -0,0 +1,7 @@
+# frozen_string_literal: true
+
+require 'mkmf'
+
+extension_name = 'seccomp-tools/lanes'
+
+create_makefile(extension_name)
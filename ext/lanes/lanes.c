@@ -0,0 +1,397 @@
+// Multi-lane evaluation of a compiled seccomp filter, see
+// SeccompTools::Emulator#compile for the program layout.
+//
+// Inputs are evaluated in groups of LANES, one lane per input, each with its
+// own registers and program counter. Every step executes the instruction at the
+// lowest pending program counter for the lanes sitting on it: cBPF only jumps
+// forward, so lanes that diverged at a conditional jump meet again where the
+// branches join and the group executes in lockstep most of the time. The group
+// state is GCC vectors, which compile to AVX-512, AVX2 or SSE2 on x86-64 (picked
+// at load time) and to NEON on arm64; other compilers get a scalar loop.
+
+#include <stdint.h>
+#include <string.h>
+
+#include "ruby.h"
+
+// Keep in sync with SeccompTools::Emulator::OPCODE and ALU_OPS.
+enum opcode {
+  RET_K, RET_A, LD_IMM, LDX_IMM, LD_MEM, LDX_MEM, LD_DATA, LDX_DATA, ST, STX, JA,
+  JEQ_K, JEQ_X, JGT_K, JGT_X, JGE_K, JGE_X, JSET_K, JSET_X, ALU_K, ALU_X, NEG, TAX, TXA, FAULT,
+  NOPCODE
+};
+enum alu { ADD, SUB, MUL, DIV, OR, AND, LSH, RSH, XOR, NALU };
+
+#define LANES 16
+// struct seccomp_data as 32-bit words, low half first: nr, arch,
+// instruction_pointer, then args[0..5]. The byte order of the filter's view was
+// resolved by Emulator#compile.
+#define NWORDS 16
+#define NMEM 16
+// SECCOMP_RET_KILL_THREAD, returned on division by zero.
+#define RET_KILL_THREAD 0u
+// Program counter of a lane that has returned or faulted.
+#define DONE UINT32_MAX
+
+struct insn {
+  uint32_t op, k, jt, jf;
+};
+
+struct group {
+  int n;                             // lanes in use
+  uint32_t word[NWORDS][LANES];      // seccomp_data
+  uint32_t defined[NWORDS][LANES];   // ~0u where the word is known
+  uint32_t ret[LANES];
+  uint32_t fault[LANES];             // ~0u where the lane must be re-run in Ruby
+};
+
+#if defined(__GNUC__)
+
+typedef uint32_t vec __attribute__((vector_size(LANES * sizeof(uint32_t))));
+
+#define BLEND(m, t, f) (((t) & (m)) | ((f) & ~(m)))
+#define SPLAT(v) ((vec){0} + (uint32_t)(v))
+
+#if defined(__x86_64__) && defined(__GLIBC__) && defined(__has_attribute)
+#if __has_attribute(target_clones)
+#define MULTIVERSION __attribute__((target_clones("avx512f", "avx2", "default")))
+#endif
+#endif
+#ifndef MULTIVERSION
+#define MULTIVERSION
+#endif
+
+MULTIVERSION static void
+run_group(const struct insn *prog, uint32_t len, struct group *g) {
+  vec a = {0}, x = {0}, pc, ret = {0}, fault = {0};
+  vec word[NWORDS], defined[NWORDS], mem[NMEM], memdef[NMEM];
+
+  memcpy(word, g->word, sizeof(word));
+  memcpy(defined, g->defined, sizeof(defined));
+  memset(mem, 0, sizeof(mem));
+  memset(memdef, 0, sizeof(memdef));
+  for (int i = 0; i < LANES; i++)
+    pc[i] = i < g->n ? 0 : DONE;
+
+  for (;;) {
+    uint32_t cur = DONE;
+    for (int i = 0; i < LANES; i++)
+      if (pc[i] < cur)
+        cur = pc[i];
+    if (cur == DONE)
+      break;
+
+    vec m = (vec)(pc == cur);
+    vec next = SPLAT(cur + 1);
+    if (cur >= len) {
+      // jumped out of the filter
+      fault |= m;
+      pc = BLEND(m, SPLAT(DONE), pc);
+      continue;
+    }
+    const struct insn *in = &prog[cur];
+    vec k = SPLAT(in->k);
+    vec jt = SPLAT(in->jt), jf = SPLAT(in->jf);
+    vec undef = {0};
+
+    switch (in->op) {
+    case RET_K: ret = BLEND(m, k, ret); next = SPLAT(DONE); break;
+    case RET_A: ret = BLEND(m, a, ret); next = SPLAT(DONE); break;
+    case LD_IMM: a = BLEND(m, k, a); break;
+    case LDX_IMM: x = BLEND(m, k, x); break;
+    case LD_MEM: a = BLEND(m, mem[in->k], a); undef = m & ~memdef[in->k]; break;
+    case LDX_MEM: x = BLEND(m, mem[in->k], x); undef = m & ~memdef[in->k]; break;
+    case LD_DATA: a = BLEND(m, word[in->k], a); undef = m & ~defined[in->k]; break;
+    case LDX_DATA: x = BLEND(m, word[in->k], x); undef = m & ~defined[in->k]; break;
+    case ST: mem[in->k] = BLEND(m, a, mem[in->k]); memdef[in->k] |= m; break;
+    case STX: mem[in->k] = BLEND(m, x, mem[in->k]); memdef[in->k] |= m; break;
+    case JA: next = k; break;
+    case JEQ_K: next = BLEND((vec)(a == k), jt, jf); break;
+    case JEQ_X: next = BLEND((vec)(a == x), jt, jf); break;
+    case JGT_K: next = BLEND((vec)(a > k), jt, jf); break;
+    case JGT_X: next = BLEND((vec)(a > x), jt, jf); break;
+    case JGE_K: next = BLEND((vec)(a >= k), jt, jf); break;
+    case JGE_X: next = BLEND((vec)(a >= x), jt, jf); break;
+    case JSET_K: next = BLEND((vec)((a & k) != 0), jt, jf); break;
+    case JSET_X: next = BLEND((vec)((a & x) != 0), jt, jf); break;
+    case ALU_K:
+    case ALU_X: {
+      vec src = in->op == ALU_K ? k : x, r;
+      switch (in->jt) {
+      case ADD: r = a + src; break;
+      case SUB: r = a - src; break;
+      case MUL: r = a * src; break;
+      case DIV: {
+        vec zero = (vec)(src == 0);
+        r = a / (src | (zero & 1));
+        // classic BPF aborts the whole program on division by zero
+        ret = BLEND(m & zero, SPLAT(RET_KILL_THREAD), ret);
+        next = BLEND(zero, SPLAT(DONE), next);
+        break;
+      }
+      case OR: r = a | src; break;
+      case AND: r = a & src; break;
+      case LSH: r = (a << (src & 31)) & (vec)(src < 32); break;
+      case RSH: r = (a >> (src & 31)) & (vec)(src < 32); break;
+      default: r = a ^ src; break;
+      }
+      a = BLEND(m, r, a);
+      break;
+    }
+    case NEG: a = BLEND(m, -a, a); break;
+    case TAX: x = BLEND(m, a, x); break;
+    case TXA: a = BLEND(m, x, a); break;
+    default: undef = m; break;  // FAULT
+    }
+    fault |= undef;
+    pc = BLEND(m, BLEND(undef, SPLAT(DONE), next), pc);
+  }
+  memcpy(g->ret, &ret, sizeof(g->ret));
+  memcpy(g->fault, &fault, sizeof(g->fault));
+}
+
+#else
+
+static void
+run_group(const struct insn *prog, uint32_t len, struct group *g) {
+  for (int l = 0; l < g->n; l++) {
+    uint32_t a = 0, x = 0, pc = 0, mem[NMEM], memdef = 0;
+
+    g->fault[l] = ~0u;
+    while (pc < len) {
+      const struct insn *in = &prog[pc++];
+      uint32_t src = in->op == ALU_X ? x : in->k;
+
+      if ((in->op == LD_MEM || in->op == LDX_MEM) && !(memdef & (1u << in->k)))
+        break;
+      if ((in->op == LD_DATA || in->op == LDX_DATA) && !g->defined[in->k][l])
+        break;
+      switch (in->op) {
+      case RET_K: g->ret[l] = in->k; g->fault[l] = 0; goto next;
+      case RET_A: g->ret[l] = a; g->fault[l] = 0; goto next;
+      case LD_IMM: a = in->k; break;
+      case LDX_IMM: x = in->k; break;
+      case LD_MEM: a = mem[in->k]; break;
+      case LDX_MEM: x = mem[in->k]; break;
+      case LD_DATA: a = g->word[in->k][l]; break;
+      case LDX_DATA: x = g->word[in->k][l]; break;
+      case ST: mem[in->k] = a; memdef |= 1u << in->k; break;
+      case STX: mem[in->k] = x; memdef |= 1u << in->k; break;
+      case JA: pc = in->k; break;
+      case JEQ_K: pc = a == in->k ? in->jt : in->jf; break;
+      case JEQ_X: pc = a == x ? in->jt : in->jf; break;
+      case JGT_K: pc = a > in->k ? in->jt : in->jf; break;
+      case JGT_X: pc = a > x ? in->jt : in->jf; break;
+      case JGE_K: pc = a >= in->k ? in->jt : in->jf; break;
+      case JGE_X: pc = a >= x ? in->jt : in->jf; break;
+      case JSET_K: pc = (a & in->k) ? in->jt : in->jf; break;
+      case JSET_X: pc = (a & x) ? in->jt : in->jf; break;
+      case ALU_K:
+      case ALU_X:
+        switch (in->jt) {
+        case ADD: a += src; break;
+        case SUB: a -= src; break;
+        case MUL: a *= src; break;
+        case DIV:
+          if (src == 0) {
+            g->ret[l] = RET_KILL_THREAD;
+            g->fault[l] = 0;
+            goto next;
+          }
+          a /= src;
+          break;
+        case OR: a |= src; break;
+        case AND: a &= src; break;
+        case LSH: a = src < 32 ? a << src : 0; break;
+        case RSH: a = src < 32 ? a >> src : 0; break;
+        default: a ^= src; break;
+        }
+        break;
+      case NEG: a = -a; break;
+      case TAX: x = a; break;
+      case TXA: a = x; break;
+      default: goto next;  // FAULT
+      }
+    }
+next:;
+  }
+}
+
+#endif
+
+// Low 64 bits of an Integer, two's complement like Ruby's own bit operations.
+// Returns 0 when +v+ is not an Integer.
+static int
+to_u64(VALUE v, uint64_t *out) {
+  if (!RB_INTEGER_TYPE_P(v))
+    return 0;
+  rb_integer_pack(v, out, 1, sizeof(*out), 0,
+                  INTEGER_PACK_LSWORD_FIRST | INTEGER_PACK_NATIVE_BYTE_ORDER | INTEGER_PACK_2COMP);
+  return 1;
+}
+
+// Stores the 64-bit value +v+ into words +w+ and +w+ + 1 of lane +l+; a value
+// that is only known to Ruby (not an Integer) fails the lane.
+static void
+set_words(struct group *g, int l, int w, int n, VALUE v) {
+  uint64_t u;
+
+  if (NIL_P(v))
+    return;
+  if (!to_u64(v, &u)) {
+    g->fault[l] = ~0u;
+    return;
+  }
+  for (int i = 0; i < n; i++) {
+    g->word[w + i][l] = (uint32_t)(u >> (32 * i));
+    g->defined[w + i][l] = ~0u;
+  }
+}
+
+static VALUE
+fetch(VALUE input, VALUE key, VALUE dflt) {
+  VALUE v = rb_hash_lookup2(input, key, Qundef);
+  return v == Qundef ? dflt : v;
+}
+
+// Loads +input+ into lane +l+, see Emulator#run_batch for its keys.
+static void
+load_lane(struct group *g, int l, VALUE input, VALUE dflt[4]) {
+  VALUE args;
+
+  for (int w = 0; w < NWORDS; w++)
+    g->defined[w][l] = 0;
+  g->fault[l] = 0;
+  if (!RB_TYPE_P(input, T_HASH)) {
+    g->fault[l] = ~0u;
+    return;
+  }
+  set_words(g, l, 0, 1, fetch(input, ID2SYM(rb_intern("sys_nr")), dflt[0]));
+  set_words(g, l, 1, 1, dflt[3]);
+  set_words(g, l, 2, 2, fetch(input, ID2SYM(rb_intern("instruction_pointer")), dflt[2]));
+  args = fetch(input, ID2SYM(rb_intern("args")), dflt[1]);
+  if (!RB_TYPE_P(args, T_ARRAY)) {
+    g->fault[l] = ~0u;
+    return;
+  }
+  for (long i = 0; i < 6 && i < RARRAY_LEN(args); i++)
+    set_words(g, l, 4 + 2 * (int)i, 2, RARRAY_AREF(args, i));
+}
+
+// Decodes the Integer array of Emulator#compile, raising on anything
+// run_group can't execute safely.
+static struct insn *
+decode(VALUE code, uint32_t *len) {
+  long n = RARRAY_LEN(code);
+  struct insn *prog;
+
+  if (n % 4 != 0 || n / 4 >= DONE)
+    rb_raise(rb_eArgError, "Invalid program length: %ld", n);
+  *len = (uint32_t)(n / 4);
+  prog = ALLOC_N(struct insn, *len ? *len : 1);
+  for (uint32_t i = 0; i < *len; i++) {
+    struct insn *in = &prog[i];
+    uint32_t *f = &in->op;
+
+    for (int j = 0; j < 4; j++) {
+      VALUE v = RARRAY_AREF(code, 4 * i + j);
+      uint64_t u;
+
+      if (!to_u64(v, &u) || u > UINT32_MAX) {
+        xfree(prog);
+        rb_raise(rb_eArgError, "Invalid instruction at line %u", i);
+      }
+      f[j] = (uint32_t)u;
+    }
+    if (in->op >= NOPCODE ||
+        ((in->op == LD_MEM || in->op == LDX_MEM || in->op == ST || in->op == STX) && in->k >= NMEM) ||
+        ((in->op == LD_DATA || in->op == LDX_DATA) && (in->k > 3 + 5 || in->jt % 32))) {
+      xfree(prog);
+      rb_raise(rb_eArgError, "Invalid instruction at line %u", i);
+    }
+    if (in->op == LD_DATA || in->op == LDX_DATA)
+      // field and shift to word, see struct group
+      in->k = (in->k < 2 ? in->k : in->k == 2 ? 2 : 4 + 2 * (in->k - 3)) + in->jt / 32;
+    if ((in->op == ALU_K || in->op == ALU_X) && in->jt >= NALU) {
+      xfree(prog);
+      rb_raise(rb_eArgError, "Invalid instruction at line %u", i);
+    }
+  }
+  return prog;
+}
+
+struct evaluation {
+  struct insn *prog;
+  uint32_t len;
+  VALUE inputs, dflt[4], result;
+  struct group *g;
+};
+
+static VALUE
+evaluate_body(VALUE arg) {
+  struct evaluation *e = (struct evaluation *)arg;
+  long n = RARRAY_LEN(e->inputs);
+
+  for (long base = 0; base < n; base += LANES) {
+    struct group *g = e->g;
+
+    g->n = n - base < LANES ? (int)(n - base) : LANES;
+    for (int l = 0; l < g->n; l++)
+      load_lane(g, l, RARRAY_AREF(e->inputs, base + l), e->dflt);
+
+    uint32_t failed[LANES];
+    memcpy(failed, g->fault, sizeof(failed));
+    run_group(e->prog, e->len, g);
+    for (int l = 0; l < g->n; l++)
+      rb_ary_push(e->result, failed[l] || g->fault[l] ? Qnil : UINT2NUM(g->ret[l]));
+  }
+  return e->result;
+}
+
+static VALUE
+evaluate_ensure(VALUE arg) {
+  struct evaluation *e = (struct evaluation *)arg;
+
+  xfree(e->prog);
+  xfree(e->g);
+  return Qnil;
+}
+
+/*
+ * Evaluates a compiled filter over many inputs, LANES at a time.
+ *
+ * @param code [Array<Integer>] As returned by Emulator#compile.
+ * @param inputs [Array<Hash>] See Emulator#run_batch.
+ * @param sys_nr, args, instruction_pointer Defaults for keys missing from an input.
+ * @param arch [Integer?] Audit architecture.
+ * @return [Array<Integer?>] The action of each input, nil where Ruby must decide
+ *   (undefined data, a fault, or a value that is not an Integer).
+ */
+static VALUE
+lanes_evaluate(VALUE _mod, VALUE code, VALUE inputs, VALUE sys_nr, VALUE args, VALUE ip, VALUE arch) {
+  struct evaluation e;
+
+  Check_Type(code, T_ARRAY);
+  Check_Type(inputs, T_ARRAY);
+  e.prog = decode(code, &e.len);
+  e.inputs = inputs;
+  e.dflt[0] = sys_nr;
+  e.dflt[1] = args;
+  e.dflt[2] = ip;
+  e.dflt[3] = arch;
+  e.result = rb_ary_new_capa(RARRAY_LEN(inputs));
+  e.g = ZALLOC(struct group);
+  return rb_ensure(evaluate_body, (VALUE)&e, evaluate_ensure, (VALUE)&e);
+}
+
+void Init_lanes(void) {
+  VALUE mSeccompTools = rb_define_module("SeccompTools");
+  VALUE cEmulator = rb_define_class_under(mSeccompTools, "Emulator", rb_cObject);
+  /* Native multi-lane evaluator of Emulator#compile'd filters. */
+  VALUE mLanes = rb_define_module_under(cEmulator, "Lanes");
+
+  /* Number of inputs evaluated together. */
+  rb_define_const(mLanes, "WIDTH", INT2NUM(LANES));
+  /* Evaluates a compiled filter over many inputs. */
+  rb_define_module_function(mLanes, "evaluate", lanes_evaluate, 6);
+}
@@ -4,4 +4,7 @@ require 'mkmf'
 
 extension_name = 'seccomp-tools/ptrace'
 
+# timer_create and timer_settime, for the deadline of a trace, are in librt before glibc 2.34.
+have_library('rt', 'timer_create')
+
 create_makefile(extension_name)
@@ -2,17 +2,59 @@
 // object when installing on other platforms.
 #if __linux__
 
+// for process_vm_readv
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <linux/elf.h>
 #include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <pthread.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/prctl.h>
 #include <sys/ptrace.h>
 #include <sys/signal.h>
 #include <sys/uio.h>
 #include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "ruby.h"
+#include "ruby/thread.h"
+
+// Older libcs lack PTRACE_GET_SYSCALL_INFO (Linux 5.3), and the structure it
+// fills has different names across headers, so spell out the kernel ABI.
+#ifndef PTRACE_GET_SYSCALL_INFO
+#define PTRACE_GET_SYSCALL_INFO 0x420e
+#endif
+#define SYSCALL_INFO_ENTRY 1
+#define SYSCALL_INFO_EXIT 2
+#define SYSCALL_INFO_SECCOMP 3
+
+struct syscall_info {
+  uint8_t op;
+  uint8_t pad[3];
+  uint32_t arch;
+  uint64_t instruction_pointer;
+  uint64_t stack_pointer;
+  union {
+    struct {
+      uint64_t nr;
+      uint64_t args[6];
+    } entry;  // also the layout of the seccomp stop
+    struct {
+      int64_t rval;
+      uint8_t is_error;
+    } exit;
+  };
+};
 
 static VALUE
 ptrace_geteventmsg(VALUE _mod, VALUE pid) {
@@ -21,6 +63,55 @@ ptrace_geteventmsg(VALUE _mod, VALUE pid) {
   return ULONG2NUM(val);  
 }
 
+// Copies len bytes at addr of process pid into buf: with process_vm_readv,
+// falling back to /proc/pid/mem where it is unavailable (e.g. ENOSYS under
+// some sandboxes). Returns 0, or -1 with errno set.
+static int
+read_mem(pid_t pid, uint64_t addr, void *buf, size_t len) {
+  size_t done = 0;
+  char path[32];
+  int fd;
+  while(done < len) {
+    struct iovec local = { (char *)buf + done, len - done };
+    struct iovec remote = { (void *)(uintptr_t)(addr + done), len - done };
+    ssize_t n = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+    if(n <= 0)
+      break;
+    done += n;
+  }
+  if(done == len)
+    return 0;
+  snprintf(path, sizeof(path), "/proc/%d/mem", (int)pid);
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if(fd < 0)
+    return -1;
+  while(done < len) {
+    ssize_t n = pread(fd, (char *)buf + done, len - done, addr + done);
+    if(n <= 0) {
+      if(n == 0)
+        errno = EIO;
+      close(fd);
+      return -1;
+    }
+    done += n;
+  }
+  close(fd);
+  return 0;
+}
+
+static VALUE
+ptrace_read_memory(VALUE _mod, VALUE pid, VALUE addr, VALUE len) {
+  long size = NUM2LONG(len);
+  VALUE str;
+  if(size < 0)
+    rb_raise(rb_eArgError, "negative length");
+  str = rb_str_buf_new(size);
+  if(read_mem(NUM2INT(pid), NUM2ULL(addr), RSTRING_PTR(str), size) != 0)
+    rb_sys_fail("read_memory failed");
+  rb_str_set_len(str, size);
+  return str;
+}
+
 static VALUE
 ptrace_peekdata(VALUE _mod, VALUE pid, VALUE addr, VALUE _data) {
   long val = ptrace(PTRACE_PEEKDATA, NUM2LONG(pid), NUM2LONG(addr), NULL);
@@ -76,6 +167,72 @@ ptrace_peekuser(VALUE _mod, VALUE pid, VALUE off, VALUE _data, VALUE bits) {
   }
 }
 
+static int syscall_info_supported = 1;
+
+// Reads the registers described by layout, [bits, number, ret, *args] (offsets
+// into the NT_PRSTATUS regset), with a single PTRACE_GETREGSET.
+static VALUE
+syscall_regs(pid_t pid, VALUE layout) {
+  char regs[1024];
+  struct iovec vec = { regs, sizeof(regs) };
+  long width, i, n;
+  VALUE vals;
+  int ok;
+
+  Check_Type(layout, T_ARRAY);
+  n = RARRAY_LEN(layout) - 1;
+  width = NUM2LONG(rb_ary_entry(layout, 0));
+  if((width != 32 && width != 64) || n < 2)
+    rb_raise(rb_eArgError, "invalid register layout");
+  width /= 8;
+  ok = ptrace(PTRACE_GETREGSET, pid, NT_PRSTATUS, &vec) != -1;
+  vals = rb_ary_new_capa(n);
+  for(i = 0; i < n; i++) {
+    long offset = NUM2LONG(rb_ary_entry(layout, i + 1));
+    uint32_t val32;
+    uint64_t val64;
+    if(!ok || offset < 0 || (size_t)(offset + width) > vec.iov_len) {
+      rb_ary_push(vals, LONG2NUM(-1));
+      continue;
+    }
+    // The return value is signed, the number and arguments are not.
+    if(width == sizeof(val32)) {
+      memcpy(&val32, regs + offset, width);
+      rb_ary_push(vals, i == 1 ? LONG2NUM((int32_t)val32) : ULONG2NUM(val32));
+    } else {
+      memcpy(&val64, regs + offset, width);
+      rb_ary_push(vals, i == 1 ? LL2NUM((int64_t)val64) : ULL2NUM(val64));
+    }
+  }
+  return rb_ary_new_from_args(4, rb_ary_entry(vals, 0), rb_ary_subseq(vals, 2, n - 2),
+                              rb_ary_entry(vals, 1), Qnil);
+}
+
+// Decodes the syscall a stopped process is at, as [number, args, ret, arch].
+// With PTRACE_GET_SYSCALL_INFO (Linux 5.3) arch is the AUDIT_ARCH_* value, and
+// a syscall entry carries no ret and an exit no number and args (nil). Without
+// it, or at a stop that is not a syscall, the block is yielded for the register
+// layout, see syscall_regs, and arch is nil.
+static VALUE
+ptrace_syscall_info(VALUE _mod, VALUE pid) {
+  struct syscall_info info;
+  if(syscall_info_supported) {
+    long size = ptrace(PTRACE_GET_SYSCALL_INFO, NUM2LONG(pid), sizeof(info), &info);
+    if(size < 0 && errno == EIO)
+      syscall_info_supported = 0;
+    if(size > 0 && (info.op == SYSCALL_INFO_ENTRY || info.op == SYSCALL_INFO_SECCOMP)) {
+      VALUE args = rb_ary_new_capa(6);
+      int i;
+      for(i = 0; i < 6; i++)
+        rb_ary_push(args, ULL2NUM(info.entry.args[i]));
+      return rb_ary_new_from_args(4, ULL2NUM(info.entry.nr), args, Qnil, UINT2NUM(info.arch));
+    }
+    if(size > 0 && info.op == SYSCALL_INFO_EXIT)
+      return rb_ary_new_from_args(4, Qnil, Qnil, LL2NUM(info.exit.rval), UINT2NUM(info.arch));
+  }
+  return syscall_regs(NUM2INT(pid), rb_yield(Qnil));
+}
+
 static VALUE
 ptrace_setoptions(VALUE _mod, VALUE pid, VALUE _addr, VALUE option) {
   if(ptrace(PTRACE_SETOPTIONS, NUM2LONG(pid), NULL, NUM2LONG(option)) != 0)
@@ -90,6 +247,13 @@ ptrace_syscall(VALUE _mod, VALUE pid, VALUE _addr, VALUE sig) {
   return Qnil;
 }
 
+static VALUE
+ptrace_cont(VALUE _mod, VALUE pid, VALUE _addr, VALUE sig) {
+  if(ptrace(PTRACE_CONT, NUM2LONG(pid), NULL, NUM2LONG(sig)) != 0)
+    perror("ptrace cont");
+  return Qnil;
+}
+
 static VALUE
 ptrace_traceme(VALUE _mod) {
   if(ptrace(PTRACE_TRACEME, 0, 0, 0) != 0)
@@ -97,10 +261,30 @@ ptrace_traceme(VALUE _mod) {
   return Qnil;
 }
 
+// The stop is sent to the calling (traced) thread only: sent to the process,
+// it may be taken by another thread, such as one Ruby starts after fork, which
+// is not traced and so stops the process for good.
 static VALUE
 ptrace_traceme_and_stop(VALUE mod) {
   ptrace_traceme(mod);
-  kill(getpid(), SIGSTOP);
+  raise(SIGSTOP);
+  return Qnil;
+}
+
+// Installs the raw filter +bpf+ on the calling process. Without
+// CAP_SYS_ADMIN the kernel refuses (EACCES) unless no_new_privs is set, so set
+// it and retry in that case.
+static VALUE
+ptrace_install_filter(VALUE _mod, VALUE bpf) {
+  struct sock_fprog prog;
+  StringValue(bpf);
+  prog.len = RSTRING_LEN(bpf) / sizeof(struct sock_filter);
+  prog.filter = (struct sock_filter *)RSTRING_PTR(bpf);
+  if(prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog) == 0)
+    return Qnil;
+  if(errno != EACCES || prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0 ||
+     prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog) != 0)
+    rb_sys_fail("install seccomp filter failed");
   return Qnil;
 }
 
@@ -138,6 +322,566 @@ ptrace_detach(VALUE _mod, VALUE pid) {
   return Qnil;
 }
 
+/* Deadlines for blocking waits. */
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+struct deadline {
+  int armed;
+  timer_t timer;
+  struct timespec at;
+};
+
+// Arms a timer that interrupts the calling thread's blocking syscalls from
+// the deadline (a CLOCK_MONOTONIC time in seconds, nil for none) on, with
+// SIGVTALRM - the signal Ruby itself interrupts blocking regions with. It keeps
+// firing every millisecond until disarmed, so a waitpid entered right after
+// the first expiry is interrupted as well.
+static void
+deadline_arm(struct deadline *d, VALUE at) {
+  struct sigevent sev;
+  struct itimerspec its;
+  double secs;
+  memset(d, 0, sizeof(*d));
+  if(NIL_P(at))
+    return;
+  secs = NUM2DBL(at);
+  d->at.tv_sec = (time_t)secs;
+  d->at.tv_nsec = (long)((secs - (double)d->at.tv_sec) * 1e9);
+  memset(&sev, 0, sizeof(sev));
+  sev.sigev_notify = SIGEV_THREAD_ID;
+  sev.sigev_signo = SIGVTALRM;
+  sev.sigev_notify_thread_id = syscall(SYS_gettid);
+  if(timer_create(CLOCK_MONOTONIC, &sev, &d->timer) != 0)
+    rb_sys_fail("timer_create failed");
+  its.it_value = d->at;
+  its.it_interval.tv_sec = 0;
+  its.it_interval.tv_nsec = 1000000;
+  if(d->at.tv_sec <= 0 && d->at.tv_nsec <= 0)
+    its.it_value.tv_nsec = 1;  // zero would disarm the timer
+  d->armed = 1;
+  if(timer_settime(d->timer, TIMER_ABSTIME, &its, NULL) != 0)
+    rb_sys_fail("timer_settime failed");
+}
+
+static int
+deadline_passed(const struct deadline *d) {
+  struct timespec now;
+  if(!d->armed)
+    return 0;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec > d->at.tv_sec || (now.tv_sec == d->at.tv_sec && now.tv_nsec >= d->at.tv_nsec);
+}
+
+static VALUE
+deadline_disarm(VALUE arg) {
+  struct deadline *d = (struct deadline *)arg;
+  if(d->armed)
+    timer_delete(d->timer);
+  d->armed = 0;
+  return Qnil;
+}
+
+struct wait_args {
+  const struct deadline *deadline;
+  pid_t tid;
+  int status;
+  int err;
+};
+
+static void *
+wait_nogvl(void *arg) {
+  struct wait_args *w = arg;
+  w->tid = deadline_passed(w->deadline) ? 0 : waitpid(-1, &w->status, __WALL);
+  w->err = errno;
+  return NULL;
+}
+
+static VALUE
+wait_body(VALUE arg) {
+  struct wait_args *w = (struct wait_args *)arg;
+  for(;;) {
+    rb_thread_call_without_gvl(wait_nogvl, w, RUBY_UBF_IO, NULL);
+    if(w->tid > 0)
+      return rb_ary_new_from_args(2, INT2NUM(w->tid), INT2NUM(w->status));
+    if(w->tid == 0 || deadline_passed(w->deadline))
+      return Qnil;
+    if(w->err != EINTR) {
+      errno = w->err;
+      rb_sys_fail("waitpid failed");
+    }
+    rb_thread_check_ints();
+  }
+}
+
+// Waits for any child (or tracee) to change state, like waitpid(-1, __WALL),
+// until the deadline. Returns [tid, status], or nil once the deadline passed.
+static VALUE
+ptrace_wait(VALUE _mod, VALUE deadline) {
+  struct deadline d;
+  struct wait_args w = { &d, 0, 0, 0 };
+  deadline_arm(&d, deadline);
+  return rb_ensure(wait_body, (VALUE)&w, deadline_disarm, (VALUE)&d);
+}
+
+/* Native tracing engine, see ptrace_trace. */
+
+// The installation syscalls of one architecture, as given by Ruby.
+struct trace_abi {
+  uint32_t arch;
+  uint64_t prctl, seccomp;
+  int ptr_size;
+};
+
+struct tracee {
+  pid_t tid;
+  int in_syscall;
+  // The syscall being executed installs a filter (or strict mode).
+  int installing;
+  int strict;
+  // For strict mode: the kernel accepts the arguments (seccomp's flags and
+  // pointer are zero, prctl ignores them).
+  int strict_valid;
+  uint32_t arch;
+  uint64_t fprog;
+};
+
+struct tracer {
+  int trap;
+  struct trace_abi *abis;
+  long nabi;
+  struct deadline deadline;
+  struct tracee *tracees;
+  size_t ntracee, cap;
+  // Open-addressing hash from tid to 1 + its index in tracees (0 for empty),
+  // so a stop costs the same however many threads are traced.
+  size_t *slots;
+  size_t nslot;
+  // How many of tracees have been added to the Ruby hash.
+  size_t reported;
+  // Outcome of the last trace_wait.
+  enum { TRACE_DONE, TRACE_FOUND, TRACE_INTERRUPTED, TRACE_TIMEOUT } result;
+  pid_t found_tid;
+  uint32_t found_arch;
+  struct sock_filter *found_filter;  // NULL for strict mode
+  unsigned short found_len;
+};
+
+static size_t *
+tracee_slot(size_t *slots, size_t nslot, const struct tracee *tracees, pid_t tid) {
+  size_t i = ((uint32_t)tid * 2654435761u) & (nslot - 1);
+  while(slots[i] && tracees[slots[i] - 1].tid != tid)
+    i = (i + 1) & (nslot - 1);
+  return &slots[i];
+}
+
+// The state of tid, added when it is new. NULL when out of memory.
+static struct tracee *
+tracee_of(struct tracer *t, pid_t tid) {
+  size_t *slot, i;
+  if(t->nslot) {
+    slot = tracee_slot(t->slots, t->nslot, t->tracees, tid);
+    if(*slot)
+      return &t->tracees[*slot - 1];
+  }
+  if(t->ntracee == t->cap) {
+    size_t cap = t->cap ? t->cap * 2 : 8;
+    struct tracee *p = realloc(t->tracees, cap * sizeof(*p));
+    size_t *slots = calloc(cap * 2, sizeof(*slots));
+    if(p)
+      t->tracees = p;
+    if(!p || !slots) {
+      free(slots);
+      return NULL;
+    }
+    for(i = 0; i < t->ntracee; i++)
+      *tracee_slot(slots, cap * 2, t->tracees, t->tracees[i].tid) = i + 1;
+    free(t->slots);
+    t->slots = slots;
+    t->nslot = cap * 2;
+    t->cap = cap;
+  }
+  memset(&t->tracees[t->ntracee], 0, sizeof(struct tracee));
+  t->tracees[t->ntracee].tid = tid;
+  *tracee_slot(t->slots, t->nslot, t->tracees, tid) = ++t->ntracee;
+  return &t->tracees[t->ntracee - 1];
+}
+
+static const struct trace_abi *
+abi_of(const struct tracer *t, uint32_t arch) {
+  long i;
+  for(i = 0; i < t->nabi; i++)
+    if(t->abis[i].arch == arch)
+      return &t->abis[i];
+  return NULL;
+}
+
+// At a syscall entry (or seccomp stop): does it install a filter?
+static void
+trace_entry(struct tracer *t, struct tracee *te, const struct syscall_info *info) {
+  const struct trace_abi *abi = abi_of(t, info->arch);
+  const uint64_t *args = info->entry.args;
+  te->installing = 0;
+  if(!abi)
+    return;
+  if(info->entry.nr == abi->seccomp && args[0] <= SECCOMP_SET_MODE_FILTER) {
+    te->installing = 1;
+    te->strict = args[0] == SECCOMP_SET_MODE_STRICT;
+    te->strict_valid = args[1] == 0 && args[2] == 0;
+  } else if(info->entry.nr == abi->prctl && args[0] == PR_SET_SECCOMP &&
+            (args[1] == SECCOMP_MODE_STRICT || args[1] == SECCOMP_MODE_FILTER)) {
+    te->installing = 1;
+    te->strict = args[1] == SECCOMP_MODE_STRICT;
+    te->strict_valid = 1;
+  }
+  te->arch = info->arch;
+  te->fprog = args[2];
+}
+
+// At the exit of an installation: copies the filter out. Returns 1 when it
+// succeeded. In trap mode the kernel refuses strict mode because of the trap
+// filter, so there a strict-mode call with valid arguments failing with
+// EINVAL, the mode conflict, counts as installed.
+static int
+trace_exit(struct tracer *t, struct tracee *te, const struct syscall_info *info) {
+  const struct trace_abi *abi = abi_of(t, te->arch);
+  unsigned char fprog[16] = { 0 };
+  uint64_t filter = 0;
+  unsigned short len;
+  if(!abi)
+    return 0;
+  if(t->trap && te->strict) {
+    if(!te->strict_valid || info->exit.rval != -EINVAL)
+      return 0;
+  } else if(info->exit.rval != 0) {
+    return 0;
+  }
+  t->found_tid = te->tid;
+  t->found_arch = te->arch;
+  t->found_filter = NULL;
+  t->found_len = 0;
+  if(te->strict)
+    return 1;
+  if(read_mem(te->tid, te->fprog, fprog, 2 * abi->ptr_size) != 0)
+    return 0;
+  memcpy(&len, fprog, sizeof(len));
+  if(abi->ptr_size == 4) {
+    uint32_t p32;
+    memcpy(&p32, fprog + 4, sizeof(p32));
+    filter = p32;
+  } else {
+    memcpy(&filter, fprog + 8, sizeof(filter));
+  }
+  t->found_filter = malloc(sizeof(struct sock_filter) * (len ? len : 1));
+  if(!t->found_filter ||
+     read_mem(te->tid, filter, t->found_filter, sizeof(struct sock_filter) * len) != 0) {
+    free(t->found_filter);
+    t->found_filter = NULL;
+    return 0;
+  }
+  t->found_len = len;
+  return 1;
+}
+
+// Waits for tracee stops and resumes them, until a filter has been installed,
+// no tracees are left, the deadline passed, or waitpid is interrupted
+// (RUBY_UBF_IO kicks the thread with a signal). Runs without the GVL.
+static void *
+trace_wait(void *arg) {
+  struct tracer *t = arg;
+  for(;;) {
+    int status, found = 0;
+    struct tracee *te;
+    pid_t tid;
+    if(deadline_passed(&t->deadline)) {
+      t->result = TRACE_TIMEOUT;
+      return NULL;
+    }
+    tid = waitpid(-1, &status, __WALL);
+    if(tid < 0) {
+      t->result = errno == EINTR ? TRACE_INTERRUPTED : TRACE_DONE;
+      return NULL;
+    }
+    te = tracee_of(t, tid);
+    if(!WIFSTOPPED(status) || !te)
+      continue;
+    if(status >> 16 == PTRACE_EVENT_SECCOMP || (status >> 8) == (SIGTRAP | 0x80)) {
+      struct syscall_info info;
+      if(ptrace(PTRACE_GET_SYSCALL_INFO, tid, sizeof(info), &info) > 0) {
+        if(info.op == SYSCALL_INFO_ENTRY || info.op == SYSCALL_INFO_SECCOMP) {
+          te->in_syscall = 1;
+          trace_entry(t, te, &info);
+        } else if(info.op == SYSCALL_INFO_EXIT) {
+          te->in_syscall = 0;
+          found = te->installing && trace_exit(t, te, &info);
+          te->installing = 0;
+        }
+      }
+    }
+    // In trap mode only the exit of a trapped syscall needs a syscall stop.
+    ptrace(t->trap && !te->in_syscall ? PTRACE_CONT : PTRACE_SYSCALL, tid, NULL, 0);
+    if(found) {
+      t->result = TRACE_FOUND;
+      return NULL;
+    }
+  }
+}
+
+struct trace_args {
+  struct tracer *t;
+  VALUE tracees;
+};
+
+static VALUE
+trace_body(VALUE arg) {
+  struct trace_args *a = (struct trace_args *)arg;
+  struct tracer *t = a->t;
+  for(;;) {
+    VALUE bpf = Qnil;
+    rb_thread_call_without_gvl(trace_wait, t, RUBY_UBF_IO, NULL);
+    for(; t->reported < t->ntracee; t->reported++) {
+      VALUE tid = INT2NUM(t->tracees[t->reported].tid);
+      if(rb_hash_lookup2(a->tracees, tid, Qundef) == Qundef)
+        rb_hash_aset(a->tracees, tid, Qnil);
+    }
+    if(t->result == TRACE_INTERRUPTED) {
+      rb_thread_check_ints();
+      continue;
+    }
+    if(t->result == TRACE_DONE || t->result == TRACE_TIMEOUT)
+      return Qnil;
+    if(t->found_filter) {
+      bpf = rb_str_new((const char *)t->found_filter, sizeof(struct sock_filter) * t->found_len);
+      free(t->found_filter);
+      t->found_filter = NULL;
+    }
+    if(!RTEST(rb_yield_values(3, INT2NUM(t->found_tid), bpf, UINT2NUM(t->found_arch))))
+      return Qnil;
+  }
+}
+
+static VALUE
+trace_cleanup(VALUE arg) {
+  struct tracer *t = ((struct trace_args *)arg)->t;
+  deadline_disarm((VALUE)&t->deadline);
+  free(t->found_filter);
+  free(t->tracees);
+  free(t->slots);
+  return Qnil;
+}
+
+// Traces the stopped process pid (already set up with PTRACE_SETOPTIONS) and
+// its descendants natively until the deadline (see deadline_arm), yielding
+// each successful installation. Every tid seen is added as a key of tracees.
+// Returns false without resuming anything when the kernel lacks
+// PTRACE_GET_SYSCALL_INFO.
+static VALUE
+ptrace_trace(VALUE _mod, VALUE pid_v, VALUE tracees, VALUE abis, VALUE trap, VALUE deadline) {
+  struct tracer t;
+  struct trace_args a = { &t, tracees };
+  struct syscall_info info;
+  pid_t pid = NUM2INT(pid_v);
+  long i;
+
+  Check_Type(abis, T_ARRAY);
+  Check_Type(tracees, T_HASH);
+  if(ptrace(PTRACE_GET_SYSCALL_INFO, pid, sizeof(info), &info) <= 0)
+    return Qfalse;
+  memset(&t, 0, sizeof(t));
+  t.trap = RTEST(trap);
+  t.nabi = RARRAY_LEN(abis);
+  t.abis = ALLOCA_N(struct trace_abi, t.nabi);
+  for(i = 0; i < t.nabi; i++) {
+    VALUE abi = rb_ary_entry(abis, i);
+    t.abis[i].arch = NUM2UINT(rb_ary_entry(abi, 0));
+    t.abis[i].prctl = NUM2ULL(rb_ary_entry(abi, 1));
+    t.abis[i].seccomp = NUM2ULL(rb_ary_entry(abi, 2));
+    t.abis[i].ptr_size = NUM2INT(rb_ary_entry(abi, 3));
+  }
+  deadline_arm(&t.deadline, deadline);
+  if(!tracee_of(&t, pid)) {
+    trace_cleanup((VALUE)&a);
+    rb_memerror();
+  }
+  ptrace(t.trap ? PTRACE_CONT : PTRACE_SYSCALL, pid, NULL, 0);
+  rb_ensure(trace_body, (VALUE)&a, trace_cleanup, (VALUE)&a);
+  return Qtrue;
+}
+
+/* Parallel PTRACE_SECCOMP_GET_FILTER, see ptrace_seccomp_get_filters. */
+
+struct filter_job {
+  pid_t tid;
+  int err;
+  long nfilter;
+  struct {
+    struct sock_filter *insts;
+    long count;
+  } *filters;
+};
+
+struct filter_pool {
+  struct filter_job *jobs;
+  long njob;
+  long limit;
+  long next;  // index of the next job to take, shared by the workers
+  volatile int cancelled;
+};
+
+// Seizes tid, stops it, reads up to limit filters and detaches. PTRACE_SEIZE
+// with PTRACE_INTERRUPT, unlike PTRACE_ATTACH, sends the tracee no SIGSTOP.
+static void
+get_filters(struct filter_job *job, long limit) {
+  int status;
+  long idx;
+  if(ptrace(PTRACE_SEIZE, job->tid, 0, 0) != 0) {
+    job->err = errno;
+    return;
+  }
+  errno = 0;
+  if(ptrace(PTRACE_INTERRUPT, job->tid, 0, 0) != 0 ||
+     waitpid(job->tid, &status, __WALL) != job->tid || !WIFSTOPPED(status)) {
+    job->err = errno ? errno : ESRCH;
+    ptrace(PTRACE_DETACH, job->tid, 0, 0);
+    return;
+  }
+  for(idx = 0; limit < 0 || idx < limit; idx++) {
+    long count = ptrace(PTRACE_SECCOMP_GET_FILTER, job->tid, idx, NULL);
+    struct sock_filter *insts;
+    void *filters;
+    if(count < 0) {
+      if(errno != ENOENT && errno != EINVAL)
+        job->err = errno;
+      break;
+    }
+    insts = malloc(sizeof(struct sock_filter) * (count ? count : 1));
+    filters = realloc(job->filters, sizeof(*job->filters) * (idx + 1));
+    if(!insts || !filters) {
+      free(insts);
+      if(filters)
+        job->filters = filters;
+      job->err = ENOMEM;
+      break;
+    }
+    job->filters = filters;
+    if(ptrace(PTRACE_SECCOMP_GET_FILTER, job->tid, idx, insts) != count) {
+      free(insts);
+      job->err = errno;
+      break;
+    }
+    job->filters[idx].insts = insts;
+    job->filters[idx].count = count;
+    job->nfilter = idx + 1;
+  }
+  ptrace(PTRACE_DETACH, job->tid, 0, 0);
+}
+
+static void *
+filter_worker(void *arg) {
+  struct filter_pool *pool = arg;
+  while(!pool->cancelled) {
+    long i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+    if(i >= pool->njob)
+      break;
+    get_filters(&pool->jobs[i], pool->limit);
+  }
+  return NULL;
+}
+
+struct filter_run {
+  struct filter_pool *pool;
+  long nworker;
+};
+
+// Runs the workers and waits for them, without the GVL.
+static void *
+filter_run(void *arg) {
+  struct filter_run *run = arg;
+  pthread_t *threads = malloc(sizeof(pthread_t) * run->nworker);
+  long i, started = 0;
+  if(threads)
+    for(; started < run->nworker; started++)
+      if(pthread_create(&threads[started], NULL, filter_worker, run->pool) != 0)
+        break;
+  // Without threads, do the work here.
+  if(started == 0)
+    filter_worker(run->pool);
+  for(i = 0; i < started; i++)
+    pthread_join(threads[i], NULL);
+  free(threads);
+  return NULL;
+}
+
+static void
+filter_ubf(void *arg) {
+  ((struct filter_pool *)arg)->cancelled = 1;
+}
+
+// Runs the pool until every job is done. Any interrupt (a SIGCHLD from a
+// tracee stopping, too) cancels the workers, so handle it and resume.
+static VALUE
+filter_body(VALUE arg) {
+  struct filter_run *run = (struct filter_run *)arg;
+  struct filter_pool *pool = run->pool;
+  VALUE result;
+  long i, j;
+  while(pool->next < pool->njob) {
+    pool->cancelled = 0;
+    rb_thread_call_without_gvl(filter_run, run, filter_ubf, pool);
+    rb_thread_check_ints();
+  }
+  result = rb_ary_new_capa(pool->njob);
+  for(i = 0; i < pool->njob; i++) {
+    struct filter_job *job = &pool->jobs[i];
+    VALUE filters;
+    if(job->err && job->nfilter == 0) {
+      rb_ary_push(result, INT2NUM(job->err));
+      continue;
+    }
+    filters = rb_ary_new_capa(job->nfilter);
+    for(j = 0; j < job->nfilter; j++)
+      rb_ary_push(filters, rb_str_new((const char *)job->filters[j].insts,
+                                      sizeof(struct sock_filter) * job->filters[j].count));
+    rb_ary_push(result, filters);
+  }
+  return result;
+}
+
+static VALUE
+filter_cleanup(VALUE arg) {
+  struct filter_pool *pool = (struct filter_pool *)arg;
+  long i, j;
+  for(i = 0; i < pool->njob; i++) {
+    for(j = 0; j < pool->jobs[i].nfilter; j++)
+      free(pool->jobs[i].filters[j].insts);
+    free(pool->jobs[i].filters);
+  }
+  xfree(pool->jobs);
+  return Qnil;
+}
+
+// Reads the seccomp filters of many threads at once from worker threads
+// without the GVL. Returns, for each tid, an Array of its filters (up to
+// limit, negative for all), or the errno that stopped the first one.
+static VALUE
+ptrace_seccomp_get_filters(VALUE _mod, VALUE tids, VALUE limit, VALUE workers) {
+  struct filter_pool pool;
+  struct filter_run run = { &pool, NUM2LONG(workers) };
+  long i;
+
+  Check_Type(tids, T_ARRAY);
+  memset(&pool, 0, sizeof(pool));
+  pool.njob = RARRAY_LEN(tids);
+  pool.limit = NUM2LONG(limit);
+  pool.jobs = ZALLOC_N(struct filter_job, pool.njob);
+  for(i = 0; i < pool.njob; i++)
+    pool.jobs[i].tid = NUM2INT(rb_ary_entry(tids, i));
+  if(run.nworker > pool.njob)
+    run.nworker = pool.njob;
+  return rb_ensure(filter_body, (VALUE)&run, filter_cleanup, (VALUE)&pool);
+}
 
 void Init_ptrace(void) {
   VALUE mSeccompTools = rb_define_module("SeccompTools");
@@ -146,10 +890,12 @@ void Init_ptrace(void) {
 
   /* consts */
   rb_define_const(mPtrace, "EVENT_CLONE", UINT2NUM(PTRACE_EVENT_CLONE));
+  rb_define_const(mPtrace, "EVENT_SECCOMP", UINT2NUM(PTRACE_EVENT_SECCOMP));
   rb_define_const(mPtrace, "EVENT_FORK", UINT2NUM(PTRACE_EVENT_FORK));
   rb_define_const(mPtrace, "EVENT_VFORK", UINT2NUM(PTRACE_EVENT_VFORK));
   rb_define_const(mPtrace, "O_TRACECLONE", UINT2NUM(PTRACE_O_TRACECLONE));
   rb_define_const(mPtrace, "O_TRACEFORK", UINT2NUM(PTRACE_O_TRACEFORK));
+  rb_define_const(mPtrace, "O_TRACESECCOMP", UINT2NUM(PTRACE_O_TRACESECCOMP));
   rb_define_const(mPtrace, "O_TRACESYSGOOD", UINT2NUM(PTRACE_O_TRACESYSGOOD));
   rb_define_const(mPtrace, "O_TRACEVFORK", UINT2NUM(PTRACE_O_TRACEVFORK));
 
@@ -157,22 +903,36 @@ void Init_ptrace(void) {
   rb_define_module_function(mPtrace, "geteventmsg", ptrace_geteventmsg, 1);
   /* get data */
   rb_define_module_function(mPtrace, "peekdata", ptrace_peekdata, 3);
+  /* read a range of memory */
+  rb_define_module_function(mPtrace, "read_memory", ptrace_read_memory, 3);
   /* get registers */
   rb_define_module_function(mPtrace, "peekuser", ptrace_peekuser, 4);
+  /* decode the current syscall */
+  rb_define_module_function(mPtrace, "syscall_info", ptrace_syscall_info, 1);
   /* set ptrace options */
   rb_define_module_function(mPtrace, "setoptions", ptrace_setoptions, 3);
   /* wait for syscall */
   rb_define_module_function(mPtrace, "syscall", ptrace_syscall, 3);
+  /* continue until the next signal or event */
+  rb_define_module_function(mPtrace, "cont", ptrace_cont, 3);
   /* wait for its parent to attach */
   rb_define_module_function(mPtrace, "traceme", ptrace_traceme, 0);
   /* stop itself before parent attaching */
   rb_define_module_function(mPtrace, "traceme_and_stop", ptrace_traceme_and_stop, 0);
+  /* install a seccomp filter on the calling process */
+  rb_define_module_function(mPtrace, "install_filter", ptrace_install_filter, 1);
   /* attach to an existing process */
   rb_define_module_function(mPtrace, "attach_and_wait", ptrace_attach_and_wait, 1);
   /* retrieve seccomp filter */
   rb_define_module_function(mPtrace, "seccomp_get_filter", ptrace_seccomp_get_filter, 2);
+  /* retrieve the seccomp filters of many threads in parallel */
+  rb_define_module_function(mPtrace, "seccomp_get_filters", ptrace_seccomp_get_filters, 3);
   /* detach from an existing process */
   rb_define_module_function(mPtrace, "detach", ptrace_detach, 1);
+  /* trace a process natively, yielding installed seccomp filters */
+  rb_define_module_function(mPtrace, "trace", ptrace_trace, 5);
+  /* wait for a child or tracee until a deadline */
+  rb_define_module_function(mPtrace, "wait", ptrace_wait, 1);
 }
 
 #endif  /* __linux__ */
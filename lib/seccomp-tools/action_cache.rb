@@ -0,0 +1,154 @@
+# frozen_string_literal: true
+
+require 'set'
+
+require 'seccomp-tools/action_cache/report'
+require 'seccomp-tools/audit/policy'
+require 'seccomp-tools/const'
+require 'seccomp-tools/explain/analysis'
+require 'seccomp-tools/symbolic/executor'
+
+module SeccompTools
+  # Which syscalls the kernel's seccomp action cache (Linux 5.11 and later) lets skip a filter.
+  #
+  # When a filter is installed the kernel emulates it once per syscall number, knowing nothing but
+  # +nr+ and +arch+, and records in a per-architecture bitmap the syscalls that reach
+  # +return ALLOW+ along the way; those never run the filter again. The emulation
+  # (+seccomp_is_const_allow+ in +kernel/seccomp.c+) understands only loads of +nr+ and +arch+,
+  # comparisons against constants, +ja+, +A &= k+ and +return k+, and gives up at any other
+  # instruction - an +args+ or +instruction_pointer+ load, other arithmetic, the X register, the
+  # scratch memory - so a filter that loads an argument before deciding a syscall keeps the
+  # syscall out of the cache even when the argument does not change the outcome.
+  #
+  # {#analyze} replicates that emulation for every syscall of the architectures the kernel keeps a
+  # bitmap for, and explains each allowed syscall left out: it walks the filter with the
+  # {Symbolic::Executor} and asks the architecture's {Audit::Policy} whether the syscall can reach
+  # anything but +ALLOW+. When it cannot, the blocking instruction does not matter to the outcome
+  # and a rewrite deciding the syscall on its number alone - what +seccomp-tools optimize+ emits -
+  # makes it cacheable.
+  #
+  # @example
+  #   insts = SeccompTools::Disasm.to_bpf(raw, :amd64).map(&:inst)
+  #   puts SeccompTools::ActionCache.new(insts, arch: :amd64, source: 'a.out').analyze
+  class ActionCache
+    # The architectures the kernel keeps a bitmap for, by the architecture it runs on: the native
+    # one and its compat one, when seccomp-tools knows it. x32 syscalls are numbered beyond the
+    # bitmap, so they are never cached.
+    ARCHES = {
+      amd64: %i[amd64 i386],
+      i386: %i[i386],
+      aarch64: %i[aarch64],
+      riscv64: %i[riscv64],
+      s390x: %i[s390x]
+    }.freeze
+
+    # Syscalls at or beyond this number are outside the bitmap (the x32 ones on amd64).
+    NR_LIMIT = 0x40000000
+
+    # @param [Array<Instruction::Base>] instructions
+    #   The filter, as +SeccompTools::Disasm.to_bpf(raw, arch).map(&:inst)+.
+    # @param [Symbol] arch
+    #   The architecture the filter is installed on.
+    # @param [String?] source
+    #   A label for the filter (e.g. a filename) shown in the report.
+    def initialize(instructions, arch:, source: nil)
+      @instructions = instructions
+      @arch = arch
+      @source = source
+    end
+
+    # Classifies every syscall the filter can allow, on each architecture the kernel caches.
+    # @return [Report]
+    def analyze
+      leaves, truncated = Symbolic::Executor.new(@instructions).run
+      analysis = Explain::Analysis.new(leaves)
+      sections = ARCHES.fetch(@arch, [@arch]).map { |arch| section(analysis, arch) }
+      Report.new(source: @source, sections:, truncated:)
+    end
+
+    # Would the kernel cache syscall +nr+ of +arch+ as always allowed? An exact replica of
+    # +seccomp_is_const_allow+.
+    # @param [Symbol] arch
+    # @param [Integer] nr
+    # @return [Boolean]
+    def cacheable?(arch, nr)
+      emulate(audit(arch), nr).nil?
+    end
+
+    private
+
+    # One architecture's entries: every syscall +ALLOW+ is reachable for, below {NR_LIMIT}.
+    def section(analysis, arch)
+      val = audit(arch)
+      policy = Audit::Policy.new(analysis, [val, arch, arch, analysis.leaves_for(val)])
+      allowed = policy.allowed(policy.table.values.select { |nr| nr < NR_LIMIT }).to_set
+      entries = policy.table.filter_map do |name, nr|
+        next unless allowed.include?(nr)
+
+        line = emulate(val, nr)
+        next Report::Entry.new(name.to_s, nr, true) if line.nil?
+
+        blocker = @instructions[line]
+        # decided on nr and arch alone, and not allowed after all (the walk could not follow A &= k)
+        next if reason(blocker) == :action
+
+        hoistable = policy.reachable_actions(nr) == ['ALLOW']
+        Report::Entry.new(name.to_s, nr, false, line, blocker.decompile, reason(blocker), hoistable)
+      end
+      Report::Section.new(arch.to_s, entries.sort_by(&:nr))
+    end
+
+    # Runs the kernel's emulation, returning +nil+ when it reaches +return ALLOW+, or else the line
+    # it stops at: a +return+ of something else, or an instruction it cannot emulate.
+    def emulate(arch_val, nr)
+      data = Const::BPF::SeccompData
+      allow = Const::BPF::ACTION[:ALLOW]
+      a = 0
+      pc = 0
+      while pc < @instructions.size
+        op, *args = @instructions[pc].symbolize
+        case op
+        when :ld
+          dst, src = args
+          return pc unless dst == :a && src[:rel] == :data && [data::SYS_NUMBER, data::ARCH].include?(src[:val])
+
+          a = src[:val] == data::ARCH ? arch_val : nr
+        when :ret then return args[0] == allow ? nil : pc
+        when :jmp then pc += args[0]
+        when :cmp
+          cmp, src, jt, jf = args
+          return pc if src == :x
+
+          pc += Symbolic::Constraint.evaluate(a, cmp == :& ? :set : cmp, src) ? jt : jf
+        when :alu
+          return pc unless args[0] == :& && args[1].is_a?(Integer)
+
+          a &= args[1]
+        else return pc
+        end
+        pc += 1
+      end
+      # ran off the end, which the kernel refuses to install anyway
+      @instructions.size - 1
+    end
+
+    # Why the emulation stopped at +inst+.
+    def reason(inst)
+      op, *args = inst.symbolize
+      data = Const::BPF::SeccompData
+      case op
+      when :ret then args[0] == :a ? :other : :action
+      when :ld
+        return :other unless args[1][:rel] == :data
+
+        args[1][:val] >= data::ARGS ? :args : :instruction_pointer
+      when :alu then :alu
+      else :other
+      end
+    end
+
+    def audit(arch)
+      Const::Audit::ARCH[Const::Audit::ARCH_NAME[arch]]
+    end
+  end
+end
@@ -0,0 +1,134 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/util'
+
+module SeccompTools
+  class ActionCache
+    # Which allowed syscalls of one filter (or of several stacked ones) the kernel caches, rendered
+    # either as a human report or a JSON-ready hash.
+    class Report
+      # One syscall +ALLOW+ is reachable for. When it is not +cacheable+, +line+ and +instruction+
+      # name where the kernel's emulation gave up, +reason+ says why (a key of {REASONS}), and
+      # +hoistable+ whether the syscall is allowed whatever its arguments, so a filter deciding it
+      # on its number alone gets it cached.
+      Entry = Struct.new(:name, :nr, :cacheable, :line, :instruction, :reason, :hoistable)
+
+      # The allowed syscalls of one architecture, by number.
+      Section = Struct.new(:arch, :entries) do
+        # @return [Array<Entry>]
+        def cached
+          entries.select(&:cacheable)
+        end
+
+        # @return [Array<Entry>]
+        def uncached
+          entries.reject(&:cacheable)
+        end
+      end
+
+      # What stops the kernel's emulation, by {Entry#reason}.
+      REASONS = {
+        args: 'loads an argument',
+        instruction_pointer: 'reads instruction_pointer',
+        alu: 'does arithmetic other than A &= k',
+        other: 'uses an instruction the kernel does not emulate'
+      }.freeze
+
+      # @return [Array<Section>]
+      attr_reader :sections
+
+      # @param [String?] source Label for the analysed filter.
+      # @param [Array<Section>] sections One per cached architecture.
+      # @param [Boolean] truncated Whether the symbolic walk was cut short.
+      def initialize(source:, sections:, truncated:)
+        @source = source
+        @sections = sections
+        @truncated = truncated
+      end
+
+      # The cache of +reports+' filters stacked: the kernel caches a syscall only when every filter
+      # lets it, so per architecture a syscall is listed when every filter allows it, and cached
+      # when every filter caches it. An uncached one is explained by the first filter that blocks it.
+      # @param [Array<Report>] reports
+      # @param [String?] source
+      # @return [Report]
+      def self.stack(reports, source: nil)
+        arches = reports.map { |r| r.sections.map(&:arch) }.reduce(:&)
+        sections = arches.map do |arch|
+          lists = reports.map { |r| r.sections.find { |s| s.arch == arch }.entries.to_h { |e| [e.nr, e] } }
+          entries = lists.first.keys.filter_map do |nr|
+            all = lists.map { |l| l[nr] }
+            next if all.include?(nil)
+
+            blocked = all.reject(&:cacheable)
+            next all.first if blocked.empty?
+
+            blocked.first.dup.tap { |e| e.hoistable = blocked.all?(&:hoistable) }
+          end
+          Section.new(arch, entries)
+        end
+        new(source:, sections:, truncated: reports.any?(&:truncated?))
+      end
+
+      # @return [Boolean] Whether the symbolic walk was cut short, so allowed syscalls may be missing.
+      def truncated?
+        @truncated
+      end
+
+      # The human report.
+      # @return [String]
+      def to_s
+        out = +''
+        out << "Action cache of #{@source}\n" if @source
+        out << "Allowed syscalls the kernel (5.11+) decides once, when the filter is installed, instead of\n" \
+               "running the filter on every call.\n"
+        out << "WARNING: analysis truncated (filter too large); results may be incomplete.\n" if @truncated
+        @sections.each { |section| out << "\n" << render(section) }
+        out
+      end
+
+      # @return [Hash] JSON-ready shape for one filter.
+      def to_h
+        {
+          source: @source,
+          truncated: @truncated,
+          arches: @sections.map do |s|
+            {
+              arch: s.arch,
+              cached: s.cached.map(&:name),
+              uncached: s.uncached.map do |e|
+                { name: e.name, number: e.nr, line: e.line, instruction: e.instruction, reason: e.reason,
+                  hoistable: e.hoistable }
+              end
+            }
+          end
+        }
+      end
+
+      private
+
+      def render(section)
+        out = "Architecture: #{Util.colorize(section.arch, t: :arch)}\n"
+        entries = section.entries
+        return out << "\n  (no syscall is allowed)\n" if entries.empty?
+
+        uncached = section.uncached
+        out << "  #{section.cached.size} of #{entries.size} allowed syscall#{'s' if entries.size > 1} cached\n"
+        return out if uncached.empty?
+
+        width = uncached.map { |e| e.name.size }.max
+        out << "\n  Not cached:\n"
+        uncached.each do |e|
+          out << "    #{Util.colorize(e.name.ljust(width), t: :syscall)}  " \
+                 "#{format('%04d', e.line)}: #{e.instruction} (#{REASONS[e.reason]})#{' *' if e.hoistable}\n"
+        end
+        hoistable = uncached.count(&:hoistable)
+        return out if hoistable.zero?
+
+        out << "\n  * #{hoistable} always allowed whatever the arguments: `seccomp-tools optimize` decides " \
+               "#{hoistable > 1 ? 'them' : 'it'}\n    on the syscall number alone, so the kernel caches " \
+               "#{hoistable > 1 ? 'them' : 'it'}.\n"
+      end
+    end
+  end
+end
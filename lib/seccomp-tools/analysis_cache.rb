@@ -0,0 +1,204 @@
+# frozen_string_literal: true
+
+require 'digest'
+require 'fileutils'
+require 'zlib'
+
+require 'seccomp-tools/logger'
+require 'seccomp-tools/symbolic/constraint'
+require 'seccomp-tools/symbolic/executor'
+require 'seccomp-tools/symbolic/expr'
+require 'seccomp-tools/version'
+
+module SeccompTools
+  # A content-addressed cache of analysis results on disk, so analyzing a filter already seen - the
+  # same bytes, for the same architecture, by the same version of seccomp-tools - skips the work.
+  #
+  # Each result is one file named after the SHA-256 of its key, holding the result deflated with
+  # Marshal. Writers write a temporary file and rename it into place, which is atomic, so concurrent
+  # processes never read a partial entry and the last writer simply wins. Entries are evicted oldest
+  # use first (a hit refreshes the file's mtime) once the directory exceeds its size bound. An entry
+  # that cannot be read, or was written by another format, counts as a miss.
+  #
+  # Loading an entry can build any object, so only a directory nobody else can write to is used:
+  # it is created accessible to its user only, and one owned by another user, or writable by its
+  # group or others, is left alone - every result is then computed, with a warning.
+  #
+  # Symbolic walks are stored as plain tables of their expressions, constraints and leaves, and
+  # rebuilt through the interning factories of {Symbolic::Expr} and {Symbolic::Constraint}, so a
+  # cached walk compares equal to a fresh one.
+  #
+  # @example
+  #   cache = SeccompTools::AnalysisCache.new
+  #   leaves, truncated = cache.walk(raw, :amd64) { SeccompTools::Symbolic::Executor.new(insts).run }
+  class AnalysisCache
+    # Bumped when the layout of an entry changes, so older entries miss instead of misreading.
+    FORMAT = 1
+    # The default bound on the total size of the entries, in bytes.
+    MAX_BYTES = 64 << 20
+
+    # Where the cache lives by default: +seccomp-tools+ under +$XDG_CACHE_HOME+, or under
+    # +~/.cache+ when that is not set.
+    # @return [String]
+    def self.default_dir
+      base = ENV.fetch('XDG_CACHE_HOME', '')
+      base = File.join(Dir.home, '.cache') if base.empty?
+      File.join(base, 'seccomp-tools')
+    end
+
+    # @return [String] The directory holding the entries.
+    attr_reader :dir
+
+    # @param [String] dir
+    #   The directory to keep entries in, created on the first write, accessible to its user only.
+    # @param [Integer] max_bytes
+    #   Evict the least recently used entries once they take more than this.
+    def initialize(dir: self.class.default_dir, max_bytes: MAX_BYTES)
+      @dir = dir
+      @max_bytes = max_bytes
+    end
+
+    # The result of +kind+ for +raw+ on +arch+, computed by the block and stored on a miss.
+    # @param [Symbol] kind
+    #   What the result is, e.g. +:audit+; results of different kinds never collide.
+    # @param [String] raw
+    #   The filter's raw bytes.
+    # @param [Symbol] arch
+    # @param [Array] extra
+    #   Anything else the result depends on.
+    # @yieldreturn [Object]
+    #   The result, of plain Ruby data Marshal can dump.
+    # @return [Object]
+    def fetch(kind, raw, arch, *extra)
+      return yield unless usable?
+
+      path = path_of(Digest::SHA256.hexdigest(Marshal.dump([VERSION, kind, arch, extra, raw.b])))
+      found = read(path)
+      return found.last if found
+
+      yield.tap { |value| write(path, value) }
+    end
+
+    # The symbolic walk of +raw+ on +arch+ - what {Symbolic::Executor#run} returns - computed by the
+    # block on a miss.
+    # @param [String] raw
+    # @param [Symbol] arch
+    # @yieldreturn [Array(Array<Symbolic::Executor::Leaf>, Boolean)]
+    # @return [Array(Array<Symbolic::Executor::Leaf>, Boolean)]
+    def walk(raw, arch)
+      load_walk(fetch(:walk, raw, arch) { dump_walk(*yield) })
+    end
+
+    private
+
+    # Whether {#dir} can be trusted, see {#trusted?}; warns once when it cannot.
+    def usable?
+      return @usable unless @usable.nil?
+
+      @usable = trusted?
+      Logger.warn("Not using the cache at #{@dir}: another user owns it or may write to it.", io: $stderr) unless @usable
+      @usable
+    end
+
+    # Whether {#dir} is absent (to be created private) or owned by this user and writable by no one else.
+    def trusted?
+      st = File.stat(@dir)
+      st.uid == Process.uid && (st.mode & 0o022).zero?
+    rescue Errno::ENOENT
+      true
+    end
+
+    def path_of(digest)
+      File.join(@dir, digest[0, 2], digest[2..])
+    end
+
+    # The +[FORMAT, value]+ pair stored at +path+, or +nil+ when there is none (or it is unusable).
+    def read(path)
+      data = Marshal.load(Zlib::Inflate.inflate(File.binread(path))) # rubocop:disable Security/MarshalLoad
+      return nil unless data.is_a?(Array) && data.first == FORMAT
+
+      touch(path)
+      data
+    rescue SystemCallError, Zlib::Error, TypeError, ArgumentError
+      nil
+    end
+
+    def touch(path)
+      File.utime(nil, nil, path)
+    rescue SystemCallError
+      nil # evicted meanwhile
+    end
+
+    def write(path, value)
+      FileUtils.mkdir_p(File.dirname(path), mode: 0o700)
+      # Someone else may have created the directory between the check and here.
+      return @usable = false unless trusted?
+
+      tmp = "#{path}.#{Process.pid}.#{Thread.current.object_id}.tmp"
+      File.binwrite(tmp, Zlib::Deflate.deflate(Marshal.dump([FORMAT, value])))
+      File.rename(tmp, path)
+      evict
+    rescue SystemCallError
+      File.delete(tmp) if tmp && File.exist?(tmp)
+    end
+
+    # Deletes the least recently used entries until the rest fit in the size bound.
+    def evict
+      entries = Dir[File.join(@dir, '*', '*')].filter_map do |f|
+        next if f.end_with?('.tmp')
+
+        st = File.stat(f)
+        [f, st.size, st.mtime]
+      rescue SystemCallError
+        nil
+      end
+      total = entries.sum { |_, size, _| size }
+      entries.sort_by(&:last).each do |f, size, _|
+        break if total <= @max_bytes
+
+        FileUtils.rm_f(f)
+        total -= size
+      end
+    end
+
+    # Flattens a walk into tables of integers and symbols: every expression once, operands before
+    # what uses them, then every constraint, then the leaves referring to both by position.
+    def dump_walk(leaves, truncated)
+      exprs = {}
+      constraints = {}
+      expr = lambda do |e|
+        exprs.fetch(e) do
+          row = [e.kind, e.val || e.offset, e.op, e.lhs && expr.call(e.lhs), e.rhs && expr.call(e.rhs)]
+          exprs[e] = [exprs.size, row]
+        end.first
+      end
+      rows = leaves.map do |leaf|
+        path = leaf.path.map do |c|
+          constraints.fetch(c) { constraints[c] = [constraints.size, [expr.call(c.lhs), c.op, expr.call(c.rhs)]] }.first
+        end
+        [path, expr.call(leaf.ret), leaf.line, leaf.steps, leaf.max_steps]
+      end
+      [exprs.values.map(&:last), constraints.values.map(&:last), rows, truncated]
+    end
+
+    def load_walk((expr_rows, constraint_rows, rows, truncated))
+      exprs = []
+      expr_rows.each { |row| exprs << build_expr(exprs, *row) }
+      constraints = constraint_rows.map { |lhs, op, rhs| Symbolic::Constraint.new(exprs[lhs], op, exprs[rhs]) }
+      leaves = rows.map do |path, ret, line, steps, max_steps|
+        Symbolic::Executor::Leaf.new(path.map { |i| constraints[i] }, exprs[ret], line, steps, max_steps)
+      end
+      [leaves, truncated]
+    end
+
+    def build_expr(exprs, kind, val, op, lhs, rhs)
+      case kind
+      when :imm then Symbolic::Expr.imm(val)
+      when :data then Symbolic::Expr.data(val)
+      when :binop then Symbolic::Expr.binop(op, exprs[lhs], exprs[rhs])
+      when :unop then Symbolic::Expr.unop(op, exprs[lhs])
+      else Symbolic::Expr.opaque
+      end
+    end
+  end
+end
@@ -16,6 +16,10 @@ module SeccompTools
     # @param [Symbol?] arch
     #   Target architecture, must be one of {SeccompTools::Util.supported_archs}.
     #   Defaults to {SeccompTools::Util.system_arch} when +nil+.
+    # @param [Boolean] optimize
+    #   Whether to shorten the result: drop reloads of what a register already holds, unreachable
+    #   lines and jumps to jumps, share repeated tails and fold comparisons with a known outcome.
+    #   See {Compiler#compile!}.
     # @return [String]
     #   Raw BPF bytes.
     # @raise [SeccompTools::Error]
@@ -34,11 +38,11 @@ module SeccompTools
     #     return ALLOW
     #   EOS
     #   #=> <raw binary bytes>
-    def asm(str, filename: '-', arch: nil)
+    def asm(str, filename: '-', arch: nil, optimize: false)
       filename = nil if filename == '-'
       arch = Util.system_arch if arch.nil?
       compiler = Compiler.new(str, filename, arch)
-      compiler.compile!.map(&:asm).join
+      compiler.compile!(optimize:).map(&:asm).join
     end
   end
 end
@@ -1,5 +1,6 @@
 # frozen_string_literal: true
 
+require 'seccomp-tools/asm/peephole'
 require 'seccomp-tools/asm/sasm.tab'
 require 'seccomp-tools/asm/scalar'
 require 'seccomp-tools/asm/scanner'
@@ -32,8 +33,11 @@ module SeccompTools
       # Compiles the processed instructions.
       #
       # Scans and parses the source, resolves the labels into relative jump distances, then emits
-      # one {BPF} per statement.
+      # one {BPF} per statement. A conditional jump farther than {JUMP_DISTANCE_MAX} goes through a
+      # trampoline inserted within its reach, see {#relax}.
       #
+      # @param [Boolean] optimize
+      #   Whether to shorten the emitted instructions with {Peephole} afterwards.
       # @return [Array<SeccompTools::BPF>]
       #   Returns the compiled {BPF} array.
       # @raise [SeccompTools::UnrecognizedTokenError]
@@ -46,13 +50,15 @@ module SeccompTools
       #   If a jump refers to a label that is never defined.
       # @raise [SeccompTools::BackwardJumpError]
       #   If a jump goes backward, which BPF cannot express.
-      def compile!
+      def compile!(optimize: false)
         @scanner.validate!
         statements = SeccompAsmParser.new(@scanner).parse
         fixup_symbols(statements)
         resolve_symbols(statements)
+        size = statements.size
+        statements = relax(statements)
 
-        statements.map.with_index do |s, idx|
+        bpfs = statements.map.with_index do |s, idx|
           @line = idx
           case s.type
           when :alu then emit_alu(*s.data)
@@ -61,6 +67,8 @@ module SeccompTools
           when :ret then emit_ret(*s.data)
           end
         end
+        check_relaxed(bpfs) if statements.size > size
+        optimize ? Peephole.new(bpfs, @arch).optimize : bpfs
       end
 
       private
@@ -90,6 +98,192 @@ module SeccompTools
         end
       end
 
+      # Branch relaxation: makes every conditional jump reach its target, inserting trampolines
+      # where it is farther than {JUMP_DISTANCE_MAX}.
+      #
+      # Each out-of-range jump is sent to the last instruction within its reach that does what its
+      # target does: a +return+ of the same action, or a +goto+ the target. When there is none, one
+      # is inserted: a copy of the target when it is a +return+, so the jump costs nothing more,
+      # else a +goto+ it. It goes right after a +return+ or +goto+ when one is within reach, so no
+      # other path runs it; only failing that, it is inserted inline, with a +goto+ over it. Since
+      # each insertion pushes the jumps over it farther, this repeats until every jump reaches.
+      #
+      # The kernel checks scratch memory loads by a walk over the lines in order, carrying what is
+      # written across a +return+ (see {Disasm::Program#mem_valid}), so a jump only goes through an
+      # instruction, or one is placed, where that walk still proves written every slot it checks a
+      # load of from there on, see {#covered?}.
+      #
+      # @param [Array<Statement>] statements
+      #   Statements whose jump distances are resolved.
+      # @return [Array<Statement>]
+      #   The statements with the trampolines, jump distances updated.
+      def relax(statements)
+        # jump targets as the statements themselves, or distances past the end, so insertions
+        # do not move them
+        @targets = {}.compare_by_identity
+        statements.each_with_index do |s, idx|
+          next unless s.type == :if
+
+          @targets[s] = [s.data[1], s.data[2]].map do |dis, _|
+            at = idx + dis + 1
+            at < statements.size ? statements[at] : at - statements.size
+          end
+        end
+        @loading = statements.any? { |s| load?(s) }
+        @proven = !@loading || begin
+          written, = scan_memory(statements)
+          statements.each_with_index.none? { |s, i| load?(s) && written[i][s.data[1].val].zero? }
+        end
+        items = statements.dup
+        loop do
+          raise SeccompTools::LongJumpError, 'Cannot place the trampolines of the far jumps' if
+            items.size > 4 * statements.size
+          # the first first: the insertions for a jump all come after it
+          break unless items.each_index.map { |idx| relax_jump(items, idx) }.any?
+        end
+        positions = items.each_with_index.with_object({}.compare_by_identity) { |(s, i), h| h[s] = i }
+        items.each_with_index do |s, idx|
+          next unless s.type == :if
+
+          s.data[1][0], s.data[2][0] = @targets[s].map do |t|
+            (t.is_a?(Statement) ? positions.fetch(t) : items.size + t) - idx - 1
+          end
+        end
+      end
+
+      # Sends the jump at +idx+ through a trampoline where its target is out of reach.
+      # @return [Boolean]
+      #   Whether it did.
+      def relax_jump(items, idx)
+        s = items[idx]
+        return false if s.nil? || !conditional?(s)
+
+        far = [0, 1].reject { |f| reach?(items, idx, @targets[s][f]) }
+        far.each { |f| @targets[s][f] = trampoline(items, idx, @targets[s][f]) }
+        far.any?
+      end
+
+      # Whether the jump at +from+ reaches +target+, a statement or a distance past the end.
+      def reach?(items, from, target)
+        return items.size + target - from - 1 <= JUMP_DISTANCE_MAX unless target.is_a?(Statement)
+
+        items[from + 1, JUMP_DISTANCE_MAX + 1].any? { |s| s.equal?(target) }
+      end
+
+      # Does +s+ compare, so reach only {JUMP_DISTANCE_MAX} instructions? A +goto+, or a comparison
+      # going the same way either way, is emitted as an unconditional jump.
+      def conditional?(statement)
+        statement.type == :if && !statement.data[0].nil? && !@targets[statement][0].equal?(@targets[statement][1])
+      end
+
+      # Whether +s+ ends a path, so a trampoline after it is run by no other path.
+      def terminator?(statement)
+        statement.type == :ret || (statement.type == :if && !conditional?(statement))
+      end
+
+      # An instruction within the reach of the jump at +from+ that leads where +target+ does,
+      # inserted into +items+ if need be.
+      def trampoline(items, from, target)
+        @written, @live = scan_memory(items) if @loading
+        ret = target.is_a?(Statement) && target.type == :ret
+        found = (from + 1..[from + 1 + JUMP_DISTANCE_MAX, items.size - 1].min).reverse_each.find do |p|
+          s = items[p]
+          next true if s.equal?(target)
+          next false unless covered?(from, p)
+
+          ret ? s.type == :ret && s.data == target.data : s.type == :if && @targets[s].all? { |t| t.equal?(target) }
+        end
+        return items[found] if found
+
+        # one short of the reach, so the trampoline of the jump's other target, inserted next, does
+        # not push this one out
+        last = [from + JUMP_DISTANCE_MAX, items.size].min
+        # the kernel's walk carries what is written on through a return, and a trampoline after it
+        # passes that on where it leads: to the line after it for a return, else to the target
+        to = ret || !target.is_a?(Statement) ? nil : items.index { |s| s.equal?(target) }
+        slot = (from + 2..last).reverse_each.find do |p|
+          terminator?(items[p - 1]) && covered?(from, ret ? p : to, (p - 1 if items[p - 1].type == :ret))
+        end
+        return items.insert(slot, ret ? Statement.new(:ret, target.data, []) : goto(target))[slot] if slot
+
+        over = from + JUMP_DISTANCE_MAX - 1
+        tramp = ret && covered?(from, over) ? Statement.new(:ret, target.data, []) : goto(target)
+        items.insert(over, goto(items[over] || 0), tramp)
+        tramp
+      end
+
+      # Whether the kernel's walk over scratch memory still proves written every slot loaded from
+      # line +at+ on (+nil+ for past the end), after narrowing what it takes as written there to that
+      # on +from+, and on +past+ too when given.
+      def covered?(from, at, past = nil)
+        return true unless @loading && at
+
+        valid = @written[from]
+        valid &= @written[past] if past
+        (@live[at] & ~valid).zero?
+      end
+
+      # What the kernel's walk over scratch memory takes as written when each of +items+ runs (see
+      # {Disasm::Program#mem_valid}), and the slots the walk checks a load of on or after each before
+      # a store to them: past a +return+ to the next line, and from a jump to where it jumps only.
+      # @return [Array(Array<Integer>, Array<Integer>)]
+      #   Masks, bit +i+ for +mem[i]+.
+      def scan_memory(items)
+        positions = items.each_with_index.with_object({}.compare_by_identity) { |(s, i), h| h[s] = i }
+        succ = items.map.with_index do |s, i|
+          next [i + 1] unless s.type == :if
+
+          @targets[s].filter_map { |t| positions.fetch(t) if t.is_a?(Statement) }
+        end
+        masks = Array.new(items.size, 0xffff)
+        valid = 0
+        written = items.each_with_index.map do |s, i|
+          valid &= masks[i]
+          at = valid
+          if s.type == :if
+            succ[i].each { |t| masks[t] &= valid }
+            valid = 0xffff
+          elsif store?(s)
+            valid |= 1 << s.data[0].val
+          end
+          at
+        end
+        live = Array.new(items.size + 1, 0)
+        (items.size - 1).downto(0) do |i|
+          s = items[i]
+          live[i] = succ[i].reduce(0) { |m, t| m | live[t] }
+          live[i] &= ~(1 << s.data[0].val) if store?(s)
+          live[i] |= 1 << s.data[1].val if load?(s)
+        end
+        [written, live]
+      end
+
+      def store?(statement)
+        statement.type == :assign && statement.data[0].mem?
+      end
+
+      def load?(statement)
+        statement.type == :assign && !statement.data[1].is_a?(Symbol) && statement.data[1].mem?
+      end
+
+      # The relaxed program is checked as the kernel would, which must load scratch memory wherever
+      # the source does.
+      # @raise [SeccompTools::LongJumpError]
+      def check_relaxed(bpfs)
+        return unless @proven
+
+        line, reason = Disasm::Program.new(bpfs.map(&:asm).join, @arch).check
+        return unless reason == 'scratch memory read before written'
+
+        raise SeccompTools::LongJumpError, "Cannot place the trampolines of the far jumps: line #{line} would load " \
+                                           'scratch memory the kernel does not know written'
+      end
+
+      # A +goto+ statement to +target+, a statement or a distance past the end.
+      def goto(target)
+        Statement.new(:if, [nil, [0, nil], [0, nil]], []).tap { |s| @targets[s] = [target, target] }
+      end
+
       # Resolves a jump target into a relative distance from +index+.
       #
       # @param [Integer] index
@@ -0,0 +1,288 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/bpf'
+require 'seccomp-tools/const'
+require 'seccomp-tools/disasm/disasm'
+
+module SeccompTools
+  module Asm
+    # @private
+    #
+    # Shortens compiled instructions without changing what the filter returns for any input.
+    #
+    # What each register holds is tracked by the forward pass of {Disasm.track}, i.e. the
+    # +Instruction::*#branch+ of every instruction, and the passes below rely on it:
+    # * a comparison whose result every reaching state decides becomes a +goto+;
+    # * a jump whose target is a +goto+, or a comparison the states along that edge decide, jumps
+    #   to where it leads instead, and a +goto+ to a +return+ is that +return+;
+    # * a load (or store) of what the target already holds in every reaching state is dropped;
+    # * a jump to a sequence that reappears later in the filter jumps to the later copy, leaving
+    #   the earlier one unreached;
+    # * unreached lines and +goto+s to the next line are dropped.
+    # The passes repeat until none of them changes anything.
+    #
+    # The kernel also refuses a filter loading a scratch memory slot it cannot tell is written, by a
+    # linear walk that knows nothing of the values (see {Disasm::Program#mem_valid}), so a jump only
+    # goes to a line whose loads that walk still proves written, and the output of a pass the kernel
+    # would refuse, unlike its input, is dropped.
+    class Peephole
+      # One instruction, whose +jt+ and +jf+ are the line numbers jumped to, not distances, so
+      # lines can be dropped and targets moved freely. A +goto+ keeps its target in +jt+.
+      Node = Struct.new(:code, :k, :jt, :jf)
+
+      # The passes, in the order each round runs them.
+      PASSES = %i[fold thread drop_loads merge_tails drop_dead].freeze
+      # Opcodes of the loads from scratch memory.
+      MEM_LOADS = [Const::BPF::COMMAND[:ld], Const::BPF::COMMAND[:ldx]].map { |c| c | Const::BPF::MODE[:mem] }.freeze
+
+      # @param [Array<SeccompTools::BPF>] bpfs
+      #   Compiled instructions.
+      # @param [Symbol] arch
+      #   Architecture.
+      def initialize(bpfs, arch)
+        @arch = arch
+        @nodes = bpfs.map.with_index do |bpf, i|
+          case kind(bpf.code)
+          when :ja then Node.new(bpf.code, 0, i + bpf.k + 1, nil)
+          when :cmp then Node.new(bpf.code, bpf.k, i + bpf.jt + 1, i + bpf.jf + 1)
+          else Node.new(bpf.code, bpf.k, nil, nil)
+          end
+        end
+      end
+
+      # Runs the passes until the instructions stop changing.
+      # @return [Array<SeccompTools::BPF>]
+      #   The optimized instructions.
+      def optimize
+        valid = installable?(@nodes)
+        loop do
+          before = @nodes
+          PASSES.each do |pass|
+            nodes = __send__(pass, Disasm.track(build(@nodes)))
+            @nodes = nodes if !valid || installable?(nodes)
+          end
+          break if @nodes == before
+        end
+        build(@nodes)
+      end
+
+      private
+
+      def kind(code)
+        case Const::BPF::COMMAND.invert[code & 7]
+        when :jmp then (code & 0x70) == Const::BPF::JMP[:ja] ? :ja : :cmp
+        when :ret then :ret
+        else :op
+        end
+      end
+
+      def build(nodes)
+        nodes.each_with_index.map do |node, i|
+          raw = case kind(node.code)
+                when :ja then { code: node.code, k: node.jt - i - 1, jt: 0, jf: 0 }
+                when :cmp then { code: node.code, k: node.k, jt: node.jt - i - 1, jf: node.jf - i - 1 }
+                else { code: node.code, k: node.k, jt: 0, jf: 0 }
+                end
+          BPF.new(raw, @arch, i)
+        end
+      end
+
+      def installable?(nodes)
+        program(nodes).check.nil?
+      end
+
+      def program(nodes)
+        Disasm::Program.new(build(nodes).map(&:asm).join, @arch)
+      end
+
+      # Notes, for {#jumpable?}, the scratch memory slots the kernel takes as written on each line,
+      # and those it checks a load of on or after it before a store to them: past a +return+ to the
+      # next line, and from a jump to where it jumps only.
+      def scan_memory
+        @valid = program(@nodes).mem_valid
+        @live = Array.new(@nodes.size + 1, 0)
+        (@nodes.size - 1).downto(0) do |i|
+          node = @nodes[i]
+          succ = case kind(node.code)
+                 when :ja then [node.jt]
+                 when :cmp then [node.jt, node.jf]
+                 else [i + 1]
+                 end
+          @live[i] = succ.reduce(0) { |m, t| m | @live[t] }
+          @live[i] &= ~(1 << node.k) if store?(node)
+          @live[i] |= 1 << node.k if MEM_LOADS.include?(node.code)
+        end
+      end
+
+      # Whether a jump on line +from+ may go to +target+ as far as the kernel's check of scratch memory
+      # is concerned: every slot it checks a load of from +target+ on is written at +from+.
+      def jumpable?(from, target)
+        (@live[target] & ~@valid[from]).zero?
+      end
+
+      def goto(target)
+        Node.new(Const::BPF::COMMAND[:jmp] | Const::BPF::JMP[:ja], 0, target, nil)
+      end
+
+      # Comparisons every reaching state decides become a +goto+.
+      def fold(bpfs)
+        @nodes.each_with_index.map do |node, i|
+          next node unless kind(node.code) == :cmp
+
+          taken = bpfs[i].states.map { |st| decide(bpfs[i], st) }.uniq
+          next node unless taken.size == 1 && !taken.first.nil?
+
+          goto(taken.first ? node.jt : node.jf)
+        end
+      end
+
+      # Whether the comparison +bpf+ is taken in +state+, or +nil+ when that depends on the input.
+      def decide(bpf, state)
+        _, op, src, = bpf.inst.symbolize
+        lhs = value(state, state.a)
+        rhs = src == :x ? value(state, state.x) : src
+        return nil if lhs.nil? || rhs.nil?
+
+        case op
+        when :== then lhs == rhs
+        when :> then lhs > rhs
+        when :>= then lhs >= rhs
+        when :& then !(lhs & rhs).zero?
+        end
+      end
+
+      # The constant +expr+ is known to be in +state+: an immediate, or a data word an +==+ pins.
+      def value(state, expr)
+        return expr.val if expr.imm?
+
+        state.pinned(expr.offset) if expr.plain_data?
+      end
+
+      # Jumps go as far as the states along them decide, and a +goto+ reaching a +return+ returns.
+      def thread(bpfs)
+        scan_memory
+        @nodes.each_with_index.map do |node, i|
+          next node if bpfs[i].states.empty?
+
+          case kind(node.code)
+          when :ja
+            target = follow(bpfs, i, node.jt, bpfs[i].states.to_a)
+            # unlike a goto, a return leaves what it knows written to the next line
+            next goto(target) unless bpfs[target] && kind(bpfs[target].code) == :ret && jumpable?(i, i + 1)
+
+            Node.new(bpfs[target].code, bpfs[target].k)
+          when :cmp
+            edges = Hash.new { |h, pc| h[pc] = [] }
+            bpfs[i].states.each { |st| bpfs[i].branch(st) { |pc, s| edges[pc] << s } }
+            jt = follow(bpfs, i, node.jt, edges[node.jt])
+            jf = follow(bpfs, i, node.jf, edges[node.jf])
+            jt == jf ? goto(jt) : Node.new(node.code, node.k, jt, jf)
+          else node
+          end
+        end
+      end
+
+      # The farthest line a jump from line +from+ to +target+ can go instead, passing +goto+s and the
+      # comparisons +states+ decide, within the reach of a conditional jump unless +from+ is a +goto+,
+      # and the scratch memory it loads known written, see {#jumpable?}.
+      def follow(bpfs, from, target, states)
+        far = kind(bpfs[from].code) == :ja ? Float::INFINITY : Compiler::JUMP_DISTANCE_MAX
+        best = target
+        while (bpf = bpfs[target]) && target - from - 1 <= far
+          best = target if jumpable?(from, target)
+          case kind(bpf.code)
+          when :ja then target = bpf.line + bpf.k + 1
+          when :cmp
+            taken = states.map { |st| decide(bpf, st) }.uniq
+            break unless taken.size == 1 && !taken.first.nil?
+
+            target = bpf.line + 1 + (taken.first ? bpf.jt : bpf.jf)
+            states = states.flat_map { |st| bpf.inst.branch(st).select { |pc, _| pc == target }.map(&:last) }
+          else break
+          end
+        end
+        best
+      end
+
+      # Loads and stores of what their target already holds in every reaching state are dropped.
+      # A store stays where the kernel would not know the slot written without it.
+      def drop_loads(bpfs)
+        valid = program(@nodes).mem_valid
+        remove(@nodes, bpfs.each_index.select do |i|
+          redundant?(bpfs[i]) && (!store?(@nodes[i]) || valid[i][@nodes[i].k] == 1)
+        end)
+      end
+
+      def store?(node)
+        [Const::BPF::COMMAND[:st], Const::BPF::COMMAND[:stx]].include?(node.code)
+      end
+
+      def redundant?(bpf)
+        return false if bpf.states.empty?
+
+        op, dst, val = bpf.inst.symbolize
+        bpf.states.all? do |st|
+          before = case op
+                   when :ld then dst == :a ? st.a : st.x
+                   when :misc then dst == :txa ? st.a : st.x
+                   when :st then st.mem[val]
+                   end
+          next false if before.nil? || before.opaque?
+
+          bpf.branch(st) { |_, after| return false unless after == st }
+          true
+        end
+      end
+
+      # Each line is numbered as the last line running the same instructions to the same end; jumps
+      # go to that copy where they may, see {#jumpable?}.
+      def merge_tails(_bpfs)
+        scan_memory
+        same = {}
+        canon = []
+        (@nodes.size - 1).downto(0) do |i|
+          node = @nodes[i]
+          key = case kind(node.code)
+                when :ja then [:ja, canon[node.jt] || node.jt]
+                when :cmp then [node.code, node.k, canon[node.jt] || node.jt, canon[node.jf] || node.jf]
+                when :ret then [node.code, node.k]
+                else [node.code, node.k, canon[i + 1] || i + 1]
+                end
+          canon[i] = (same[key] ||= i)
+        end
+        @nodes.each_with_index.map do |node, i|
+          case kind(node.code)
+          when :ja then goto(canon[node.jt].nil? || !jumpable?(i, canon[node.jt]) ? node.jt : canon[node.jt])
+          when :cmp
+            jt, jf = [node.jt, node.jf].map do |t|
+              canon[t].nil? || canon[t] - i - 1 > Compiler::JUMP_DISTANCE_MAX || !jumpable?(i, canon[t]) ? t : canon[t]
+            end
+            Node.new(node.code, node.k, jt, jf)
+          else node
+          end
+        end
+      end
+
+      # Lines no state reaches, and +goto+s to the next line, are dropped.
+      def drop_dead(bpfs)
+        remove(@nodes, @nodes.each_index.select do |i|
+          bpfs[i].states.empty? || (kind(@nodes[i].code) == :ja && @nodes[i].jt == i + 1)
+        end)
+      end
+
+      # Drops the lines +dead+, a jump to one of them going to the line that follows it instead.
+      def remove(nodes, dead)
+        return nodes if dead.empty?
+
+        shift = ->(t) { t - dead.count { |d| d < t } }
+        nodes.each_with_index.reject { |_, i| dead.include?(i) }.map do |node, _|
+          case kind(node.code)
+          when :ja then goto(shift[node.jt])
+          when :cmp then Node.new(node.code, node.k, shift[node.jt], shift[node.jf])
+          else node
+          end
+        end
+      end
+    end
+  end
+end
@@ -61,9 +61,20 @@ module SeccompTools
         @arch = arch
         @syscalls =
           begin; Const::Syscall.const_get(arch.to_s.upcase); rescue NameError; []; end
-        @syscall_all = ARCHES.each_with_object({}) do |ar, memo|
-          memo.merge!(Const::Syscall.const_get(ar.to_s.upcase))
-        end.keys
+      end
+
+      # The matchers of a syscall name of +arch+, and of +arch.name+ for any architecture, compiled
+      # on the first scan for +arch+ and shared by every later one.
+      # @param [Symbol] arch
+      # @return [Array(Regexp, Regexp)]
+      def self.syscall_matchers(arch)
+        @syscall_matchers ||= {}
+        @syscall_matchers[arch] ||= begin
+          syscalls = begin; Const::Syscall.const_get(arch.to_s.upcase).keys; rescue NameError; []; end
+          all = ARCHES.flat_map { |ar| Const::Syscall.const_get(ar.upcase).keys }.uniq
+          [::Regexp.compile("\\A\\b(#{syscalls.map { |s| ::Regexp.escape(s) }.join('|')})\\b"),
+           ::Regexp.compile("\\A(#{ARCHES.join('|')})\\.(#{all.join('|')})\\b")].freeze
+        end
       end
 
       # Scans the whole string and raises errors when there are unrecognized tokens.
@@ -109,9 +120,7 @@ module SeccompTools
           add_token.call(sym, ::Regexp.last_match(0))
           bump_vars.call
         end
-        syscalls = @syscalls.keys.map { |s| ::Regexp.escape(s) }.join('|')
-        syscall_matcher = ::Regexp.compile("\\A\\b(#{syscalls})\\b")
-        syscall_all_matcher = ::Regexp.compile("\\A(#{ARCHES.join('|')})\\.(#{@syscall_all.join('|')})\\b")
+        syscall_matcher, syscall_all_matcher = self.class.syscall_matchers(@arch)
         until str.empty?
           case str
           when /\A\n+/
@@ -24,16 +24,19 @@ module SeccompTools
     #   The architecture the filter is written for, used when it does not itself branch on +arch+.
     # @param [String?] source
     #   A label for the filter (e.g. a filename) shown in the report.
-    def initialize(instructions, arch:, source: nil)
+    # @param [Array(Array<Symbolic::Executor::Leaf>, Boolean)?] walk
+    #   The filter's walk, when already known (e.g. from an {AnalysisCache}), instead of walking it.
+    def initialize(instructions, arch:, source: nil, walk: nil)
       @instructions = instructions
       @arch = arch
       @source = source
+      @walk = walk
     end
 
     # Walks the filter, runs every check, and returns the {Report}.
     # @return [Report]
     def audit
-      leaves, truncated = Symbolic::Executor.new(@instructions).run
+      leaves, truncated = @walk || Symbolic::Executor.new(@instructions).run
       analysis = Explain::Analysis.new(leaves)
       policies = analysis.sections(@arch).map { |section| Policy.new(analysis, section) }
 
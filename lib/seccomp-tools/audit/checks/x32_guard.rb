@@ -1,5 +1,7 @@
 # frozen_string_literal: true
 
+require 'set'
+
 require 'seccomp-tools/audit/finding'
 
 module SeccompTools
@@ -15,11 +17,12 @@ module SeccompTools
         # @param [Audit::Policy] policy
         # @return [Array<Audit::Finding>]
         def call(policy)
+          allowed = policy.allowed(policy.table.values).to_set
           sharp = policy.table.filter_map do |name, nr|
             next if name.to_s.start_with?('x32_')
 
             x = policy.number(:"x32_#{name}")
-            name if x && policy.reachable_as_allow?(x) && !policy.reachable_as_allow?(nr)
+            name if x && allowed.include?(x) && !allowed.include?(nr)
           end
           return [] if sharp.empty?
 
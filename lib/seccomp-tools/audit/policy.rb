@@ -1,10 +1,10 @@
 # frozen_string_literal: true
 
+require 'seccomp-tools/audit/syscall_index'
 require 'seccomp-tools/const'
 require 'seccomp-tools/explain/qword'
 require 'seccomp-tools/explain/renderer'
 require 'seccomp-tools/explain/verdict'
-require 'seccomp-tools/symbolic/constraint'
 
 module SeccompTools
   class Audit
@@ -17,9 +17,10 @@ module SeccompTools
     # attacker-controlled and the executor already dropped self-contradictory paths, so a surviving
     # leaf is reachable under some argument choice. The stance is deliberately conservative - "could an
     # attacker reach this action?".
+    #
+    # The predicate is evaluated once per section, by the {SyscallIndex} of its leaves, rather than
+    # once per leaf for every syscall asked about.
     class Policy
-      SYS = Const::BPF::SeccompData::SYS_NUMBER
-
       # @return [Integer?] The +AUDIT_ARCH+ value (+nil+ when the filter never branches on +arch+).
       attr_reader :arch_val
       # @return [Symbol?] The architecture symbol whose syscall names apply (+nil+ when unknown).
@@ -79,7 +80,14 @@ module SeccompTools
       # @param [Integer] nr
       # @return [Boolean]
       def reachable_as_allow?(nr)
-        reachable_leaves(nr).any? { |l| Explain::Verdict.label(l.ret) == 'ALLOW' }
+        allow?(reachable_leaves(nr))
+      end
+
+      # The syscalls of +nrs+ that can reach +ALLOW+, found in one sweep of the {#index}.
+      # @param [Array<Integer>] nrs
+      # @return [Array<Integer>] Sorted.
+      def allowed(nrs)
+        index.sweep(nrs) { |leaves| allow?(leaves) }
       end
 
       # Was syscall +nr+ singled out for denial (a rule pins +sys_number == nr+ to a non-+ALLOW+
@@ -106,20 +114,27 @@ module SeccompTools
         conds.include?('') ? nil : conds.join(' or ')
       end
 
-      private
+      # The leaves syscall +nr+ can reach, under some choice of arguments.
+      # @param [Integer] nr
+      # @return [Array<Symbolic::Executor::Leaf>]
+      def reachable_leaves(nr)
+        index.leaves_at(nr)
+      end
 
-      def name_of(nr)
-        table && table.invert[nr]
+      # The leaves each syscall number can reach, built on first use.
+      # @return [SyscallIndex]
+      def index
+        @index ||= SyscallIndex.new(@leaves)
       end
 
-      def reachable_leaves(nr)
-        @leaves.select { |l| sys_satisfied?(l, nr) }
+      private
+
+      def name_of(nr)
+        @arch_sym && Const::Syscall.name_of(@arch_sym, nr)
       end
 
-      def sys_satisfied?(leaf, nr)
-        leaf.path.all? do |c|
-          !c.plain_data_fact?(SYS) || Symbolic::Constraint.evaluate(nr, c.op, c.rhs.val)
-        end
+      def allow?(leaves)
+        leaves.any? { |l| Explain::Verdict.label(l.ret) == 'ALLOW' }
       end
     end
   end
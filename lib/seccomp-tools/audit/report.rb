@@ -28,6 +28,8 @@ module SeccompTools
       attr_reader :findings
       # @return [Array<String>] The architectures covered.
       attr_reader :arches
+      # @return [Boolean] Whether the symbolic walk was cut short.
+      attr_reader :truncated
 
       # The human report.
       # @return [String]
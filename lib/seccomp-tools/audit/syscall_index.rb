@@ -0,0 +1,148 @@
+# frozen_string_literal: true
+
+require 'set'
+
+require 'seccomp-tools/const'
+require 'seccomp-tools/symbolic/constraint'
+
+module SeccompTools
+  class Audit
+    # Which leaves each syscall number can reach, precomputed for a whole section.
+    #
+    # The 32-bit +sys_number+ space is cut into intervals at every constant a +sys_number+ fact of
+    # the leaves compares against (the value itself, and the one past it), so no +==+, +!=+ or range
+    # fact changes its outcome within an interval. A +jset+ test whose mask has no bit below bit
+    # {FOLD_BIT} (an x32 guard tests bit 30) is constant over aligned blocks of +2**FOLD_BIT+
+    # numbers, so the space is also cut at those blocks and the test is folded in the same way.
+    # Each interval lists the leaves whose facts it satisfies, in their original order; a lookup is
+    # a binary search for the interval.
+    #
+    # A bit test on lower bits would cut the space into too many intervals. Such a test is kept with
+    # its leaf instead and evaluated on the number looked up, and the index is no longer {#exact?}.
+    class SyscallIndex
+      SYS = Const::BPF::SeccompData::SYS_NUMBER
+      # Largest syscall number, i.e. 32-bit value.
+      U32_MAX = 0xffffffff
+      # The lowest mask bit a folded +jset+ test may have: at most +2**(32 - FOLD_BIT)+ blocks.
+      FOLD_BIT = 24
+
+      # @return [Array<Integer>] Where each interval starts, in order, the first being +0+.
+      attr_reader :starts
+
+      # @param [Array<Symbolic::Executor::Leaf>] leaves
+      def initialize(leaves)
+        @leaves = leaves
+        @facts = leaves.map { |leaf| leaf.path.select { |c| c.plain_data_fact?(SYS) }.uniq }
+        @tested = @facts.map { |facts| facts.reject { |c| foldable?(c) } }
+        @starts = cut
+        @members = Array.new(@starts.size) { [] }
+        @facts.each_with_index { |facts, i| place(i, facts) }
+      end
+
+      # Whether every interval's leaves are reachable for all of its numbers, i.e. no bit test was
+      # left unfolded.
+      # @return [Boolean]
+      def exact?
+        @tested.all?(&:empty?)
+      end
+
+      # The leaves syscall +nr+ can reach.
+      # @param [Integer] nr
+      # @return [Array<Symbolic::Executor::Leaf>]
+      def leaves_at(nr)
+        members(interval(nr), nr)
+      end
+
+      # Yields each interval, lowest first, with its first and last numbers and the leaves all of
+      # its numbers can reach (which, unless {#exact?}, some of them may not after all).
+      # @yieldparam [Integer] lo
+      # @yieldparam [Integer] hi
+      # @yieldparam [Array<Symbolic::Executor::Leaf>] leaves
+      # @return [void]
+      def each_interval
+        @starts.each_with_index do |lo, i|
+          yield lo, (@starts[i + 1] || (U32_MAX + 1)) - 1, @members[i].map { |j| @leaves[j] }
+        end
+      end
+
+      # The numbers of +nrs+ whose reachable leaves +block+ accepts, found in one sweep over the
+      # sorted numbers and the intervals together; +block+ runs once per interval, or once per
+      # number where an unfolded bit test tells the numbers of an interval apart.
+      # @param [Array<Integer>] nrs
+      # @yieldparam [Array<Symbolic::Executor::Leaf>] leaves
+      #   The leaves one number can reach.
+      # @yieldreturn [Boolean]
+      # @return [Array<Integer>] Sorted.
+      def sweep(nrs)
+        i = 0
+        decided = {}
+        nrs.sort.select do |nr|
+          i += 1 while @starts[i + 1] && @starts[i + 1] <= nr
+          next yield members(i, nr) if @members[i].any? { |j| !@tested[j].empty? }
+
+          decided.fetch(i) { decided[i] = yield members(i, nr) }
+        end
+      end
+
+      private
+
+      def foldable?(c)
+        return true unless %i[set unset].include?(c.op)
+
+        (c.rhs.val & ((1 << FOLD_BIT) - 1)).zero?
+      end
+
+      def cut
+        points = [0]
+        @facts.flatten.uniq.each do |c|
+          v = c.rhs.val
+          case c.op
+          when :==, :!= then points << v << (v + 1)
+          when :>, :<= then points << (v + 1)
+          when :>=, :< then points << v
+          else points.concat((0..U32_MAX).step(1 << FOLD_BIT).to_a) if foldable?(c)
+          end
+        end
+        points.select { |p| p <= U32_MAX }.uniq.sort
+      end
+
+      # Adds leaf +i+ to the intervals whose numbers satisfy all of its folded +facts+: the span the
+      # +==+ and range facts leave, less the intervals +!=+ facts rule out, each remaining one
+      # checked at its start for the folded bit tests.
+      def place(i, facts)
+        lo = 0
+        hi = @starts.size - 1
+        excluded = Set.new
+        facts.each do |c|
+          v = c.rhs.val
+          case c.op
+          when :== then lo, hi = [lo, interval(v)].max, [hi, interval(v)].min
+          when :!= then excluded << interval(v)
+          when :>= then lo = [lo, interval(v)].max
+          when :> then lo = v == U32_MAX ? hi + 1 : [lo, interval(v + 1)].max
+          when :<= then hi = [hi, interval(v)].min
+          when :< then hi = [hi, interval(v) - 1].min
+          end
+        end
+        bits = facts.select { |c| foldable?(c) && %i[set unset].include?(c.op) }
+        (lo..hi).each do |idx|
+          next if excluded.include?(idx)
+          next unless bits.all? { |c| Symbolic::Constraint.evaluate(@starts[idx], c.op, c.rhs.val) }
+
+          @members[idx] << i
+        end
+      end
+
+      # The index of the interval holding +nr+.
+      def interval(nr)
+        (@starts.bsearch_index { |s| s > nr } || @starts.size) - 1
+      end
+
+      def members(idx, nr)
+        @members[idx].filter_map do |j|
+          @leaves[j] if @tested[j].all? { |c| Symbolic::Constraint.evaluate(nr, c.op, c.rhs.val) }
+        end
+      end
+    end
+  end
+end
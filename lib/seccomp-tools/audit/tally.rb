@@ -0,0 +1,90 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/audit/finding'
+
+module SeccompTools
+  class Audit
+    # Totals over the {Report}s of many filters, as +audit --batch+ prints after them: how many
+    # filters each finding was reported for, overall and per architecture, and how many filters
+    # covered each architecture.
+    class Tally
+      # @return [Integer] The filters added.
+      attr_reader :filters
+      # @return [Integer] The filters that could not be audited.
+      attr_reader :failed
+
+      def initialize
+        @filters = 0
+        @failed = 0
+        @clean = 0
+        @truncated = 0
+        @arches = Hash.new(0)
+        @findings = {}
+      end
+
+      # Counts the findings of one filter, each finding id once per architecture it names.
+      # @param [Report] report
+      # @return [self]
+      def add(report)
+        @filters += 1
+        @clean += 1 if report.findings.empty?
+        @truncated += 1 if report.truncated
+        report.arches.each { |arch| @arches[arch] += 1 }
+        report.findings.group_by(&:id).each do |id, found|
+          entry = (@findings[id] ||= { severity: found.first.severity, filters: 0, arches: Hash.new(0) })
+          entry[:severity] = found.map(&:severity).push(entry[:severity]).min_by { |s| SEVERITIES.index(s) }
+          entry[:filters] += 1
+          found.filter_map(&:arch).uniq.each { |arch| entry[:arches][arch] += 1 }
+        end
+        self
+      end
+
+      # Counts filters that could not be audited.
+      # @param [Integer] count
+      # @return [self]
+      def fail!(count = 1)
+        @failed += count
+        self
+      end
+
+      # The summary as a table of finding ids by architecture, most severe and most frequent first.
+      # @return [String]
+      def to_s
+        out = +"Batch summary: #{@filters} filter#{'s' unless @filters == 1} audited"
+        out << ", #{@clean} without weaknesses" if @filters.positive?
+        out << ", #{@failed} failed" if @failed.positive?
+        out << "\nWARNING: #{@truncated} analyses truncated; their results may be incomplete." if @truncated.positive?
+        out << "\nArchitectures: #{@arches.sort.map { |arch, n| "#{arch} (#{n})" }.join(', ')}" unless @arches.empty?
+        out << "\n"
+        return out if @findings.empty?
+
+        arches = @arches.keys.sort
+        rows = [['Finding', 'Filters', *arches]]
+        ranked.each do |id, entry|
+          rows << [id, entry[:filters].to_s, *arches.map { |arch| (entry[:arches][arch].nonzero? || '-').to_s }]
+        end
+        widths = rows.transpose.map { |col| col.map(&:size).max }
+        out << "\n"
+        rows.each do |row|
+          cells = row.each_with_index.map { |cell, i| i.zero? ? cell.ljust(widths[i]) : cell.rjust(widths[i]) }
+          out << "  #{cells.join('  ')}\n"
+        end
+        out
+      end
+
+      # @return [Hash] JSON-ready shape.
+      def to_h
+        {
+          filters: @filters, failed: @failed, clean: @clean, truncated: @truncated, arches: @arches,
+          findings: ranked.to_h
+        }
+      end
+
+      private
+
+      def ranked
+        @findings.sort_by { |id, entry| [SEVERITIES.index(entry[:severity]), -entry[:filters], id] }
+      end
+    end
+  end
+end
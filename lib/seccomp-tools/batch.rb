@@ -0,0 +1,157 @@
+# frozen_string_literal: true
+
+require 'etc'
+
+module SeccompTools
+  # Runs one block over many inputs in forked worker processes, so a large batch - thousands of
+  # dumped filters - loads the library once and keeps every processor busy.
+  #
+  # Workers take their inputs from one queue the parent holds: each gets one input at a time and
+  # the next as soon as it reports back, so a worker that drew cheap inputs goes on to take the ones
+  # a slower worker has not reached, and no worker sits idle while inputs remain. Results travel
+  # back through Marshal over a pipe per worker. A worker that dies fails only the input it held, and
+  # is replaced.
+  #
+  # The block runs in the workers, so whatever it changes there is lost; only what it returns
+  # comes back. Without +fork+, or with one job, everything runs in this process.
+  #
+  # @example
+  #   Batch.new(paths, jobs: 4) { |path| File.size(path) }.each { |path, size, error| ... }
+  class Batch
+    # A worker process: its pid, the pipe its inputs go down and the one its results come up, and
+    # the index of the input it is working on, +nil+ while idle.
+    Worker = Struct.new(:pid, :tasks, :results, :index)
+
+    # @param [Array] items
+    #   The inputs.
+    # @param [Integer] jobs
+    #   How many workers to run at most.
+    # @yieldparam [Object] item
+    # @yieldreturn [Object]
+    #   The result for +item+, of plain Ruby data Marshal can dump.
+    def initialize(items, jobs: Etc.nprocessors, &work)
+      @items = items
+      @jobs = jobs.clamp(1, [items.size, 1].max)
+      @work = work
+    end
+
+    # Yields every input with its result, or with the message of the error its block raised.
+    # @param [Boolean] ordered
+    #   Yield in the order of the inputs, holding back results that arrive early; otherwise as soon
+    #   as each is ready.
+    # @yieldparam [Object] item
+    # @yieldparam [Object?] result
+    # @yieldparam [String?] error
+    # @return [void]
+    def each(ordered: true, &block)
+      emit = ordered ? in_order(&block) : ->(i, result, error) { block.call(@items[i], result, error) }
+      if @jobs == 1 || !Process.respond_to?(:fork)
+        @items.each_index { |i| emit.call(i, *attempt(@items[i])) }
+      else
+        run_workers(emit)
+      end
+    end
+
+    private
+
+    def attempt(item)
+      [@work.call(item), nil]
+    rescue StandardError => e
+      [nil, e.message]
+    end
+
+    # Buffers results until every earlier one has been yielded.
+    def in_order(&block)
+      held = {}
+      following = 0
+      lambda do |i, result, error|
+        held[i] = [result, error]
+        while held.key?(following)
+          block.call(@items[following], *held.delete(following))
+          following += 1
+        end
+      end
+    end
+
+    def run_workers(emit)
+      @workers = []
+      @next = 0
+      @jobs.times { assign(spawn) }
+      until (busy = @workers.select(&:index)).empty?
+        IO.select(busy.map(&:results)).first.each do |io|
+          worker = busy.find { |w| w.results.equal?(io) }
+          i = worker.index
+          result, error = receive(worker)
+          if error == :died
+            error = 'worker process died'
+            reap(worker)
+            @workers.delete(worker)
+            worker = spawn if @next < @items.size
+          end
+          emit.call(i, result, error)
+          assign(worker)
+        end
+      end
+    ensure
+      @workers.each { |w| reap(w) }
+    end
+
+    # Hands the next input to +worker+, or leaves it idle when there is none left.
+    def assign(worker)
+      worker.index = @next < @items.size ? @next : nil
+      return unless worker.index
+
+      worker.tasks.write([@next].pack('L'))
+      @next += 1
+    end
+
+    def spawn
+      tasks_r, tasks_w = IO.pipe
+      results_r, results_w = IO.pipe
+      pid = fork do
+        # Another worker's pipes kept open here would hide its end of input from it.
+        @workers.each { |w| [w.tasks, w.results].each(&:close) }
+        tasks_w.close
+        results_r.close
+        serve(tasks_r, results_w)
+      ensure
+        exit!(0)
+      end
+      tasks_r.close
+      results_w.close
+      Worker.new(pid, tasks_w, results_r, nil).tap { |w| @workers << w }
+    end
+
+    # The loop of a worker: answers each input index with the Marshal of +[result, error]+.
+    def serve(tasks, results)
+      while (head = tasks.read(4))
+        reply = attempt(@items[head.unpack1('L')])
+        data = begin
+          Marshal.dump(reply)
+        rescue TypeError => e
+          Marshal.dump([nil, e.message])
+        end
+        results.write([data.bytesize].pack('L'), data)
+      end
+    end
+
+    # The +[result, error]+ +worker+ sent, +[nil, :died]+ when it exited without one.
+    def receive(worker)
+      head = worker.results.read(4)
+      data = head && worker.results.read(head.unpack1('L'))
+      return [nil, :died] if data.nil? || data.bytesize != head.unpack1('L')
+
+      Marshal.load(data) # rubocop:disable Security/MarshalLoad
+    end
+
+    def reap(worker)
+      return if worker.tasks.closed?
+
+      worker.tasks.close
+      worker.results.close
+      Process.wait(worker.pid)
+    rescue SystemCallError
+      nil # already reaped
+    end
+  end
+end
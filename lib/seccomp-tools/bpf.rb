@@ -1,7 +1,6 @@
 # frozen_string_literal: true
 
 require 'set'
-require 'stringio'
 
 require 'seccomp-tools/const'
 require 'seccomp-tools/instruction/instruction'
@@ -12,6 +11,12 @@ module SeccompTools
   # Beyond the four fields of the C struct, a {BPF} also carries the architecture it belongs to and
   # its line number, which together allow it to be disassembled into readable assembly.
   class BPF
+    # The states of an instruction no state reaches, until {#states} is set.
+    NO_STATES = Set.new.freeze
+    # BPF command of each value of +code & 7+.
+    COMMANDS = Const::BPF::COMMAND.invert.freeze
+    private_constant :COMMANDS
+
     # @return [Integer] Line number.
     attr_reader :line
     # @return [Integer] BPF code.
@@ -37,12 +42,8 @@ module SeccompTools
     #   Line number of this filter.
     def initialize(raw, arch, line)
       if raw.is_a?(String)
-        io = ::StringIO.new(raw)
         endian = Const::Endian::ENDIAN[arch]
-        @code = io.read(2).unpack1("S#{endian}")
-        @jt = io.read(1).ord
-        @jf = io.read(1).ord
-        @k = io.read(4).unpack1("L#{endian}")
+        @code, @jt, @jf, @k = raw.unpack("S#{endian}CCL#{endian}")
       else
         @code = raw[:code]
         @jt = raw[:jt]
@@ -51,11 +52,9 @@ module SeccompTools
       end
       @arch = arch
       @line = line
-      @states = Set.new
-      @disasm_setting = {
-        code: true,
-        arg_infer: true
-      }
+      @states = NO_STATES
+      @show_code = true
+      @arg_infer = true
     end
 
     # Pretty display the disassemble result.
@@ -66,7 +65,8 @@ module SeccompTools
     # @return [String]
     #   One line of disassembly, without a trailing newline.
     def disasm(**options)
-      @disasm_setting.merge!(options)
+      @show_code = options.fetch(:code, @show_code)
+      @arg_infer = options.fetch(:arg_infer, @arg_infer)
       if show_code?
         format(' %04d: 0x%02x 0x%02x 0x%02x 0x%08x  %s',
                line, code, jt, jf, k, decompile)
@@ -79,13 +79,13 @@ module SeccompTools
     # Whether the raw +code+, +jt+, +jf+, +k+ fields need to be dumped.
     # @return [Boolean]
     def show_code?
-      @disasm_setting[:code]
+      @show_code
     end
 
     # Whether the syscall argument names need to be inferred.
     # @return [Boolean]
     def show_arg_infer?
-      @disasm_setting[:arg_infer]
+      @arg_infer
     end
 
     # Convert to raw bytes.
@@ -100,7 +100,7 @@ module SeccompTools
     # @return [Symbol?]
     #   See {Const::BPF::COMMAND} for the list of commands, +nil+ if +code+ is invalid.
     def command
-      Const::BPF::COMMAND.invert[code & 7]
+      COMMANDS[code & 7]
     end
 
     # Decompile.
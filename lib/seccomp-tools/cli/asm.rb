@@ -1,25 +1,20 @@
 # frozen_string_literal: true
 
-require 'seccomp-tools/cli/base'
 require 'seccomp-tools/asm/asm'
+require 'seccomp-tools/cli/base'
+require 'seccomp-tools/cli/bpf_output'
 
 module SeccompTools
   module CLI
     # Handle 'asm' command.
     class Asm < Base
+      include BPFOutput
+
       # Summary of this command.
       SUMMARY = 'Seccomp bpf assembler.'
       # Usage of this command.
       USAGE = "asm - #{SUMMARY}\n\nUsage: seccomp-tools asm IN_FILE [options]".freeze
 
-      # Instantiate an {Asm} object, defaulting the output format to +:inspect+.
-      #
-      # Takes the same arguments as {Base#initialize}.
-      def initialize(*)
-        super
-        option[:format] = :inspect
-      end
-
       # Define option parser.
       # @return [OptionParser]
       #   The parser of this command's options.
@@ -30,13 +25,14 @@ module SeccompTools
             option[:ofile] = o
           end
 
-          opt.on('-f', '--format FORMAT', %i[inspect raw c_array carray c_source assembly],
-                 'Output format. FORMAT can only be one of <inspect|raw|c_array|c_source|assembly>.',
-                 'Default: inspect') do |f|
-                   option[:format] = f
-                 end
-
+          option_bpf_format(opt)
           option_arch(opt)
+
+          opt.on('-O', '--optimize', 'Shorten the output without changing what it returns for any syscall:',
+                 'drop reloads, unreachable lines and jumps to jumps, share repeated tails,',
+                 'and fold comparisons whose result is already known.') do
+            option[:optimize] = true
+          end
         end
       end
 
@@ -48,20 +44,8 @@ module SeccompTools
         option[:ifile] = argv.shift
         return CLI.show(parser.help) if option[:ifile].nil?
 
-        res = SeccompTools::Asm.asm(input, filename: option[:ifile], arch: option[:arch])
-        output do
-          case option[:format]
-          when :inspect then "#{res.inspect}\n"
-          when :raw then res
-          when :c_array, :carray then "unsigned char bpf[] = {#{res.bytes.join(',')}};\n"
-          when :c_source then SeccompTools::Util.template('asm.c').sub('<TO_BE_REPLACED>', res.bytes.join(','))
-          when :assembly
-            SeccompTools::Util.template("asm.#{option[:arch]}.asm").sub(
-              '<TO_BE_REPLACED>',
-              res.bytes.map { |b| format('\\\%03o', b) }.join
-            )
-          end
-        end
+        res = SeccompTools::Asm.asm(input, filename: option[:ifile], arch: option[:arch], optimize: option[:optimize])
+        output { format_bpf(res) }
       end
     end
   end
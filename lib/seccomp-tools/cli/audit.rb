@@ -3,6 +3,7 @@
 require 'json'
 
 require 'seccomp-tools/audit'
+require 'seccomp-tools/audit/tally'
 require 'seccomp-tools/cli/base'
 require 'seccomp-tools/cli/filter_input'
 require 'seccomp-tools/disasm/disasm'
@@ -35,6 +36,8 @@ module SeccompTools
           opt.banner = usage
           option_filter_source(opt, 'audit')
           option_arch(opt, 'With an executable or --pid the architecture is auto-detected instead.')
+          option_cache(opt)
+          option_batch(opt, 'audit')
 
           opt.on('-f', '--format FORMAT', %i[human json], 'Output format, one of <human|json>.',
                  'Default: human') do |f|
@@ -43,11 +46,12 @@ module SeccompTools
         end
       end
 
-      # Reads the filter(s) from a BPF file, an executable, or an existing process, then reports the
-      # weaknesses of each.
+      # Reads the filter(s) from a BPF file, an executable, an existing process, or the files of
+      # +--batch+, then reports the weaknesses of each.
       # @return [void]
       def handle
         return unless super
+        return audit_batch if option[:batch]
 
         filters = collect_filters
         return if filters.empty?
@@ -73,12 +77,43 @@ module SeccompTools
         output { "#{JSON.pretty_generate(stacked_filters: filters.size, reports:)}\n" }
       end
 
+      # Prints the report of every file of +--batch+ (or one JSON document of them all, the files
+      # that failed listed under +errors+), then what they add up to. Exits with status 1 when a file
+      # failed.
+      def audit_batch
+        warn_ignored_arguments
+        json = option[:format] == :json
+        tally = SeccompTools::Audit::Tally.new
+        reports = []
+        errors = []
+        failed = each_batch(method(:analyze), errors: json ? errors : nil) do |path, (arches, findings, truncated)|
+          report = SeccompTools::Audit::Report.new(source: path, arches:, findings:, truncated:)
+          tally.add(report)
+          json ? reports << report.to_h : output { report.to_s }
+        end
+        return exit_batch(failed) if failed.nil?
+
+        tally.fail!(failed)
+        output { json ? "#{JSON.pretty_generate(summary: tally.to_h, reports:, errors:)}\n" : "\n#{tally}" }
+        exit_batch(failed)
+      end
+
       # Yields the {Audit::Report} of each filter, labelling stacked filters like +explain+ does.
       def each_report(filters)
         filters.each_with_index do |(raw, arch, source), idx|
           label = filters.size > 1 ? "#{source} (filter ##{idx})" : source
+          arches, findings, truncated = analyze(raw, arch)
+          yield SeccompTools::Audit::Report.new(source: label, arches:, findings:, truncated:)
+        end
+      end
+
+      # The +[arches, findings, truncated]+ of one filter's {Audit::Report}, which holds no label so
+      # a cached one serves the same filter from any source.
+      def analyze(raw, arch)
+        cached(:audit, raw, arch) do
           insts = SeccompTools::Disasm.to_bpf(raw, arch).map(&:inst)
-          yield SeccompTools::Audit.new(insts, arch:, source: label).audit
+          report = SeccompTools::Audit.new(insts, arch:, walk: walk_of(raw, arch, insts)).audit
+          [report.arches, report.findings, report.truncated]
         end
       end
     end
@@ -71,15 +71,24 @@ module SeccompTools
       #   The data to be written.
       # @return [void]
       def output
+        output_to { |io| io.write(yield) }
+      end
+
+      # Like {#output}, but hands the block the stream to write to, for output written piece by piece
+      # as it is produced rather than built whole first.
+      # @yieldparam [IO] io
+      #   +$stdout+, or the file for this call.
+      # @return [void]
+      def output_to
         # if file name not present, just output to stdout.
-        return $stdout.write(yield) if option[:ofile].nil?
+        return yield($stdout) if option[:ofile].nil?
 
         # times of calling output
         @serial ||= 0
         # Write to file, we should disable colorize
         enabled = Util.colorize_enabled?
         Util.disable_color! if enabled
-        File.binwrite(file_of(option[:ofile], @serial), yield)
+        File.open(file_of(option[:ofile], @serial), 'wb') { |f| yield f }
         Util.enable_color! if enabled
         @serial += 1
       end
@@ -0,0 +1,47 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/util'
+
+module SeccompTools
+  module CLI
+    # Shared output handling for the commands that produce a seccomp filter ({Asm} and {Optimize}):
+    # the +-f/--format+ option and the rendering of raw BPF bytes in each format. The including
+    # command must provide +option+ (from {Base}).
+    module BPFOutput
+      # Formats {#format_bpf} can render.
+      FORMATS = %i[inspect raw c_array carray c_source assembly].freeze
+
+      private
+
+      # Registers +-f/--format+ on +opt+, defaulting to +inspect+.
+      # @param [OptionParser] opt
+      # @return [void]
+      def option_bpf_format(opt)
+        option[:format] ||= :inspect
+        opt.on('-f', '--format FORMAT', FORMATS,
+               'Output format. FORMAT can only be one of <inspect|raw|c_array|c_source|assembly>.',
+               'Default: inspect') do |f|
+                 option[:format] = f
+               end
+      end
+
+      # Renders +res+ in the format given by +--format+.
+      # @param [String] res
+      #   Raw BPF bytes.
+      # @return [String]
+      def format_bpf(res)
+        case option[:format]
+        when :inspect then "#{res.inspect}\n"
+        when :raw then res
+        when :c_array, :carray then "unsigned char bpf[] = {#{res.bytes.join(',')}};\n"
+        when :c_source then SeccompTools::Util.template('asm.c').sub('<TO_BE_REPLACED>', res.bytes.join(','))
+        when :assembly
+          SeccompTools::Util.template("asm.#{option[:arch]}.asm").sub(
+            '<TO_BE_REPLACED>',
+            res.bytes.map { |b| format('\\\%03o', b) }.join
+          )
+        end
+      end
+    end
+  end
+end
@@ -0,0 +1,92 @@
+# frozen_string_literal: true
+
+require 'json'
+
+require 'seccomp-tools/action_cache'
+require 'seccomp-tools/cli/base'
+require 'seccomp-tools/cli/filter_input'
+require 'seccomp-tools/disasm/disasm'
+require 'seccomp-tools/logger'
+
+module SeccompTools
+  module CLI
+    # Handle 'cache' command.
+    class Cache < Base
+      include FilterInput
+
+      # Summary of this command.
+      SUMMARY = "Report which allowed syscalls skip a seccomp filter through the kernel's action cache."
+      # Usage of this command.
+      USAGE = "cache - #{SUMMARY}\n\nUsage: seccomp-tools cache [options] [BPF_FILE|EXEC]".freeze
+
+      # Instantiate a {Cache} object.
+      #
+      # Takes the same arguments as {Base#initialize}.
+      def initialize(*)
+        super
+        option[:format] = :human
+      end
+
+      # Define option parser.
+      # @return [OptionParser]
+      #   The parser of this command's options.
+      def parser
+        @parser ||= OptionParser.new do |opt|
+          opt.banner = usage
+          option_filter_source(opt, 'analyze')
+          option_arch(opt, 'Its compat architecture (i386 for amd64) is analysed too.',
+                      'With an executable or --pid the architecture is auto-detected instead.')
+
+          opt.on('-f', '--format FORMAT', %i[human json], 'Output format, one of <human|json>.',
+                 'Default: human') do |f|
+            option[:format] = f
+          end
+        end
+      end
+
+      # Reads the filter(s) from a BPF file, an executable, or an existing process, then reports the
+      # syscalls the kernel caches for each, and for them all when several are stacked.
+      # @return [void]
+      def handle
+        return unless super
+
+        filters = collect_filters
+        return if filters.empty?
+
+        reports = filters.each_with_index.map do |(raw, arch, source), idx|
+          label = filters.size > 1 ? "#{source} (filter ##{idx})" : source
+          insts = SeccompTools::Disasm.to_bpf(raw, arch).map(&:inst)
+          SeccompTools::ActionCache.new(insts, arch:, source: label).analyze
+        end
+        total = stack(reports, filters)
+        option[:format] == :json ? emit_json(reports, total) : emit_human(reports, total)
+      end
+
+      private
+
+      # What the kernel caches for all of +filters+ together, or +nil+ when there is only one.
+      def stack(reports, filters)
+        return nil if reports.size == 1
+
+        SeccompTools::ActionCache::Report.stack(reports, source: "all #{filters.size} filters of #{filters.first[2]}")
+      end
+
+      # Prints each filter's report, then what the kernel caches for them stacked.
+      def emit_human(reports, total)
+        reports.each { |report| output { report.to_s } }
+        return if total.nil?
+
+        Logger.warn("#{reports.size} filters are installed; the kernel caches a syscall only when every one " \
+                    'of them lets it. What it caches for them all is reported last.')
+        output { total.to_s }
+      end
+
+      # Prints one JSON document describing every stacked filter.
+      def emit_json(reports, total)
+        doc = { stacked_filters: reports.size, reports: reports.map(&:to_h) }
+        doc[:stacked] = total.to_h if total
+        output { "#{JSON.pretty_generate(doc)}\n" }
+      end
+    end
+  end
+end
@@ -1,30 +1,33 @@
 # frozen_string_literal: true
 
-require 'seccomp-tools/cli/asm'
-require 'seccomp-tools/cli/audit'
-require 'seccomp-tools/cli/completion'
-require 'seccomp-tools/cli/disasm'
-require 'seccomp-tools/cli/dump'
-require 'seccomp-tools/cli/emu'
-require 'seccomp-tools/cli/explain'
 require 'seccomp-tools/version'
 
 module SeccompTools
   # Handle CLI arguments parse.
+  #
+  # The handler of a command is loaded when the command runs, so each command requires only its own
+  # part of the library.
   module CLI
-    # Handled commands
+    # Handled commands, with the name of their handler class.
     COMMANDS = {
-      'asm' => SeccompTools::CLI::Asm,
-      'audit' => SeccompTools::CLI::Audit,
-      'completion' => SeccompTools::CLI::Completion,
-      'disasm' => SeccompTools::CLI::Disasm,
-      'dump' => SeccompTools::CLI::Dump,
-      'emu' => SeccompTools::CLI::Emu,
-      'explain' => SeccompTools::CLI::Explain
+      'asm' => :Asm,
+      'audit' => :Audit,
+      'cache' => :Cache,
+      'completion' => :Completion,
+      'cost' => :Cost,
+      'disasm' => :Disasm,
+      'dump' => :Dump,
+      'emu' => :Emu,
+      'explain' => :Explain,
+      'merge' => :Merge,
+      'optimize' => :Optimize,
+      'serve' => :Serve
     }.freeze
 
-    # Main usage message.
-    USAGE = <<EOS.sub('%COMMANDS', COMMANDS.map { |k, v| "\t#{k}\t#{v::SUMMARY}" }.join("\n")).freeze
+    COMMANDS.each_value { |name| autoload(name, "seccomp-tools/cli/#{name.downcase}") }
+
+    # Main usage message, without the list of commands.
+    USAGE_TEMPLATE = <<EOS
 Usage: seccomp-tools [--version] [--help] <command> [<options>]
 
 List of commands:
@@ -34,6 +37,19 @@ List of commands:
 See 'seccomp-tools <command> --help' to read about a specific subcommand.
 EOS
 
+    # Defines +USAGE+, the main usage message, on first use: listing the commands with their
+    # summaries loads every handler.
+    # @param [Symbol] cons
+    # @return [String]
+    # @raise [NameError]
+    #   For any other missing constant.
+    def self.const_missing(cons)
+      return super unless cons == :USAGE
+
+      list = COMMANDS.map { |k, v| "\t#{k}\t#{const_get(v)::SUMMARY}" }.join("\n")
+      const_set(:USAGE, USAGE_TEMPLATE.sub('%COMMANDS', list).freeze)
+    end
+
     module_function
 
     # Main working method of CLI.
@@ -60,7 +76,7 @@ EOS
       argv = %w[--help] if preoption.include?('--help')
       return show(invalid(cmd)) if COMMANDS[cmd].nil?
 
-      COMMANDS[cmd].new(argv).handle
+      const_get(COMMANDS[cmd]).new(argv).handle
     end
 
     # Writes a message to stdout, followed by a newline.
@@ -0,0 +1,112 @@
+# frozen_string_literal: true
+
+require 'json'
+
+require 'seccomp-tools/cli/base'
+require 'seccomp-tools/cli/filter_input'
+require 'seccomp-tools/cost'
+require 'seccomp-tools/cost/profile'
+require 'seccomp-tools/disasm/disasm'
+require 'seccomp-tools/logger'
+
+module SeccompTools
+  module CLI
+    # Handle 'cost' command.
+    class Cost < Base
+      include FilterInput
+
+      # Summary of this command.
+      SUMMARY = 'Report how many instructions a seccomp filter executes for each syscall.'
+      # Usage of this command.
+      USAGE = "cost - #{SUMMARY}\n\nUsage: seccomp-tools cost [options] [BPF_FILE|EXEC]".freeze
+
+      # Instantiate a {Cost} object.
+      #
+      # Takes the same arguments as {Base#initialize}.
+      def initialize(*)
+        super
+        option[:format] = :human
+      end
+
+      # Define option parser.
+      # @return [OptionParser]
+      #   The parser of this command's options.
+      def parser
+        @parser ||= OptionParser.new do |opt|
+          opt.banner = usage
+          option_filter_source(opt, 'measure')
+          option_arch(opt, 'With an executable or --pid the architecture is auto-detected instead.')
+
+          opt.on('-f', '--format FORMAT', %i[human json], 'Output format, one of <human|json>.',
+                 'Default: human') do |f|
+            option[:format] = f
+          end
+
+          opt.on('-n', '--top N', Integer, 'List only the N most expensive syscalls of each architecture.',
+                 'Default: all of them') do |n|
+            option[:top] = n
+          end
+
+          opt.on('--profile FILE', 'Also report the average cost weighted by how often each syscall is made.',
+                 'FILE is the output of `strace -c`, or one "syscall count" pair per line.') do |f|
+            option[:profile] = f
+          end
+        end
+      end
+
+      # Reads the filter(s) from a BPF file, an executable, or an existing process, then reports the
+      # cost of each, and of them all when several are stacked.
+      # @return [void]
+      def handle
+        return unless super
+
+        profile = read_profile
+        return if profile == false
+
+        filters = collect_filters
+        return if filters.empty?
+
+        reports = filters.each_with_index.map do |(raw, arch, source), idx|
+          label = filters.size > 1 ? "#{source} (filter ##{idx})" : source
+          insts = SeccompTools::Disasm.to_bpf(raw, arch).map(&:inst)
+          SeccompTools::Cost.new(insts, arch:, source: label).cost(profile:)
+        end
+        total = reports.size > 1 ? SeccompTools::Cost::Report.stack(reports, source: stacked_label(filters)) : nil
+        option[:format] == :json ? emit_json(reports, total) : emit_human(reports, total)
+      end
+
+      private
+
+      # The profile given by +--profile+, +nil+ without one, or +false+ when it cannot be read.
+      def read_profile
+        return nil if option[:profile].nil?
+
+        SeccompTools::Cost::Profile.parse(File.read(option[:profile]))
+      rescue SystemCallError => e
+        Logger.error(e.message)
+        false
+      end
+
+      def stacked_label(filters)
+        "all #{filters.size} filters of #{filters.first[2]}"
+      end
+
+      # Prints each filter's report, then their stacked total.
+      def emit_human(reports, total)
+        reports.each { |report| output { report.to_s(top: option[:top]) } }
+        return if total.nil?
+
+        Logger.warn("#{reports.size} filters are installed; they stack, so every syscall runs each of them. " \
+                    'Their total cost is reported last.')
+        output { total.to_s(top: option[:top]) }
+      end
+
+      # Prints one JSON document describing every stacked filter.
+      def emit_json(reports, total)
+        doc = { stacked_filters: reports.size, reports: reports.map(&:to_h) }
+        doc[:stacked] = total.to_h if total
+        output { "#{JSON.pretty_generate(doc)}\n" }
+      end
+    end
+  end
+end
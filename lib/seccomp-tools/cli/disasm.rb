@@ -2,6 +2,7 @@
 
 require 'seccomp-tools/cli/base'
 require 'seccomp-tools/disasm/disasm'
+require 'seccomp-tools/logger'
 
 module SeccompTools
   module CLI
@@ -50,7 +51,8 @@ module SeccompTools
         end
       end
 
-      # Disassembles the input file and writes the result.
+      # Disassembles the input file, writing each line as soon as it is known, with a warning on stderr
+      # when the kernel would refuse to install the filter.
       # @return [void]
       def handle
         return unless super
@@ -58,11 +60,23 @@ module SeccompTools
         option[:ifile] = argv.shift
         return CLI.show(parser.help) if option[:ifile].nil?
 
-        output do
-          SeccompTools::Disasm.disasm(input, arch: option[:arch], display_bpf: option[:bpf],
-                                             arg_infer: option[:arg_infer])
+        raw = input
+        warn_refused(raw)
+        output_to do |io|
+          SeccompTools::Disasm.write(io, raw, arch: option[:arch], display_bpf: option[:bpf],
+                                              arg_infer: option[:arg_infer])
         end
       end
+
+      private
+
+      def warn_refused(raw)
+        line, reason = SeccompTools::Disasm.decode(raw, option[:arch]).check
+        return if reason.nil?
+
+        at = line.nil? ? '' : format(' at line %04d', line)
+        Logger.warn("The kernel would refuse this filter#{at}: #{reason}.", io: $stderr)
+      end
     end
   end
 end
@@ -39,6 +39,10 @@ module SeccompTools
                    option[:format] = f
                  end
 
+          opt.on('--all', 'Dump the filters of every process on this host that has seccomp filters installed.',
+                 'Each distinct filter is shown once, after the pids sharing it. --limit applies per thread.',
+                 'You must have CAP_SYS_ADMIN (e.g. be root) to use this option.') { option[:all] = true }
+
           opt.on('-o', '--output FILE', 'Write output to FILE instead of stdout.',
                  'If multiple seccomp syscalls have been invoked (see --limit),',
                  'results are written to FILE, FILE_1, FILE_2, etc.',
@@ -55,8 +59,9 @@ module SeccompTools
       def handle
         return unless dumping_supported?
         return unless super
+        return dump_all if option[:all]
 
-        collect_filters.each { |bpf, arch| emit(bpf, arch) }
+        collect_filters { |bpf, arch| emit(bpf, arch) }
       end
 
       private
@@ -68,14 +73,28 @@ module SeccompTools
         false
       end
 
-      # Writes one dumped filter in the requested format.
+      # Writes the distinct filters of every seccomp'd process, see {SeccompTools::Dumper.dump_all}.
       # @return [void]
-      def emit(bpf, arch)
+      def dump_all
+        warn_ignored_arguments
+        dump_seccomp_all(option[:limit]) { |bpf, arch, pids| emit(bpf, arch, pids) }
+      end
+
+      # Writes one dumped filter in the requested format, as soon as it is dumped. The textual formats
+      # are preceded by the processes sharing it, when given.
+      # @return [nil]
+      def emit(bpf, arch, pids = nil)
+        header = pids ? "pid #{pids.join(', ')}\n" : ''
         case option[:format]
-        when :inspect then output { "\"#{bpf.bytes.map { |b| format('\\x%02X', b) }.join}\"\n" }
+        when :inspect then output { "#{header}\"#{bpf.bytes.map { |b| format('\\x%02X', b) }.join}\"\n" }
         when :raw then output { bpf }
-        when :disasm then output { SeccompTools::Disasm.disasm(bpf, arch:) }
+        when :disasm
+          output_to do |io|
+            io.write(header)
+            SeccompTools::Disasm.write(io, bpf, arch:)
+          end
         end
+        nil
       end
     end
   end
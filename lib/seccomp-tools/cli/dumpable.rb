@@ -23,22 +23,43 @@ module SeccompTools
       #   Stop after this many installed filters.
       # @param [Float?] timeout
       #   Seconds to wait for +command+, ignored when tracing a pid.
+      # @param [Boolean] trap
+      #   Trace +command+ in trap mode (see {SeccompTools::Dumper.dump}), ignored when tracing a pid.
       # @yieldparam [String] bpf
       #   One installed filter, as raw bytes.
       # @yieldparam [Symbol?] arch
       #   The architecture of the traced process, if known.
       # @return [Array]
       #   One entry per filter: the block's return values. Empty when nothing was installed.
-      def dump_seccomp(command:, pid:, limit:, timeout:, &)
+      def dump_seccomp(command:, pid:, limit:, timeout:, trap: false, &)
         filters = if pid
                     dump_seccomp_by_pid(pid, limit, &)
                   else
-                    SeccompTools::Dumper.dump('/bin/sh', '-c', command, limit:, timeout:, &)
+                    SeccompTools::Dumper.dump('/bin/sh', '-c', command, limit:, timeout:, trap:, &)
                   end
         Logger.warn('No seccomp filter was installed.') if filters.empty?
         filters
       end
 
+      # Dumps the distinct seccomp filters of every process on the host (requiring +CAP_SYS_ADMIN+),
+      # yielding each with the pids sharing it. See {SeccompTools::Dumper.dump_all}.
+      #
+      # On a permission error {#dump_permission_error} exits. Warns when no process has a filter.
+      # @param [Integer] limit
+      #   Dump this many filters per thread.
+      # @yieldparam [String] bpf
+      # @yieldparam [Symbol?] arch
+      # @yieldparam [Array<Integer>] pids
+      # @return [Array]
+      #   One entry per distinct filter: the block's return values.
+      def dump_seccomp_all(limit, &)
+        filters = SeccompTools::Dumper.dump_all(limit, &)
+        Logger.warn('No seccomp filter was installed.') if filters.empty?
+        filters
+      rescue Errno::EPERM, Errno::EACCES => e
+        dump_permission_error(e)
+      end
+
       # Whether tracer-based dumping is available on this platform (Linux only). Logs an error when
       # it is not, so callers can guard with +return unless dumping_supported?+.
       # @return [Boolean]
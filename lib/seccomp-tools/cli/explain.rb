@@ -5,6 +5,7 @@ require 'seccomp-tools/cli/filter_input'
 require 'seccomp-tools/disasm/disasm'
 require 'seccomp-tools/explain'
 require 'seccomp-tools/logger'
+require 'seccomp-tools/util'
 
 module SeccompTools
   module CLI
@@ -26,14 +27,17 @@ module SeccompTools
 
           option_filter_source(opt, 'explain')
           option_arch(opt, 'With an executable or --pid the architecture is auto-detected instead.')
+          option_cache(opt)
+          option_batch(opt, 'explain')
         end
       end
 
-      # Reads the filter(s) from a BPF file, an executable, or an existing process, then prints the
-      # policy of each.
+      # Reads the filter(s) from a BPF file, an executable, an existing process, or the files of
+      # +--batch+, then prints the policy of each.
       # @return [void]
       def handle
         return unless super
+        return explain_batch if option[:batch]
 
         filters = collect_filters
         if filters.size > 1
@@ -42,8 +46,27 @@ module SeccompTools
         end
         filters.each_with_index do |(raw, arch, source), idx|
           label = filters.size > 1 ? "#{source} (filter ##{idx})" : source
+          output { SeccompTools::Explain::Summary.header(label) + summary(raw, arch) }
+        end
+      end
+
+      private
+
+      # Prints the policy of every file of +--batch+. Exits with status 1 when a file failed.
+      def explain_batch
+        warn_ignored_arguments
+        failed = each_batch(method(:summary)) do |path, text|
+          output { SeccompTools::Explain::Summary.header(path) + text }
+        end
+        exit_batch(failed)
+      end
+
+      # The policy of one filter, without its header; colored or not as the output is, which the
+      # cached text depends on too.
+      def summary(raw, arch)
+        cached(:explain, raw, arch, Util.colorize_enabled?) do
           insts = SeccompTools::Disasm.to_bpf(raw, arch).map(&:inst)
-          output { SeccompTools::Explain.new(insts, arch:, source: label).summarize.to_s }
+          SeccompTools::Explain.new(insts, arch:, walk: walk_of(raw, arch, insts)).summarize.to_s
         end
       end
     end
@@ -1,7 +1,12 @@
 # frozen_string_literal: true
 
+require 'etc'
+
+require 'seccomp-tools/analysis_cache'
+require 'seccomp-tools/batch'
 require 'seccomp-tools/cli/dumpable'
 require 'seccomp-tools/logger'
+require 'seccomp-tools/symbolic/executor'
 require 'seccomp-tools/util'
 
 module SeccompTools
@@ -17,12 +22,13 @@ module SeccompTools
       private
 
       # Registers the options every command taking its filter from a process shares - +-c/--sh-exec+,
-      # +-l/--limit+, +-p/--pid+ and +-t/--timeout+ - and their defaults, so the four stay described
-      # and parsed the same way wherever they appear. The counterpart of {Base#option_arch}.
+      # +-l/--limit+, +-p/--pid+, +-t/--timeout+ and +--trap+ - and their defaults, so they stay
+      # described and parsed the same way wherever they appear. The counterpart of {Base#option_arch}.
       #
       # The descriptions hold for every including command, because the behaviour they describe lives
       # in the shared code: {#collect_filters} gives +-c+ precedence, and {Dumpable#dump_seccomp}
-      # passes +--timeout+ only when running an executable, never when attaching to a +--pid+.
+      # passes +--timeout+ and +--trap+ only when running an executable, never when attaching to a
+      # +--pid+.
       # @param [OptionParser] opt
       # @param [String] action
       #   What the command does with each filter, woven into the descriptions.
@@ -31,6 +37,7 @@ module SeccompTools
       #   option_filter_source(opt, 'explain')
       def option_filter_source(opt, action)
         option[:limit] = 1
+        option[:trap] = false
         opt.on('-c', '--sh-exec <command>', "Executes the given command (via sh) and #{action}s its seccomp.",
                'Use this to pass arguments or pipe things to the executable.',
                'e.g. use `-c "./bin > /dev/null"` to keep the program output out of the result.',
@@ -45,6 +52,120 @@ module SeccompTools
 
         opt.on('-t', '--timeout SEC', Float, 'Timeout (seconds) for the execution. Default: no timeout',
                'This option is ignored when --pid is given.') { |t| option[:timeout] = t }
+
+        opt.on('--trap', 'Stop the executable only at its seccomp installations instead of at every syscall,',
+               'by installing a filter that traps them first. Much faster on syscall-heavy programs,',
+               'but the extra filter is visible to the program and sets no_new_privs when not root.',
+               'This option is ignored when --pid is given.') { option[:trap] = true }
+      end
+
+      # Registers +--cache [DIR]+, which keeps the results of the analysis on disk in an
+      # {AnalysisCache} for {#cached} and {#walk_of} to reuse.
+      # @param [OptionParser] opt
+      # @return [void]
+      def option_cache(opt)
+        opt.on('--cache [DIR]', 'Reuse the results for filters analyzed before, kept on disk under DIR by',
+               'their bytes, architecture and the seccomp-tools version.',
+               'Default DIR: $XDG_CACHE_HOME/seccomp-tools (or ~/.cache/seccomp-tools)') do |dir|
+          option[:cache] = dir || AnalysisCache.default_dir
+        end
+      end
+
+      # Registers +--batch DIR|@LIST+, which takes many raw BPF files in one run, and +-j/--jobs+ and
+      # +--unordered+, which tune how {#each_batch} goes through them.
+      # @param [OptionParser] opt
+      # @param [String] action
+      #   What the command does with each filter, woven into the descriptions.
+      # @return [void]
+      def option_batch(opt, action)
+        option[:jobs] = Etc.nprocessors
+        option[:ordered] = true
+        opt.on('--batch DIR|@LIST', "#{action.capitalize} every file under DIR, or listed one per line in LIST,",
+               'as a raw BPF of --arch, in one run. Takes precedence over the other inputs.') do |batch|
+          option[:batch] = batch
+        end
+
+        opt.on('-j', '--jobs N', Integer, 'Worker processes for --batch. Default: the number of processors') do |n|
+          option[:jobs] = n
+        end
+
+        opt.on('--unordered', 'With --batch, print each result as soon as it is ready instead of in input order.') do
+          option[:ordered] = false
+        end
+      end
+
+      # The files +--batch+ names: every regular file under the directory, sorted, or every path
+      # listed in the +@+ file (blank lines and +#+ comments skipped).
+      # @return [Array<String>?]
+      #   +nil+ when the directory or list cannot be read, which is logged.
+      def batch_files
+        spec = option[:batch]
+        return File.readlines(spec[1..], chomp: true).map(&:strip).grep_v(/\A(#|\z)/) if spec.start_with?('@')
+        raise Errno::ENOENT, spec unless File.directory?(spec)
+
+        Dir.glob('**/*', base: spec).sort.map { |f| File.join(spec, f) }.select { |f| File.file?(f) }
+      rescue SystemCallError => e
+        Logger.error(e.message)
+        nil
+      end
+
+      # Runs +work+ on the bytes and +--arch+ of every file of +--batch+, spread over +--jobs+ worker
+      # processes, and yields each file with what +work+ returned, in input order unless +--unordered+.
+      # A file +work+ fails on is logged instead of yielded, or added to +errors+ when given.
+      # @param [#call] work
+      # @param [Array<Hash>?] errors
+      #   Gets a +{ source:, error: }+ for each file that failed, for output that must not be mixed
+      #   with log lines, such as a JSON document.
+      # @yieldparam [String] path
+      # @yieldparam [Object] result
+      # @return [Integer?]
+      #   How many files failed; +nil+ when there were none to go through, see {#batch_files}.
+      def each_batch(work, errors: nil)
+        files = batch_files
+        return nil if files.nil?
+
+        failed = 0
+        arch = option[:arch]
+        SeccompTools::Batch.new(files, jobs: option[:jobs]) { |path| work.call(File.binread(path), arch) }
+                           .each(ordered: option[:ordered]) do |path, result, error|
+          next yield(path, result) unless error
+
+          errors ? errors << { source: path, error: } : Logger.error("#{path}: #{error}")
+          failed += 1
+        end
+        failed
+      end
+
+      # The result of +kind+ for the filter +raw+, from the cache when +--cache+ is given and it holds
+      # one, else computed by the block (and stored).
+      # @param [Symbol] kind
+      # @param [String] raw
+      # @param [Symbol] arch
+      # @param [Array] extra
+      #   Anything else the result depends on.
+      # @yieldreturn [Object]
+      # @return [Object]
+      def cached(kind, raw, arch, *extra, &)
+        return yield unless option[:cache]
+
+        (@cache ||= AnalysisCache.new(dir: option[:cache])).fetch(kind, raw, arch, *extra, &)
+      end
+
+      # The symbolic walk of +insts+, the instructions of +raw+, through the cache when +--cache+ is
+      # given; +nil+ otherwise, leaving the walk to the analysis.
+      # @return [Array(Array<Symbolic::Executor::Leaf>, Boolean)?]
+      def walk_of(raw, arch, insts)
+        return nil unless option[:cache]
+
+        (@cache ||= AnalysisCache.new(dir: option[:cache])).walk(raw, arch) { Symbolic::Executor.new(insts).run }
+      end
+
+      # Ends a +--batch+ run with status 1 when a file failed or there were none to go through.
+      # @param [Integer?] failed
+      #   What {#each_batch} returned.
+      # @return [void]
+      def exit_batch(failed)
+        exit(1) unless failed&.zero?
       end
 
       # Resolves the input into an array of +[raw_bpf, arch, source]+ tuples, empty when there is
@@ -54,22 +175,27 @@ module SeccompTools
       # * a running process, when +--pid+ is given;
       # * a raw BPF file (or stdin), when the positional argument is not an executable;
       # * a command to run and trace - either +-c+, or a positional executable.
-      # @return [Array<Array(String, Symbol, String?)>]
-      def collect_filters
+      # @yieldparam [String] raw
+      # @yieldparam [Symbol] arch
+      # @yieldparam [String?] source
+      #   When a block is given, each filter is passed to it as soon as it is read or dumped, and
+      #   what it returns takes the tuple's place in the result.
+      # @return [Array<Array(String, Symbol, String?)>, Array]
+      def collect_filters(&each)
         # -c/--sh-exec and --pid take precedence over a positional BPF file or executable.
         option[:ifile] = argv.shift unless option[:command] || option[:pid]
         warn_ignored_arguments
 
-        return dump_filters(command: nil, pid: option[:pid], source: "pid #{option[:pid]}") if option[:pid]
+        return dump_filters(command: nil, pid: option[:pid], source: "pid #{option[:pid]}", &each) if option[:pid]
 
         command = option[:command] || option[:ifile]
         if command.nil? # nothing to process
           CLI.show(parser.help)
           return []
         end
-        return read_raw_bpf if raw_bpf_file?
+        return read_raw_bpf.map { |filter| each ? each.call(*filter) : filter } if raw_bpf_file?
 
-        dump_filters(command:, pid: nil, source: command)
+        dump_filters(command:, pid: nil, source: command, &each)
       end
 
       # Reads the positional file (or stdin) as a raw BPF blob, logging an error instead of
@@ -99,14 +225,18 @@ module SeccompTools
         true
       end
 
-      # Dumps filters from a command or pid and labels each with +source+.
-      # @return [Array<Array(String, Symbol, String?)>]
-      #   The filter tuples, empty when dumping is unsupported or nothing was installed.
-      def dump_filters(command:, pid:, source:)
+      # Dumps filters from a command or pid and labels each with +source+, passing each tuple to the
+      # block, when given, as soon as it is dumped.
+      # @return [Array<Array(String, Symbol, String?)>, Array]
+      #   The filter tuples, or what the block returned for them; empty when dumping is unsupported
+      #   or nothing was installed.
+      def dump_filters(command:, pid:, source:, &each)
         return [] unless dumping_supported?
 
-        dump_seccomp(command:, pid:, limit: option[:limit], timeout: option[:timeout]) do |bpf, arch|
-          [bpf, arch || option[:arch], source]
+        dump_seccomp(command:, pid:, limit: option[:limit], timeout: option[:timeout],
+                     trap: option[:trap]) do |bpf, arch|
+          filter = [bpf, arch || option[:arch], source]
+          each ? each.call(*filter) : filter
         end
       end
 
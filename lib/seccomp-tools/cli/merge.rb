@@ -0,0 +1,137 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/cli/base'
+require 'seccomp-tools/cli/bpf_output'
+require 'seccomp-tools/cli/filter_input'
+require 'seccomp-tools/cost'
+require 'seccomp-tools/cost/profile'
+require 'seccomp-tools/disasm/disasm'
+require 'seccomp-tools/logger'
+require 'seccomp-tools/merger'
+require 'seccomp-tools/util'
+
+module SeccompTools
+  module CLI
+    # Handle 'merge' command.
+    class Merge < Base
+      include BPFOutput
+      include FilterInput
+
+      # Summary of this command.
+      SUMMARY = 'Merge stacked seccomp filters into a single equivalent one.'
+      # Usage of this command.
+      USAGE = "merge - #{SUMMARY}\n\nUsage: seccomp-tools merge [options] BPF_FILE... | EXEC".freeze
+
+      # Define option parser.
+      # @return [OptionParser]
+      #   The parser of this command's options.
+      def parser
+        @parser ||= OptionParser.new do |opt|
+          opt.banner = usage
+          opt.separator('    BPF_FILEs are given in the order they are installed, the oldest first.')
+          option_filter_source(opt, 'merge')
+          opt.on('-o', '--output FILE', 'Write output to FILE instead of stdout,',
+                 'and report how many instructions each syscall executes before and after.') do |o|
+            option[:ofile] = o
+          end
+
+          option_bpf_format(opt)
+          option_arch(opt, 'With an executable or --pid the architecture is auto-detected instead.')
+
+          opt.on('-n', '--top N', Integer, 'Report only the N syscalls of each architecture dearest before merging.',
+                 'Default: all of them') do |n|
+            option[:top] = n
+          end
+
+          opt.on('--profile FILE', 'How often each syscall is made, to decide the hottest ones first.',
+                 'FILE is the output of `strace -c`, or one "syscall count" pair per line.',
+                 'Default: every syscall is as frequent') do |f|
+            option[:profile] = f
+          end
+        end
+      end
+
+      # Reads the stacked filters from BPF files, an executable, or an existing process, merges them
+      # and writes the result in the requested format.
+      # @return [void]
+      def handle
+        return unless super
+
+        profile = option[:profile] && SeccompTools::Cost::Profile.parse(File.read(option[:profile]))
+        filters = read_filters
+        return if filters.empty?
+
+        Logger.warn('Only one filter is given; it is optimized alone.') if filters.size == 1
+        option[:arch] = filters.first[1]
+        raws = filters.map(&:first)
+        res = SeccompTools::Merger.new(raws, arch: option[:arch], profile:).merge
+        output { format_bpf(res) }
+        report(filters, res, profile) if option[:ofile]
+      rescue SeccompTools::MergeError, SystemCallError => e
+        Logger.error(e.message)
+      end
+
+      private
+
+      # Several positional arguments are BPF files, oldest first; otherwise the input is resolved as
+      # by the other commands taking filters, where +--limit+ says how many to dump.
+      def read_filters
+        return collect_filters if argv.size < 2 || option[:command] || option[:pid]
+
+        argv.shift(argv.size).map { |file| [File.binread(file), option[:arch], file] }
+      end
+
+      # Prints the size of the filters before and after, and what each syscall executes.
+      def report(filters, res, profile)
+        before = SeccompTools::Cost::Report.stack(filters.map { |raw, arch, _| cost(raw, arch) })
+        after = cost(res, option[:arch])
+        sizes = filters.map { |raw, _, _| raw.size / 8 }.join(' + ')
+        CLI.show("Merged #{filters.size} filter#{'s' if filters.size > 1} of #{source_label(filters)}: " \
+                 "#{sizes} -> #{res.size / 8} instructions")
+        CLI.show('Instructions executed per syscall, stacked -> merged; a range spans paths that differ by arguments.')
+        before.sections.each do |section|
+          merged = after.sections.find { |s| s.arch == section.arch }
+          CLI.show("\n#{compare(section, merged, profile)}") if merged
+        end
+      end
+
+      def cost(raw, arch)
+        insts = SeccompTools::Disasm.to_bpf(raw, arch).map(&:inst)
+        SeccompTools::Cost.new(insts, arch:).cost
+      end
+
+      def source_label(filters)
+        filters.map(&:last).uniq.join(', ')
+      end
+
+      # One architecture's comparison: the average over its syscalls (weighted by +profile+ too when
+      # given) and each syscall's cost, dearest first before merging.
+      def compare(before, after, profile)
+        out = "Architecture: #{Util.colorize(before.arch, t: :arch)}\n"
+        rows = before.rows
+        return "#{out}  (no return reached)" if rows.empty?
+
+        merged = after.rows.to_h { |r| [r.name, r] }
+        out << "  #{rows.size} syscalls: #{average(rows)} -> #{average(after.rows)} on average"
+        weighted = profile && [before.weighted(profile), after.weighted(profile)]
+        out << format(', %.1f -> %.1f weighted by the profile', weighted[0][1], weighted[1][1]) if weighted&.all?
+        shown = option[:top] ? rows.first(option[:top]) : rows
+        width = shown.map { |r| r.name.size }.max
+        shown.each do |r|
+          m = merged[r.name]
+          out << "\n    #{Util.colorize(r.name.ljust(width), t: :syscall)}  #{span(r).ljust(7)} -> #{m ? span(m) : '?'}"
+        end
+        out << "\n    ... #{rows.size - shown.size} more" if shown.size < rows.size
+        out
+      end
+
+      def average(rows)
+        format('%.1f', rows.sum(&:max).fdiv([rows.size, 1].max))
+      end
+
+      def span(row)
+        row.min == row.max ? row.min.to_s : "#{row.min} - #{row.max}"
+      end
+    end
+  end
+end
@@ -0,0 +1,103 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/action_cache'
+require 'seccomp-tools/cli/base'
+require 'seccomp-tools/cli/bpf_output'
+require 'seccomp-tools/cost'
+require 'seccomp-tools/cost/profile'
+require 'seccomp-tools/disasm/disasm'
+require 'seccomp-tools/logger'
+require 'seccomp-tools/optimizer'
+
+module SeccompTools
+  module CLI
+    # Handle 'optimize' command.
+    class Optimize < Base
+      include BPFOutput
+
+      # Summary of this command.
+      SUMMARY = 'Rewrite a seccomp filter so the most frequent syscalls are decided first.'
+      # Usage of this command.
+      USAGE = "optimize - #{SUMMARY}\n\nUsage: seccomp-tools optimize BPF_FILE [options]".freeze
+
+      # Define option parser.
+      # @return [OptionParser]
+      #   The parser of this command's options.
+      def parser
+        @parser ||= OptionParser.new do |opt|
+          opt.banner = usage
+          opt.on('-o', '--output FILE', 'Write output to FILE instead of stdout,',
+                 'and report how many instructions the rewrite saves.') do |o|
+            option[:ofile] = o
+          end
+
+          option_bpf_format(opt)
+          option_arch(opt)
+
+          opt.on('--profile FILE', 'How often each syscall is made, to decide the hottest ones first.',
+                 'FILE is the output of `strace -c`, or one "syscall count" pair per line.',
+                 'Default: every syscall is as frequent') do |f|
+            option[:profile] = f
+          end
+        end
+      end
+
+      # Rewrites the filter in BPF_FILE and writes the result in the requested format. When the
+      # rewrite executes no fewer instructions than the original and gets no more syscalls into the
+      # kernel's action cache, the original is written instead, with a warning on stderr so the
+      # filter written to stdout stays valid.
+      # @return [void]
+      # @raise [SystemExit]
+      #   With status 1 when the filter cannot be read or rewritten.
+      def handle
+        return unless super
+
+        option[:ifile] = argv.shift
+        return CLI.show(parser.help) if option[:ifile].nil?
+
+        profile = option[:profile] && SeccompTools::Cost::Profile.parse(File.read(option[:profile]))
+        raw = input
+        res = SeccompTools::Optimizer.new(raw, arch: option[:arch], profile:).optimize
+        before, after = [raw, res].map { |r| average_cost(r, profile) }
+        cached = [raw, res].map { |r| cached_count(r) }
+        if after >= before && cached[1] <= cached[0]
+          Logger.warn('The rewrite is not faster for this profile; the filter is written unchanged.', io: $stderr)
+          res = raw
+          after = before
+          cached[1] = cached[0]
+        end
+        output { format_bpf(res) }
+        report(raw, res, [before, after], cached) if option[:ofile]
+      rescue SeccompTools::OptimizeError, SystemCallError => e
+        Logger.error(e.message)
+        exit(1)
+      end
+
+      private
+
+      # Instructions +raw+ executes per syscall on average over the architectures it handles:
+      # weighted by +profile+ when given, otherwise for the dearest path of each syscall.
+      def average_cost(raw, profile)
+        insts = SeccompTools::Disasm.to_bpf(raw, option[:arch]).map(&:inst)
+        sections = SeccompTools::Cost.new(insts, arch: option[:arch]).cost.sections
+        sections.sum do |s|
+          weighted = profile && s.weighted(profile)
+          weighted ? weighted[1] : s.rows.sum(&:max).fdiv([s.rows.size, 1].max)
+        end.fdiv(sections.size)
+      end
+
+      # How many allowed syscalls of +raw+ the kernel caches, over the architectures it caches.
+      def cached_count(raw)
+        insts = SeccompTools::Disasm.to_bpf(raw, option[:arch]).map(&:inst)
+        SeccompTools::ActionCache.new(insts, arch: option[:arch]).analyze.sections.sum { |s| s.cached.size }
+      end
+
+      def report(raw, res, cost, cached)
+        basis = option[:profile] ? 'weighted by the profile' : 'per syscall'
+        CLI.show(format('%s: %d -> %d instructions, %.1f -> %.1f executed on average %s, ' \
+                        '%d -> %d allowed syscalls cached by the kernel',
+                        option[:ifile], raw.size / 8, res.size / 8, *cost, basis, *cached))
+      end
+    end
+  end
+end
@@ -0,0 +1,52 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/cli/base'
+require 'seccomp-tools/client'
+require 'seccomp-tools/logger'
+require 'seccomp-tools/server'
+
+module SeccompTools
+  module CLI
+    # Handle 'serve' command.
+    class Serve < Base
+      # Summary of this command.
+      SUMMARY = 'Keep the library loaded and run the commands of other invocations.'
+      # Usage of this command.
+      USAGE = "serve - #{SUMMARY}\n\nUsage: seccomp-tools serve [options]".freeze
+
+      # Define option parser.
+      # @return [OptionParser]
+      #   The parser of this command's options.
+      def parser
+        @parser ||= OptionParser.new do |opt|
+          opt.banner = usage
+          opt.separator('    While it runs, seccomp-tools commands run in it instead of starting afresh.')
+
+          opt.on('-s', '--socket PATH', 'Listen on the Unix socket PATH.',
+                 "Default: $#{Client::ENV_SOCKET}, else seccomp-tools-UID.sock in $XDG_RUNTIME_DIR or /tmp.",
+                 "Set #{Client::ENV_SOCKET} to the same PATH for commands to find it.") do |path|
+            option[:socket] = path
+          end
+        end
+      end
+
+      # Serves requests until interrupted.
+      # @return [void]
+      def handle
+        # Unlike other commands, no arguments means to run with the defaults.
+        return unless argv.empty? || super
+
+        warn_ignored_arguments
+        path = option[:socket] || Client.socket_path
+        SeccompTools::Server.new(path).run do
+          CLI.show("Listening on #{path}")
+          $stdout.flush
+        end
+      rescue Errno::EADDRINUSE
+        Logger.error("A server is already listening on #{path}.")
+      rescue SystemCallError => e
+        Logger.error(e.message)
+      end
+    end
+  end
+end
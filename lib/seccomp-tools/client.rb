@@ -0,0 +1,144 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/version'
+
+module SeccompTools
+  # The thin side of +seccomp-tools serve+: hands a command line to a running {Server} instead of
+  # loading the library, which is most of what a short command costs.
+  #
+  # It requires nothing of the library but this file, and +socket+ only once a server's socket is
+  # found, so +bin/seccomp-tools+ can try it first and load the rest only when no server answers.
+  #
+  # A request is the caller's stdin, stdout and stderr, passed over the socket as file descriptors,
+  # followed by frames - each a 4-byte big-endian length and that many bytes - holding the
+  # seccomp-tools version, the working directory, the environment (+NAME=value+ entries, each
+  # ended by a NUL byte) and the arguments, after a frame counting them. The raw BPF a command
+  # reads from stdin thus reaches the server without being copied. The server answers with one
+  # frame: the exit status, +signal N+ when the command was killed by signal +N+, or +refused+ when
+  # it runs another version.
+  #
+  # While the command runs, the client sends the name of each of {SIGNALS} it gets as a frame, for
+  # the server to send on to the command, and dies of the signal that killed the command: Ctrl-C,
+  # Ctrl-Z and +kill+ work as though the command ran in the client. The server kills the command
+  # when the client hangs up.
+  #
+  # The streams are only handed to a socket this user owns, with a server of this user at the
+  # other end: a socket under a shared directory such as +/tmp+ may have been put there by
+  # someone else.
+  module Client
+    # Set this to the server's socket; set it empty to never use a server.
+    ENV_SOCKET = 'SECCOMP_TOOLS_SOCKET'
+    # The signals a client sends on to the command it runs.
+    SIGNALS = %w[INT TERM TSTP CONT].freeze
+
+    module_function
+
+    # Where a server listens unless told otherwise: +$SECCOMP_TOOLS_SOCKET+, or a socket private to
+    # this user under +$XDG_RUNTIME_DIR+ (or +$TMPDIR+, or +/tmp+).
+    # @return [String]
+    def socket_path
+      ENV.fetch(ENV_SOCKET) do
+        File.join(ENV.fetch('XDG_RUNTIME_DIR') { ENV.fetch('TMPDIR', '/tmp') }, "seccomp-tools-#{Process.uid}.sock")
+      end
+    end
+
+    # Runs +argv+ on the server listening at +path+, if there is one running this version.
+    # @param [Array<String>] argv
+    # @param [String] path
+    # @return [Integer?]
+    #   The exit status of the command, or +nil+ when no server took it, so the caller should run
+    #   it itself. When the command was killed by a signal, this process is killed by it too.
+    def forward(argv, path: socket_path)
+      return nil if path.empty? || argv.first == 'serve' || !File.socket?(path)
+
+      require 'socket'
+      return nil unless File.stat(path).uid == Process.uid
+
+      UNIXSocket.open(path) do |sock|
+        next nil unless sock.getpeereid.first == Process.uid
+
+        [$stdin, $stdout, $stderr].each { |io| sock.send_io(io) }
+        write_frames(sock, [VERSION, Dir.pwd, ENV.map { |k, v| "#{k}=#{v}\0" }.join, *argv])
+        result(relay_signals(sock) { read_frame(sock) })
+      end
+    rescue SystemCallError, SocketError
+      nil
+    end
+
+    # The status a server answered with, see {forward}.
+    # @param [String?] status
+    # @return [Integer?]
+    def result(status)
+      # A server that hung up after taking the command may have run some of it; do not run it twice.
+      return 1 if status.nil?
+      return nil if status == 'refused'
+
+      signo = status[/\Asignal (\d+)\z/, 1]
+      return Integer(status) if signo.nil?
+
+      Signal.trap(Integer(signo), 'SYSTEM_DEFAULT')
+      Process.kill(Integer(signo), Process.pid)
+      128 + Integer(signo) # when the signal does not kill
+    end
+
+    # Sends the name of each of {SIGNALS} this process gets to +sock+ until the block returns, stopping
+    # this process too on +TSTP+.
+    # @param [UNIXSocket] sock
+    # @return [Object] What the block returns, +nil+ once the command was taken and the connection
+    #   failed, so that it is not run again.
+    def relay_signals(sock)
+      handlers = SIGNALS.to_h do |sig|
+        [sig, Signal.trap(sig) do
+          write_frame(sock, sig)
+          Process.kill('STOP', Process.pid) if sig == 'TSTP'
+        rescue SystemCallError, IOError
+          nil
+        end]
+      end
+      yield
+    rescue SystemCallError, IOError
+      nil
+    ensure
+      handlers&.each { |sig, handler| Signal.trap(sig, handler) }
+    end
+
+    # The environment a request carries, as a Hash.
+    # @param [String] frame
+    # @return [Hash{String => String}]
+    def read_env(frame)
+      frame.split("\0").to_h { |entry| entry.split('=', 2) }
+    end
+
+    # @param [IO] io
+    # @param [Array<String>] frames
+    # @return [void]
+    def write_frames(io, frames)
+      io.write([frames.size].pack('N'), *frames.flat_map { |f| [[f.bytesize].pack('N'), f] })
+    end
+
+    # @param [IO] io
+    # @return [Array<String>?]
+    #   +nil+ when the peer hung up before sending them all.
+    def read_frames(io)
+      count = io.read(4)&.unpack1('N')
+      frames = count && Array.new(count) { read_frame(io) }
+      frames&.all? ? frames : nil
+    end
+
+    # @param [IO] io
+    # @return [String?]
+    #   +nil+ when the peer hung up first.
+    def read_frame(io)
+      size = io.read(4)&.unpack1('N')
+      data = size && io.read(size)
+      data if data && data.bytesize == size
+    end
+
+    # @param [IO] io
+    # @param [String] frame
+    # @return [void]
+    def write_frame(io, frame)
+      io.write([frame.bytesize].pack('N'), frame)
+    end
+  end
+end
@@ -151,9 +151,66 @@ module SeccompTools
 
     # Define syscall numbers for all architectures.
     # Since the list is too long, split it to files in consts/*.rb and load them in this module.
+    #
+    # Each table is read on first use of its architecture, as the constant named after it (e.g.
+    # +Syscall::AMD64+, name to number), and the reverse lookup is an {Index} built with it.
     module Syscall
+      # Both directions of one architecture's table, built once and frozen: syscall numbers below
+      # {DENSE} index an Array of names, the few above (amd64's x32 aliases) a Hash. Where several
+      # names share a number the one listed last wins, as with +Hash#invert+.
+      class Index
+        # Numbers below this are looked up by position rather than hashed.
+        DENSE = 0x1000
+
+        # @return [{Symbol => Integer}] Syscall name to number.
+        attr_reader :numbers
+
+        # @param [{Symbol => Integer}] numbers
+        def initialize(numbers)
+          @numbers = numbers
+          @names = []
+          @sparse = {}
+          numbers.each { |name, nr| nr < DENSE ? @names[nr] = name : @sparse[nr] = name }
+          [@names, @sparse, self].each(&:freeze)
+        end
+
+        # @param [Integer] nr
+        # @return [Symbol?] The name of syscall +nr+.
+        def name_of(nr)
+          nr.between?(0, DENSE - 1) ? @names[nr] : @sparse[nr]
+        end
+
+        # @param [Symbol] name
+        # @return [Integer?] The number of syscall +name+.
+        def number_of(name)
+          @numbers[name]
+        end
+      end
+
+      @indexes = {}
+      @mutex = Mutex.new
+
       module_function
 
+      # The {Index} of +arch+'s table.
+      # @param [Symbol] arch
+      # @return [Index]
+      # @raise [NameError]
+      #   If no syscall table exists for +arch+.
+      def index(arch)
+        @indexes[arch] || @mutex.synchronize { @indexes[arch] ||= Index.new(const_get(arch.upcase)) }
+      end
+
+      # The name of syscall +nr+ on +arch+.
+      # @param [Symbol] arch
+      # @param [Integer] nr
+      # @return [Symbol?]
+      # @raise [NameError]
+      #   If no syscall table exists for +arch+.
+      def name_of(arch, nr)
+        index(arch).name_of(nr)
+      end
+
       # To dynamically fetch constants from files.
       # @param [Symbol] cons
       #   Name of const, an upcased architecture name such as +:AMD64+.
@@ -176,7 +233,7 @@ module SeccompTools
         filename = File.join(__dir__, 'consts', 'sys_nr', "#{arch}.rb")
         return unless File.exist?(filename)
 
-        const_set(cons, instance_eval(File.read(filename)))
+        const_set(cons, instance_eval(File.read(filename)).freeze)
       end
 
       # Helper for loading syscall prototypes from generated sys_arg.rb.
@@ -195,8 +252,14 @@ module SeccompTools
       end
     end
 
-    # The argument names of all syscalls.
-    SYS_ARG = Syscall.load_args.freeze
+    # Defines {SYS_ARG}, the argument names of all syscalls, on first use.
+    # @param [Symbol] cons
+    # @return [{Symbol => Array<String>}]
+    # @raise [NameError]
+    #   For any other missing constant.
+    def self.const_missing(cons)
+      cons == :SYS_ARG ? const_set(:SYS_ARG, Syscall.load_args.freeze) : super
+    end
 
     # Constants from https://github.com/torvalds/linux/blob/master/include/uapi/linux/audit.h.
     module Audit
@@ -0,0 +1,48 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/audit/policy'
+require 'seccomp-tools/cost/report'
+require 'seccomp-tools/cost/section'
+require 'seccomp-tools/explain/analysis'
+require 'seccomp-tools/symbolic/executor'
+
+module SeccompTools
+  # Measures what a seccomp filter costs each syscall: the kernel runs the filter on every syscall
+  # entry, one instruction at a time, so a syscall pays for every instruction on its path to a
+  # +return+ - and for every stacked filter.
+  #
+  # It runs the generic {Symbolic::Executor} over the filter (the same walk {Explain} and {Audit}
+  # use), which counts the instructions of each path ({Symbolic::Executor::Leaf#steps}), splits the
+  # leaves per architecture with {Explain::Analysis}, and asks each architecture's {Audit::Policy}
+  # which leaves every syscall can reach. The cheapest and the dearest of those are the syscall's
+  # minimum and maximum cost; they differ when the filter inspects arguments.
+  #
+  # @example
+  #   insts = SeccompTools::Disasm.to_bpf(raw, :amd64).map(&:inst)
+  #   puts SeccompTools::Cost.new(insts, arch: :amd64, source: 'a.out').cost
+  class Cost
+    # @param [Array<Instruction::Base>] instructions
+    #   The filter, as +SeccompTools::Disasm.to_bpf(raw, arch).map(&:inst)+.
+    # @param [Symbol] arch
+    #   The architecture the filter is written for, used when it does not itself branch on +arch+.
+    # @param [String?] source
+    #   A label for the filter (e.g. a filename) shown in the report.
+    def initialize(instructions, arch:, source: nil)
+      @instructions = instructions
+      @arch = arch
+      @source = source
+    end
+
+    # Walks the filter and returns the cost of every syscall on every architecture it handles.
+    # @param [{Symbol => Integer}?] profile
+    #   Call counts by syscall name (see {Cost::Profile}), to also report the average cost weighted
+    #   by how often each syscall is made.
+    # @return [Report]
+    def cost(profile: nil)
+      leaves, truncated = Symbolic::Executor.new(@instructions).run
+      analysis = Explain::Analysis.new(leaves)
+      sections = analysis.sections(@arch).map { |section| Section.of(Audit::Policy.new(analysis, section)) }
+      Report.new(source: @source, sections:, truncated:, profile:)
+    end
+  end
+end
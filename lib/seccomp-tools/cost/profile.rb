@@ -0,0 +1,33 @@
+# frozen_string_literal: true
+
+module SeccompTools
+  class Cost
+    # Reads a syscall frequency profile: how often a workload makes each syscall.
+    module Profile
+      # A row of the +strace -c+ table: +% time, seconds, usecs/call, calls, [errors,] syscall+.
+      STRACE_ROW = /\A\s*[\d.]+\s+[\d.]+\s+\d+\s+(?<calls>\d+)\s+(?:\d+\s+)?(?<name>\w+)\s*\z/
+      # A +name count+ line.
+      PLAIN_ROW = /\A\s*(?<name>\w+)[\s:=,]+(?<calls>\d+)\s*\z/
+
+      module_function
+
+      # Parses a profile, either +strace -c+ output or one +syscall count+ pair per line. Blank lines,
+      # +#+ comments and anything else unrecognized (e.g. the strace table's header and totals) are
+      # skipped; a syscall listed twice adds up.
+      # @param [String] text
+      # @return [{Symbol => Integer}]
+      #   Call counts by syscall name.
+      # @example
+      #   Profile.parse("futex 1200\nread 300\n")
+      #   #=> { futex: 1200, read: 300 }
+      def parse(text)
+        text.each_line.with_object(Hash.new(0)) do |line, counts|
+          m = STRACE_ROW.match(line) || PLAIN_ROW.match(line.sub(/#.*/, ''))
+          next if m.nil? || m[:name] == 'total'
+
+          counts[m[:name].to_sym] += Integer(m[:calls], 10)
+        end
+      end
+    end
+  end
+end
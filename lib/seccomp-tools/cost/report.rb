@@ -0,0 +1,104 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/util'
+
+module SeccompTools
+  class Cost
+    # The per-syscall cost of one filter (or of several stacked ones), rendered either as a human
+    # report or a JSON-ready hash.
+    class Report
+      # @return [Array<Section>]
+      attr_reader :sections
+
+      # @param [String?] source Label for the measured filter.
+      # @param [Array<Section>] sections One per architecture.
+      # @param [Boolean] truncated Whether the symbolic walk was cut short.
+      # @param [{Symbol => Integer}?] profile Call counts by syscall name, see {Section#weighted}.
+      def initialize(source:, sections:, truncated:, profile: nil)
+        @source = source
+        @sections = sections
+        @truncated = truncated
+        @profile = profile
+      end
+
+      # The cost of running every one of +reports+' filters, i.e. of them stacked: per architecture
+      # all the reports measure, the sum of their costs for each syscall (see {Section#+}).
+      # @param [Array<Report>] reports
+      # @param [String?] source
+      # @return [Report]
+      def self.stack(reports, source: nil)
+        arches = reports.map { |r| r.sections.map(&:arch) }.reduce(:&)
+        sections = arches.map do |arch|
+          reports.map { |r| r.sections.find { |s| s.arch == arch } }.reduce(:+)
+        end
+        new(source:, sections:, truncated: reports.any?(&:truncated?), profile: reports.first&.profile)
+      end
+
+      # @return [Boolean] Whether the symbolic walk was cut short, so costs may be missing.
+      def truncated?
+        @truncated
+      end
+
+      # @return [{Symbol => Integer}?]
+      attr_reader :profile
+
+      # The human report.
+      # @param [Integer?] top
+      #   List only the +top+ dearest syscalls of each architecture; all of them when +nil+.
+      # @return [String]
+      def to_s(top: nil)
+        out = +''
+        out << "Syscall cost of #{@source}\n" if @source
+        out << "Instructions executed from entering the filter to its return; a range spans paths that\n" \
+               "differ by arguments.\n"
+        out << "WARNING: analysis truncated (filter too large); results may be incomplete.\n" if @truncated
+        @sections.each { |section| out << "\n" << render(section, top) }
+        out
+      end
+
+      # @return [Hash] JSON-ready shape for one filter.
+      def to_h
+        {
+          source: @source,
+          truncated: @truncated,
+          arches: @sections.map do |s|
+            h = { arch: s.arch, syscalls: s.rows.map { |r| { name: r.name, number: r.nr, min: r.min, max: r.max } } }
+            weighted = @profile && s.weighted(@profile)
+            h[:profile] = { calls: weighted[2], min: weighted[0], max: weighted[1] } if weighted
+            h
+          end
+        }
+      end
+
+      private
+
+      def render(section, top)
+        out = "Architecture: #{Util.colorize(section.arch, t: :arch)}\n"
+        rows = section.rows
+        return out << "\n  (no return reached; filter runs off the end)\n" if rows.empty?
+
+        means = [rows.sum(&:min).fdiv(rows.size), rows.sum(&:max).fdiv(rows.size)]
+        out << "  #{rows.size} syscall#{'s' if rows.size > 1}: #{span(rows.map(&:min).min, rows.map(&:max).max)}" \
+               " instructions, #{span(*means)} on average\n"
+        weighted = @profile && section.weighted(@profile)
+        if weighted
+          out << "  Weighted by the profile (#{weighted[2]} calls): #{span(weighted[0], weighted[1])} per syscall\n"
+        end
+        shown = top ? rows.first(top) : rows
+        width = shown.map { |r| r.name.size }.max
+        out << "\n"
+        shown.each do |r|
+          out << "    #{Util.colorize(r.name.ljust(width), t: :syscall)}  #{span(r.min, r.max)}\n"
+        end
+        out << "    ... #{rows.size - shown.size} more\n" if shown.size < rows.size
+        out
+      end
+
+      # +"4"+, or +"4 - 7"+ when the ends differ; averages get one decimal.
+      def span(min, max)
+        fmt = ->(v) { v.is_a?(Float) ? format('%.1f', v) : v.to_s }
+        fmt[min] == fmt[max] ? fmt[min] : "#{fmt[min]} - #{fmt[max]}"
+      end
+    end
+  end
+end
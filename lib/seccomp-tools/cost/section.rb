@@ -0,0 +1,77 @@
+# frozen_string_literal: true
+
+module SeccompTools
+  class Cost
+    # The cost of every syscall on one architecture of a filter.
+    class Section
+      # One syscall's cost, in instructions executed: the cheapest and the dearest path it can take.
+      Row = Struct.new(:name, :nr, :min, :max)
+
+      # Label of the only row of a section whose architecture is unknown, so has no syscall names.
+      ANY = '<any syscall>'
+
+      # @return [String] The architecture, as {Audit::Policy#arch_name}.
+      attr_reader :arch
+      # @return [Array<Row>] Sorted dearest first.
+      attr_reader :rows
+
+      # Measures every syscall of +policy+'s architecture. An architecture without a syscall table
+      # gets a single {ANY} row spanning all its paths.
+      # @param [Audit::Policy] policy
+      # @return [Section]
+      def self.of(policy)
+        rows = if policy.table
+                 policy.table.filter_map do |name, nr|
+                   steps = policy.reachable_leaves(nr).flat_map { |l| [l.steps, l.max_steps] }
+                   Row.new(name.to_s, nr, *steps.minmax) unless steps.empty?
+                 end
+               else
+                 steps = policy.leaves.flat_map { |l| [l.steps, l.max_steps] }
+                 steps.empty? ? [] : [Row.new(ANY, nil, *steps.minmax)]
+               end
+        new(policy.arch_name, rows)
+      end
+
+      # @param [String] arch
+      # @param [Array<Row>] rows
+      def initialize(arch, rows)
+        @arch = arch
+        @rows = rows.sort_by { |r| [-r.max, -r.min, r.name] }
+      end
+
+      # The average cost per call, over the syscalls of +profile+ this architecture has.
+      # @param [{Symbol => Integer}] profile
+      #   Call counts by syscall name.
+      # @return [Array(Float, Float, Integer)?]
+      #   The weighted average of the minimum and of the maximum costs, and the number of calls they
+      #   average; +nil+ when no call of +profile+ is a syscall of this architecture.
+      def weighted(profile)
+        by_name = rows.to_h { |r| [r.name.to_sym, r] }
+        calls = min = max = 0
+        profile.each do |name, count|
+          row = by_name[name]
+          next if row.nil?
+
+          calls += count
+          min += row.min * count
+          max += row.max * count
+        end
+        calls.zero? ? nil : [min.fdiv(calls), max.fdiv(calls), calls]
+      end
+
+      # This section's cost plus +other+'s, for syscalls both measure: what a syscall pays when both
+      # filters are installed, since the kernel runs every stacked filter.
+      # @param [Section] other
+      #   A section of the same architecture.
+      # @return [Section]
+      def +(other)
+        theirs = other.rows.to_h { |r| [r.name, r] }
+        rows = @rows.filter_map do |r|
+          o = theirs[r.name]
+          o && Row.new(r.name, r.nr, r.min + o.min, r.max + o.max)
+        end
+        Section.new(arch, rows)
+      end
+    end
+  end
+end
@@ -3,6 +3,7 @@
 require 'set'
 
 require 'seccomp-tools/bpf'
+require 'seccomp-tools/disasm/program'
 require 'seccomp-tools/symbolic/constraint'
 require 'seccomp-tools/symbolic/state'
 require 'seccomp-tools/util'
@@ -31,31 +32,116 @@ module SeccompTools
     #   SeccompTools::Disasm.disasm(raw, arch: :amd64, display_bpf: false)
     #   #=> "0000: A = sys_number\n0001: if (A == read) goto 0003\n0002: return KILL\n0003: return ALLOW\n"
     def disasm(raw, arch: nil, display_bpf: true, arg_infer: true)
-      codes = to_bpf(raw, arch)
-      states = Array.new(codes.size) { Set.new }
-      states[0].add(Symbolic::State.initial)
-      # A forward pass (jumps only go forward) tracking, per line, the states that can reach it, so
-      # syscall names and argument positions can be inferred from what each register holds. Unlike
-      # the Executor, this over-approximates - it forks every conditional instead of folding - so
-      # dead lines are still rendered.
-      dis = codes.zip(states).map do |code, sts|
+      each_line(raw, arch:, display_bpf:, arg_infer:).with_object(+'') { |line, out| out << line }
+    end
+
+    # Writes the disassembly of +raw+ to +io+ line by line, as {.each_line} produces it, so nothing
+    # but the line being written is held.
+    # @param [IO, #write] io
+    # @param [String] raw
+    #   The raw BPF bytes.
+    # @param options
+    #   The keyword arguments of {.disasm}.
+    # @return [void]
+    # @example
+    #   SeccompTools::Disasm.write($stdout, raw, arch: :amd64)
+    def write(io, raw, **options)
+      each_line(raw, **options) { |line| io.write(line) }
+    end
+
+    # Yields the lines of {.disasm}, each with its newline, as soon as it is final: jumps only go
+    # forward, so a line's states are settled once every line before it has run, and it is rendered
+    # then. A line's {BPF} and states are dropped once it is yielded; only the states waiting on
+    # lines still ahead are kept.
+    # @param [String] raw
+    #   The raw BPF bytes.
+    # @param [Symbol?] arch
+    #   See {.disasm}.
+    # @param [Boolean] display_bpf
+    #   See {.disasm}.
+    # @param [Boolean] arg_infer
+    #   See {.disasm}.
+    # @yieldparam [String] line
+    # @return [void, Enumerator]
+    #   An Enumerator of the lines when no block is given.
+    def each_line(raw, arch: nil, display_bpf: true, arg_infer: true)
+      return enum_for(__method__, raw, arch:, display_bpf:, arg_infer:) unless block_given?
+
+      yield " line  CODE  JT   JF      K\n=================================\n" if display_bpf
+      codes = decode(raw, arch)
+      # An empty filter is shown as one empty line, as it always has been.
+      yield "\n" if codes.size.zero?
+      settle(codes) { |code| yield "#{code.disasm(code: display_bpf, arg_infer:)}\n" }
+    end
+
+    # Machine states kept apart on one line by {.track}; past this many they are joined into one.
+    WIDEN = 16
+
+    # Sets the +states+ of each instruction to the {Symbolic::State}s that can reach it.
+    #
+    # A forward pass (jumps only go forward) tracking, per line, what A, X and the scratch memory may
+    # hold, so syscall names and argument positions can be inferred from the registers. Unlike the
+    # Executor, this over-approximates - it forks every conditional instead of folding - so dead
+    # lines are still rendered, with no state.
+    #
+    # It is insensitive to paths: the states meeting on a line with the same registers and memory
+    # are one, keeping only the facts (data words pinned by +==+) all of them share, and more than
+    # {WIDEN} states on a line are joined into one holding a value only where all of them agree,
+    # {Symbolic::Expr.opaque} elsewhere. So a line keeps at most {WIDEN} states, and the pass is
+    # linear in the lines however many paths join.
+    # @param [Array<BPF>] codes
+    #   The instructions of one filter, in order.
+    # @return [Array<BPF>]
+    #   +codes+ itself.
+    def track(codes)
+      settle(codes) { |_code| nil }
+      codes
+    end
+
+    # Runs the pass of {.track} over +codes+, yielding each instruction as soon as its +states+ are
+    # set. The states of lines ahead are kept until their line is reached.
+    # @param [Enumerable<BPF>] codes
+    # @yieldparam [BPF] code
+    # @return [void]
+    def settle(codes)
+      pending = { 0 => {} }
+      join(pending[0], Symbolic::State.initial)
+      codes.each_with_index do |code, i|
+        sts = (pending.delete(i) || {}).values
         sts.each do |st|
           code.branch(st) do |pc, s|
-            states[pc].add(s) unless pc >= states.size
+            join(pending[pc] ||= {}, s) unless pc >= codes.size
           end
         end
-        code.states = sts
-        code.disasm(code: display_bpf, arg_infer:)
-      end.join("\n")
-      if display_bpf
-        <<-EOS
- line  CODE  JT   JF      K
-=================================
-#{dis}
-        EOS
-      else
-        "#{dis}\n"
+        code.states = Set.new(sts)
+        yield code
+      end
+    end
+
+    # Adds +state+ to the states of a line, by their machine key.
+    def join(line, state)
+      key = state.machine_key
+      old = line[key]
+      line[key] = old ? merge([old, state]) : state
+      return if line.size <= WIDEN
+
+      merged = merge(line.values)
+      line.clear
+      line[merged.machine_key] = merged
+    end
+
+    # The one state holding what +states+ agree on: each register and memory slot where they all hold
+    # the same value, and the facts on all their paths.
+    def merge(states)
+      first, *rest = states
+      agreed = lambda do |&part|
+        value = part.call(first)
+        rest.all? { |st| part.call(st).equal?(value) } ? value : Symbolic::Expr.opaque
       end
+      paths = rest.map { |st| st.path.to_a }
+      path = first.path.select { |c| paths.all? { |cs| cs.include?(c) } }
+      Symbolic::State.new(a: agreed.call(&:a), x: agreed.call(&:x),
+                          mem: Array.new(first.mem.size) { |i| agreed.call { |st| st.mem[i] } }, path:)
     end
 
     # Convert raw BPF string to array of {BPF}.
@@ -66,8 +152,17 @@ module SeccompTools
     # @return [Array<BPF>]
     #   One {BPF} per instruction, in order.
     def to_bpf(raw, arch)
-      arch ||= Util.system_arch
-      raw.scan(/.{8}/m).map.with_index { |b, i| BPF.new(b, arch, i) }
+      decode(raw, arch).to_a
+    end
+
+    # Decodes raw BPF into a {Program}, whose {BPF}s are only built for the lines used.
+    # @param [String] raw
+    #   The raw BPF bytes, each instruction being 8 bytes long.
+    # @param [Symbol?] arch
+    #   Target architecture, defaults to {SeccompTools::Util.system_arch} when +nil+.
+    # @return [Program]
+    def decode(raw, arch)
+      Program.new(raw, arch || Util.system_arch)
     end
   end
 end
@@ -0,0 +1,196 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/bpf'
+require 'seccomp-tools/const'
+
+module SeccompTools
+  module Disasm
+    # A filter decoded from raw bytes, held as four columns - the +code+, +jt+, +jf+ and +k+ of every
+    # instruction - rather than as objects.
+    #
+    # Decoding is one pass over the bytes, natively by +Program::Native+ (+ext/decoder/decoder.c+)
+    # when the C extension is built, and allocates nothing per instruction. The {BPF} of a line, and
+    # its instruction, are only built when the line is asked for, so what needs the fields alone, or a
+    # few lines, never pays for the rest.
+    #
+    # @example
+    #   prog = SeccompTools::Disasm::Program.new(raw, :amd64)
+    #   prog.codes.count(0x06) #=> number of 'return k'
+    #   prog[3].decompile #=> "if (A != execve) goto 0007"
+    class Program
+      include Enumerable
+
+      # The most instructions a filter may have, +BPF_MAXINSNS+.
+      MAX_INSNS = 4096
+      # Scratch memory slots, +BPF_MEMWORDS+.
+      MEMWORDS = 16
+      # The size of +struct seccomp_data+, which absolute loads must stay within.
+      DATA_SIZE = 64
+      # Opcodes of conditional jumps.
+      JUMPS = [0x15, 0x1d, 0x25, 0x2d, 0x35, 0x3d, 0x45, 0x4d].freeze
+      # Every other opcode seccomp allows, none of which has constraints on its operands.
+      ALLOWED = [0x80, 0x81, 0x06, 0x16, 0x04, 0x0c, 0x14, 0x1c, 0x24, 0x2c, 0x3c, 0x44, 0x4c, 0x54, 0x5c,
+                 0x6c, 0x7c, 0x84, 0xa4, 0xac, 0x00, 0x01, 0x07, 0x87].freeze
+      private_constant :JUMPS, :ALLOWED
+
+      # @return [Symbol] Architecture.
+      attr_reader :arch
+      # @return [Array<Integer>] The +code+ of every instruction.
+      attr_reader :codes
+      # @return [Array<Integer>] The +jt+ of every instruction.
+      attr_reader :jts
+      # @return [Array<Integer>] The +jf+ of every instruction.
+      attr_reader :jfs
+      # @return [Array<Integer>] The +k+ of every instruction.
+      attr_reader :ks
+
+      # @param [String] raw
+      #   The raw BPF bytes, each instruction being 8 bytes long; trailing bytes short of an
+      #   instruction are ignored.
+      # @param [Symbol] arch
+      #   Architecture, which gives the byte order.
+      def initialize(raw, arch)
+        @raw = raw
+        @arch = arch
+        @big_endian = Const::Endian.big?(arch)
+        @codes, @jts, @jfs, @ks = self.class.native? ? Native.decode(raw, @big_endian) : decode_in_ruby
+        @bpfs = []
+      end
+
+      # Whether decoding and {#check} are native, i.e. the C extension is built.
+      # @return [Boolean]
+      def self.native?
+        const_defined?(:Native, false)
+      end
+
+      # @return [Integer] Number of instructions.
+      def size
+        @codes.size
+      end
+
+      # The instruction on +line+, built on first use.
+      # @param [Integer] line
+      # @return [BPF?]
+      def [](line)
+        return nil unless line.between?(0, size - 1)
+
+        @bpfs[line] ||= build(line)
+      end
+
+      # Yields the {BPF} of every line, in order. Lines not built before are built for the call and
+      # not kept, so a pass over a large filter holds one line at a time.
+      # @yieldparam [BPF] bpf
+      # @return [self, Enumerator]
+      def each
+        return to_enum(__method__) { size } unless block_given?
+
+        size.times { |i| yield @bpfs[i] || build(i) }
+        self
+      end
+
+      # Why the kernel would refuse to install this filter, by the rules of +bpf_check_classic+ and
+      # +seccomp_check_filter+: the opcodes seccomp allows, jumps within the filter, scratch memory
+      # slots in range and written before read on every path, loads within +seccomp_data+, no
+      # division by a zero constant, and a return last.
+      # @return [Array(Integer?, String)?]
+      #   +nil+ when the filter is valid, else the first offending line (+nil+ when the filter as a
+      #   whole is at fault, i.e. empty or too long) and the reason.
+      # @example
+      #   Program.new([0x20, 0x40].pack('S<x2L<'), :amd64).check
+      #   #=> [0, "invalid seccomp_data offset"]
+      def check
+        self.class.native? ? Native.check(@raw, @big_endian) : check_in_ruby
+      end
+
+      # Whether the kernel would install this filter, see {#check}.
+      # @return [Boolean]
+      def valid?
+        check.nil?
+      end
+
+      # The scratch memory slots the kernel's +check_load_and_stores+ takes as written when each line
+      # runs: those written before it on every jump to it and, unless the line before is a jump, on
+      # the way through that line - a +return+ does not clear them. Jumps must be in range.
+      # @return [Array<Integer>]
+      #   A mask per line, bit +i+ set when +mem[i]+ is.
+      def mem_valid
+        masks = Array.new(size, 0xffff)
+        valid = 0
+        Array.new(size) do |pc|
+          valid &= masks[pc]
+          at = valid
+          k = @ks[pc]
+          case @codes[pc]
+          when 0x02, 0x03 then valid |= 1 << k
+          when 0x05
+            masks[pc + 1 + k] &= valid
+            valid = 0xffff
+          when *JUMPS
+            masks[pc + 1 + @jts[pc]] &= valid
+            masks[pc + 1 + @jfs[pc]] &= valid
+            valid = 0xffff
+          end
+          at
+        end
+      end
+
+      private
+
+      def build(line)
+        BPF.new({ code: @codes[line], jt: @jts[line], jf: @jfs[line], k: @ks[line] }, @arch, line)
+      end
+
+      def decode_in_ruby
+        e = @big_endian ? '>' : '<'
+        fields = @raw.unpack("S#{e}CCL#{e}" * size_of_raw)
+        Array.new(4) { |c| Array.new(size_of_raw) { |i| fields[(4 * i) + c] } }
+      end
+
+      def size_of_raw
+        @raw.bytesize / 8
+      end
+
+      def check_in_ruby
+        return [nil, 'empty filter'] if size.zero?
+        return [nil, 'too many instructions'] if size > MAX_INSNS
+
+        size.times do |pc|
+          reason = check_insn(pc)
+          return [pc, reason] if reason
+        end
+        return [size - 1, 'last instruction is not a return'] unless [0x06, 0x16].include?(@codes.last)
+
+        line = check_memory
+        line && [line, 'scratch memory read before written']
+      end
+
+      # Why the instruction on +pc+ cannot be installed, +nil+ when it can.
+      def check_insn(pc)
+        k = @ks[pc]
+        case @codes[pc]
+        when 0x20 then 'invalid seccomp_data offset' if k >= DATA_SIZE || k & 3 != 0
+        when 0x34 then 'division by zero' if k.zero?
+        when 0x64, 0x74 then 'shift out of range' if k >= 32
+        when 0x60, 0x61, 0x02, 0x03 then 'scratch memory index out of range' if k >= MEMWORDS
+        when 0x05 then 'jump out of range' if k >= size - pc - 1
+        when *JUMPS then 'jump out of range' if pc + [@jts[pc], @jfs[pc]].max + 1 >= size
+        when *ALLOWED then nil
+        else 'invalid opcode'
+        end
+      end
+
+      # The kernel's +check_load_and_stores+: the first line reading a scratch memory slot that some
+      # path to it has not written, or +nil+. Jumps are known to be in range.
+      def check_memory
+        valid = mem_valid
+        size.times.find { |pc| [0x60, 0x61].include?(@codes[pc]) && valid[pc][@ks[pc]].zero? }
+      end
+    end
+  end
+end
+
+begin
+  require 'seccomp-tools/decoder'
+rescue LoadError
+  # Not compiled: {SeccompTools::Disasm::Program} decodes and checks in Ruby.
+end
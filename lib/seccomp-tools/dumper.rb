@@ -1,7 +1,8 @@
 # frozen_string_literal: true
 
-require 'timeout'
+require 'etc'
 
+require 'seccomp-tools/const'
 require 'seccomp-tools/logger'
 require 'seccomp-tools/util'
 require 'seccomp-tools/ptrace' if SeccompTools::Util.linux?
@@ -30,6 +31,12 @@ module SeccompTools
     # @param [Float?] timeout
     #   Number of seconds to wait for the target process. When the timeout is reached, the target
     #   process is killed and the filters dumped so far are returned. +nil+ for no timeout.
+    # @param [Boolean] trap
+    #   Install a filter returning +TRACE+ for the seccomp installations (see {Syscall.trap_bpf}) before
+    #   executing the target, so it is stopped only at those instead of at every syscall. Much faster
+    #   on syscall-heavy targets, but the extra filter is visible to the target, and +no_new_privs+ is
+    #   set when not running with +CAP_SYS_ADMIN+. A strict-mode installation fails under the extra
+    #   filter; it is still dumped, but the target proceeds with the failure.
     # @yieldparam [String] bpf
     #   Seccomp bpf in raw bytes.
     # @yieldparam [Symbol?] arch
@@ -43,25 +50,42 @@ module SeccompTools
     #   #=> []
     #   dump('spec/binary/twctf-2016-diary') { |c| c[0, 10] }
     #   #=> [" \x00\x00\x00\x00\x00\x00\x00\x15\x00"]
-    def dump(*args, limit: 1, timeout: nil, &block)
+    def dump(*args, limit: 1, timeout: nil, trap: false, &block)
       return [] unless SUPPORTED
 
-      pid = fork { handle_child(*args) }
-      Handler.new(pid).handle(limit, timeout: timeout, &block)
+      pid = fork { handle_child(*args, trap:) }
+      Handler.new(pid, trap:).handle(limit, timeout: timeout, &block)
     end
 
     # Traces a forked child, single-stepping it through its syscalls and capturing the seccomp
     # filters it installs.
+    #
+    # In trap mode the child runs freely with +PTRACE_CONT+ and stops only at the +TRACE+ returns of
+    # {Syscall.trap_bpf}; each is then stepped with +PTRACE_SYSCALL+ to its exit, to see whether
+    # the installation succeeded.
+    #
+    # The tracing loop runs natively without the GVL ({Ptrace.trace}) when the kernel supports
+    # +PTRACE_GET_SYSCALL_INFO+, and in Ruby otherwise.
     class Handler
+      # The installation syscalls of each architecture, in the form {Ptrace.trace} takes:
+      # +[audit_arch, SYS_prctl, SYS_seccomp, pointer_size]+.
+      NATIVE_ABIS = Syscall::ABI.map do |arch, abi|
+        [Const::Audit::ARCH[Const::Audit::ARCH_NAME[arch]], abi[:SYS_prctl], abi[:SYS_seccomp], abi[:bits] / 8]
+      end.freeze
+
       # Instantiate a {Handler} object.
       # @param [Integer] pid
       #   The process id after fork.
-      def initialize(pid)
-        @pids = [pid]
+      # @param [Boolean] trap
+      #   Whether the child installed {Syscall.trap_bpf}. See {Dumper.dump}.
+      def initialize(pid, trap: false)
+        @pid = pid
+        @trap = trap
+        @tracees = { pid => nil } # tid => the syscall it is in, if any
         Process.waitpid(pid)
         opt = Ptrace::O_TRACESYSGOOD | Ptrace::O_TRACECLONE | Ptrace::O_TRACEFORK | Ptrace::O_TRACEVFORK
+        opt |= Ptrace::O_TRACESECCOMP if trap
         Ptrace.setoptions(pid, 0, opt)
-        Ptrace.syscall(pid, 0, 0)
       end
 
       # Tracer.
@@ -69,7 +93,8 @@ module SeccompTools
       # @param [Integer] limit
       #   Child will be killed when number of calling +prctl(SET_SECCOMP)+ reaches +limit+.
       # @param [Float?] timeout
-      #   Kill the child processes when +timeout+ seconds have elapsed. +nil+ for no timeout.
+      #   Kill the child processes when +timeout+ seconds have elapsed. +nil+ for no timeout. The
+      #   deadline is kept natively, by a timer interrupting the blocking wait (see {Ptrace.wait}).
       # @yieldparam [String] bpf
       #   Seccomp bpf in raw bytes.
       # @yieldparam [Symbol] arch
@@ -79,60 +104,135 @@ module SeccompTools
       #   the raw bytes.
       def handle(limit, timeout: nil, &block)
         collect = []
-        syscalls = {} # record last syscall
-        begin
-          Timeout.timeout(timeout) do
-            loop while wait_syscall do |child|
-              if syscalls[child].nil? # invoke syscall
-                syscalls[child] = syscall(child)
-                next true
-              end
-              # syscall finished
-              sys = syscalls[child]
-              syscalls[child] = nil
-              if sys.set_seccomp? && syscall(child).ret.zero? # consider successful call only
-                bpf = sys.dump_bpf
-                collect << (block.nil? ? bpf : yield(bpf, sys.arch))
-                limit -= 1
-              end
-              !limit.zero?
-            end
-          end
-        rescue Timeout::Error
-          # keep the filters dumped so far; fall through to kill the children
+        dumped = lambda do |bpf, arch|
+          collect << (block.nil? ? bpf : yield(bpf, arch))
+          limit -= 1
+          !limit.zero?
         end
-        @pids.each { |cpid| Process.kill('KILL', cpid) if alive?(cpid) }
+        deadline = timeout && (Process.clock_gettime(Process::CLOCK_MONOTONIC) + timeout)
+        # on timeout, keep the filters dumped so far and kill the children
+        trace_natively(deadline, &dumped) || trace(deadline, &dumped)
+        @tracees.each_key { |tid| Process.kill('KILL', tid) if alive?(tid) }
         Process.waitall
         collect
       end
 
       private
 
-      # Waits until a traced child enters or leaves a syscall, then resumes it.
+      # Traces the children with the native engine, {Ptrace.trace}, which runs the wait/resume loop
+      # without the GVL and returns to Ruby only when a filter has been installed.
+      #
+      # @param [Float?] deadline
+      #   When to stop tracing, a +CLOCK_MONOTONIC+ time. +nil+ for never.
+      # @yieldparam [String] bpf
+      #   Seccomp bpf in raw bytes.
+      # @yieldparam [Symbol?] arch
+      #   Architecture of the installing process.
+      # @yieldreturn [Boolean]
+      #   Whether tracing should continue.
+      # @return [Boolean]
+      #   +false+ when the kernel lacks +PTRACE_GET_SYSCALL_INFO+ (Linux < 5.3), in which case
+      #   nothing was traced; see {#trace}.
+      def trace_natively(deadline)
+        Ptrace.trace(@pid, @tracees, NATIVE_ABIS, @trap, deadline) do |tid, bpf, audit|
+          arch = Const::Audit.arch_symbol(audit) || Util.process_arch(tid)
+          yield(bpf || Syscall.strict_bpf(arch), arch)
+        end
+      end
+
+      # Traces the children in Ruby, decoding every syscall stop with {Syscall}. The fallback of
+      # {#trace_natively}.
       #
+      # @param [Float?] deadline
+      #   When to stop tracing, a +CLOCK_MONOTONIC+ time. +nil+ for never.
+      # @yieldparam [String] bpf
+      #   Seccomp bpf in raw bytes.
+      # @yieldparam [Symbol?] arch
+      #   Architecture of the installing process.
+      # @yieldreturn [Boolean]
+      #   Whether tracing should continue.
+      # @return [void]
+      def trace(deadline)
+        resume(@pid)
+        loop while wait_syscall(deadline) do |child|
+          if @tracees[child].nil? # invoke syscall
+            @tracees[child] = syscall(child)
+            next true
+          end
+          # syscall finished
+          sys = @tracees[child]
+          @tracees[child] = nil
+          next true unless installed?(sys, child)
+
+          yield(sys.dump_bpf, sys.arch)
+        end
+      end
+
+      # Waits until a traced child enters or leaves a syscall, then resumes it. In trap mode a
+      # +PTRACE_EVENT_SECCOMP+ stop is the entry.
+      #
+      # @param [Float?] deadline
+      #   When to give up waiting, a +CLOCK_MONOTONIC+ time. +nil+ for never.
       # @yieldparam [Integer] pid
       #   Id of the child that stopped.
       # @yieldreturn [Boolean]
       #   Whether tracing should continue.
       # @return [Boolean]
       #   +true+ for continue,
-      #   +false+ for break. Also +false+ once no children are left.
-      def wait_syscall
-        child, status = Process.wait2
-        @pids << child unless @pids.include?(child)
+      #   +false+ for break. Also +false+ once no children are left or the deadline passed.
+      def wait_syscall(deadline)
+        child, status = Ptrace.wait(deadline)
+        return false if child.nil?
+
+        @tracees[child] = nil unless @tracees.key?(child)
+        stopped = status & 0xff == 0x7f
+        event = status >> 16
         cont = true
-        if [Ptrace::EVENT_CLONE, Ptrace::EVENT_FORK, Ptrace::EVENT_VFORK].include?(status.to_i >> 16)
+        if [Ptrace::EVENT_CLONE, Ptrace::EVENT_FORK, Ptrace::EVENT_VFORK].include?(event)
           # New child launched!
           # newpid = SeccompTools::Ptrace.geteventmsg(child)
-        elsif status.stopped? && status.stopsig & 0x80 != 0
+        elsif event == Ptrace::EVENT_SECCOMP || (stopped && (status >> 8).anybits?(0x80))
           cont = yield(child)
         end
-        Ptrace.syscall(child, 0, 0) unless status.exited?
+        resume(child) if stopped
         cont
       rescue Errno::ECHILD
         false
       end
 
+      # Resumes a stopped child: to its next syscall stop, or in trap mode to its next seccomp stop
+      # unless it is inside a trapped syscall, whose exit must be seen.
+      #
+      # @param [Integer] pid
+      #   Id of the stopped child.
+      # @return [void]
+      def resume(pid)
+        if @trap && @tracees[pid].nil?
+          Ptrace.cont(pid, 0, 0)
+        else
+          Ptrace.syscall(pid, 0, 0)
+        end
+      end
+
+      # Did the finished syscall +sys+ install a filter? Only successful calls count, except that in
+      # trap mode the kernel refuses strict mode once a filter - here {Syscall.trap_bpf} - is
+      # installed, so it can never succeed: there a strict-mode call with valid arguments (see
+      # {Syscall#strict_args_valid?}) failing with +EINVAL+, the mode conflict, counts as installed.
+      #
+      # @param [SeccompTools::Syscall] sys
+      #   The syscall recorded at its entry.
+      # @param [Integer] pid
+      #   Id of the child, stopped at the exit of +sys+.
+      # @return [Boolean]
+      def installed?(sys, pid)
+        return false unless sys.set_seccomp?
+
+        ret = syscall(pid).ret
+        return ret.zero? unless @trap && sys.strict_mode?
+
+        sys.strict_args_valid? && ret == -Errno::EINVAL::Errno
+      end
+
       # Reads the syscall the stopped child is currently invoking.
       #
       # @param [Integer] pid
@@ -158,8 +258,9 @@ module SeccompTools
     class << self
       private
 
-      def handle_child(*args)
+      def handle_child(*args, trap: false)
         Ptrace.traceme_and_stop
+        Ptrace.install_filter(Syscall.trap_bpf(Util.system_arch)) if trap
         exec(*args)
       rescue # rubocop:disable Style/RescueStandardError
         Logger.error("Failed to execute #{args.join(' ')}")
@@ -222,5 +323,82 @@ module SeccompTools
       end
       collect
     end
+
+    # Dump the seccomp-bpf of every process on the host that has filters installed.
+    #
+    # Every thread whose +/proc/PID/task/TID/status+ reports +Seccomp: 2+ is read through
+    # +PTRACE_SECCOMP_GET_FILTER+, from a pool of native worker threads that run without the GVL
+    # (see {Ptrace.seccomp_get_filters}). This needs CAP_SYS_ADMIN, like {.dump_by_pid}. Identical
+    # filters of the same architecture are reported once, with the processes sharing them.
+    #
+    # @param [Integer] limit
+    #   Number of filters to dump per thread. Negative number for unlimited.
+    # @yieldparam [String] bpf
+    #   Seccomp bpf in raw bytes.
+    # @yieldparam [Symbol?] arch
+    #   Architecture of the processes, +nil+ when it cannot be determined.
+    # @yieldparam [Array<Integer>] pids
+    #   The processes with this filter installed, in ascending order.
+    # @return [Array<Object>, Array<String>]
+    #   One entry per distinct filter, ordered by the first process having it: the block's return
+    #   values, or the raw bytes if a block is not given.
+    # @raise [Errno::EPERM]
+    #   Raises the error if no filter could be dumped because of missing permission.
+    # @example
+    #   dump_all(1) { |bpf, arch, pids| pids }
+    #   #=> [[734, 1021], [1502]]
+    def dump_all(limit, &block)
+      return [] unless SUPPORTED
+
+      tids = seccomp_tids
+      results = Ptrace.seccomp_get_filters(tids.keys, limit, Etc.nprocessors)
+      arches = {}
+      shared = Hash.new { |h, k| h[k] = [] } # [arch, bpf] => pids
+      tids.values.zip(results).each do |pid, filters|
+        next if filters.is_a?(Integer)
+
+        arch = arches.fetch(pid) { arches[pid] = Util.process_arch(pid) }
+        filters.each { |bpf| shared[[arch, bpf]] << pid }
+      end
+      raise_denied(results) if shared.empty?
+
+      shared.map do |(arch, bpf), pids|
+        pids = pids.uniq.sort
+        block.nil? ? bpf : yield(bpf, arch, pids)
+      end
+    end
+
+    class << self
+      private
+
+      # The threads with seccomp filters installed, except ours.
+      # @return [{Integer => Integer}]
+      #   Maps each tid to its process id.
+      def seccomp_tids
+        Dir.children('/proc').grep(/\A\d+\z/).map(&:to_i).sort.each_with_object({}) do |pid, tids|
+          next if pid == Process.pid
+
+          tasks(pid).each { |tid| tids[tid] = pid if filtered?("/proc/#{pid}/task/#{tid}") }
+        end
+      end
+
+      def tasks(pid)
+        Dir.children("/proc/#{pid}/task").map(&:to_i).sort
+      rescue SystemCallError
+        []
+      end
+
+      def filtered?(dir)
+        File.foreach("#{dir}/status").any? { |line| line.start_with?('Seccomp:') && line.split[1] == '2' }
+      rescue SystemCallError
+        false
+      end
+
+      # Raises the permission error that kept every thread from being dumped, if any.
+      def raise_denied(results)
+        errno = results.find { |r| [Errno::EPERM::Errno, Errno::EACCES::Errno].include?(r) }
+        raise SystemCallError.new('ptrace seccomp_get_filter failed', errno) if errno
+      end
+    end
   end
 end
@@ -5,6 +5,23 @@ require 'seccomp-tools/const'
 module SeccompTools
   # Runs a seccomp filter against a hypothetical syscall to find out which action it returns.
   class Emulator
+    # Opcodes of a program lowered by {#compile}. Every instruction becomes four Integers,
+    # +[opcode, k, jt, jf]+, with jump targets resolved to absolute line numbers.
+    #
+    # * +ld_data+/+ldx_data+: +k+ is the field (+0+ sys_number, +1+ arch, +2+ instruction_pointer, +3 + i+
+    #   args[i]) and +jt+ how far it is shifted right to get the loaded word.
+    # * +alu_k+/+alu_x+: +jt+ indexes {ALU_OPS}.
+    # * +fault+: +k+ indexes the errors the instruction raises once reached, e.g. an out-of-range +mem+ slot.
+    #
+    # The native evaluator, +ext/lanes/lanes.c+, executes the same layout.
+    OPCODE = %i[ret_k ret_a ld_imm ldx_imm ld_mem ldx_mem ld_data ldx_data st stx ja
+                jeq_k jeq_x jgt_k jgt_x jge_k jge_x jset_k jset_x alu_k alu_x neg tax txa fault]
+             .each_with_index.to_h.freeze
+    # Operators of the +alu_k+/+alu_x+ opcodes, see {OPCODE}.
+    ALU_OPS = %i[+ - * / | & << >> ^].freeze
+    # Comparisons of conditional jumps, in the order of their opcodes.
+    CMP_OPS = %i[== > >= &].freeze
+
     # Instantiate a {Emulator} object.
     #
     # All parameters except +instructions+ are optional. A warning is shown when uninitialized data is accessed.
@@ -65,8 +82,199 @@ module SeccompTools
       @values
     end
 
+    # Lowers the instructions into a flat opcode array, once: see {OPCODE} for its layout.
+    #
+    # Instructions that can only fail (e.g. +mem[16]+) are lowered to +fault+, so they raise when
+    # reached, as with {#run}.
+    # @return [Array<Integer>]
+    #   Four Integers per instruction.
+    def compile
+      @compile ||= begin
+        @faults = []
+        @instructions.each_with_index.flat_map { |inst, line| lower(inst, line) }.freeze
+      end
+    end
+
+    # Runs the filter against many syscalls, returning the action of each.
+    #
+    # The filter is {#compile}d once and evaluated natively by +Emulator::Lanes+, many inputs at a time
+    # with SIMD, when the C extension is built. Inputs it can't decide, and all inputs without the
+    # extension, go through a Ruby interpreter of the opcode array with registers in locals, so nothing
+    # is allocated per instruction either way. This is what to use for sweeping a filter over every
+    # syscall number or a grid of arguments.
+    # @param [Array<Hash{Symbol => Object}>] inputs
+    #   Each takes the +sys_nr+, +args+ and +instruction_pointer+ keywords of {#initialize}; a missing key
+    #   defaults to the value this emulator was instantiated with. The architecture is this emulator's.
+    # @return [Array<Integer>]
+    #   The action returned for each input, i.e. what +run[:ret]+ would be.
+    # @raise [RuntimeError]
+    #   When an input leaves data read by the filter undefined, with the same message as {#run}.
+    # @example
+    #   SeccompTools::Emulator.new(insts, args: [0] * 6).run_batch((0..450).map { |nr| { sys_nr: nr } })
+    #   #=> [2147418112, 2147418112, 0, ...]
+    def run_batch(inputs)
+      code = compile
+      inputs = inputs.to_a
+      actions = self.class.native? ? Lanes.evaluate(code, inputs, @sys_nr, @args, @ip, @arch) : []
+      inputs.each_with_index do |input, i|
+        actions[i] ||= execute(code, input.fetch(:sys_nr, @sys_nr), input.fetch(:args, @args),
+                               input.fetch(:instruction_pointer, @ip))
+      end
+      actions
+    end
+
+    # Runs +instructions+ against many syscalls, see {#run_batch}.
+    # @param [Array<Instruction::Base>] instructions
+    #   See {#initialize}.
+    # @param [Symbol?] arch
+    #   See {#initialize}.
+    # @param [Array<Hash{Symbol => Object}>] inputs
+    #   See {#run_batch}.
+    # @return [Array<Integer>]
+    #   The action returned for each input.
+    # @example
+    #   SeccompTools::Emulator.evaluate_many(insts, arch: :amd64, inputs: [{ sys_nr: 0 }, { sys_nr: 59 }])
+    #   #=> [2147418112, 0]
+    def self.evaluate_many(instructions, arch: nil, inputs: [])
+      new(instructions, arch:).run_batch(inputs)
+    end
+
+    # Whether {#run_batch} evaluates natively, i.e. the C extension is built.
+    # @return [Boolean]
+    def self.native?
+      const_defined?(:Lanes, false)
+    end
+
     private
 
+    # The interpreter of {#compile}d programs. Opcodes are literals so +case+ compiles to a jump table.
+    def execute(code, sys_nr, args, ip)
+      a = x = pc = 0
+      mem = Array.new(16)
+      loop do
+        i = pc * 4
+        k = code[i + 1]
+        pc += 1
+        case code[i]
+        when 0 then return k # ret_k
+        when 1 then return a # ret_a
+        when 2 then a = k # ld_imm
+        when 3 then x = k # ldx_imm
+        when 4 then a = mem[k] || undefined("mem[#{k}]", pc - 1) # ld_mem
+        when 5 then x = mem[k] || undefined("mem[#{k}]", pc - 1) # ldx_mem
+        when 6 then a = data_word(k, code[i + 2], sys_nr, args, ip, pc - 1) # ld_data
+        when 7 then x = data_word(k, code[i + 2], sys_nr, args, ip, pc - 1) # ldx_data
+        when 8 then mem[k] = a # st
+        when 9 then mem[k] = x # stx
+        when 10 then pc = k # ja
+        when 11 then pc = a == k ? code[i + 2] : code[i + 3] # jeq_k
+        when 12 then pc = a == x ? code[i + 2] : code[i + 3] # jeq_x
+        when 13 then pc = a > k ? code[i + 2] : code[i + 3] # jgt_k
+        when 14 then pc = a > x ? code[i + 2] : code[i + 3] # jgt_x
+        when 15 then pc = a >= k ? code[i + 2] : code[i + 3] # jge_k
+        when 16 then pc = a >= x ? code[i + 2] : code[i + 3] # jge_x
+        when 17 then pc = a.anybits?(k) ? code[i + 2] : code[i + 3] # jset_k
+        when 18 then pc = a.anybits?(x) ? code[i + 2] : code[i + 3] # jset_x
+        when 19, 20 # alu_k, alu_x
+          src = code[i] == 19 ? k : x
+          op = ALU_OPS[code[i + 2]]
+          return Const::BPF::ACTION[:KILL_THREAD] if op == :/ && src.zero?
+
+          a = a.__send__(op, src) & 0xffffffff
+        when 21 then a = ((2**32) - a) & 0xffffffff # neg
+        when 22 then x = a # tax
+        when 23 then a = x # txa
+        when 24 then raise @faults[k] # fault
+        else raise IndexError, "Jumped out of the filter, to line #{pc - 1}"
+        end
+      end
+    end
+
+    # The word of +seccomp_data+ an +ld_data+ opcode reads, see {OPCODE}.
+    def data_word(field, shift, sys_nr, args, ip, line)
+      val = case field
+            when 0 then sys_nr
+            when 1 then @arch
+            when 2 then ip
+            else args[field - 3]
+            end
+      return (val >> shift) & 0xffffffff unless val.nil?
+
+      data = Const::BPF::SeccompData
+      name = case field
+             when 0 then data::NAMES[data::SYS_NUMBER]
+             when 1 then data::NAMES[data::ARCH]
+             when 2 then data::NAMES[data::INSTRUCTION_POINTER]
+             else "args[#{field - 3}]"
+             end
+      undefined(name, line)
+    end
+
+    # Lowers one instruction, see {#compile}.
+    def lower(inst, line)
+      op, *args = inst.symbolize
+      case op
+      when :ret then args[0] == :a ? [OPCODE[:ret_a], 0, 0, 0] : [OPCODE[:ret_k], args[0], 0, 0]
+      when :ld then lower_ld(*args)
+      when :st then lower_st(*args)
+      when :jmp then [OPCODE[:ja], line + args[0] + 1, 0, 0]
+      when :cmp then lower_cmp(line, *args)
+      when :alu then lower_alu(*args)
+      when :misc then [OPCODE[args[0]], 0, 0, 0]
+      end
+    rescue StandardError => e
+      fault(e)
+    end
+
+    def lower_ld(dst, src)
+      prefix = dst == :x ? 'ldx' : 'ld'
+      case src[:rel]
+      when :immi then [OPCODE[:"#{prefix}_imm"], src[:val] & 0xffffffff, 0, 0]
+      when :mem
+        return fault(IndexError.new("Invalid index: #{src[:val]}")) unless src[:val].between?(0, 15)
+
+        [OPCODE[:"#{prefix}_mem"], src[:val], 0, 0]
+      when :data then [OPCODE[:"#{prefix}_data"], *data_field(src[:val]), 0]
+      end
+    end
+
+    # +[field, shift]+ of the +seccomp_data+ word at byte offset +index+, see {OPCODE}.
+    def data_field(index)
+      data = Const::BPF::SeccompData
+      raise IndexError, "Invalid index: #{index}" unless index.nobits?(3) && index.between?(0, data::SIZE - 1)
+
+      index /= 4
+      return [index, 0] if index < 2
+
+      hi = index.odd? ^ @big_endian
+      [index < 4 ? 2 : 3 + ((index - 4) / 2), hi ? 32 : 0]
+    end
+
+    def lower_st(reg, index)
+      return fault(IndexError.new("Expect 0 <= index < 16, got: #{index}")) unless index.between?(0, 15)
+
+      [OPCODE[reg == :x ? :stx : :st], index, 0, 0]
+    end
+
+    def lower_cmp(line, op, src, jt, jf)
+      opcode = OPCODE[:jeq_k] + (CMP_OPS.index(op) * 2)
+      return [opcode + 1, 0, line + jt + 1, line + jf + 1] if src == :x
+
+      [opcode, src, line + jt + 1, line + jf + 1]
+    end
+
+    def lower_alu(op, src)
+      return [OPCODE[:neg], 0, 0, 0] if op == :neg
+      return [OPCODE[:alu_x], 0, ALU_OPS.index(op), 0] if src == :x
+
+      [OPCODE[:alu_k], src, ALU_OPS.index(op), 0]
+    end
+
+    def fault(error)
+      @faults << error
+      [OPCODE[:fault], @faults.size - 1, 0, 0]
+    end
+
     def pc
       @values[:pc]
     end
@@ -179,8 +387,14 @@ module SeccompTools
       (val >> (hi ? 32 : 0)) & 0xffffffff
     end
 
-    def undefined(var)
-      raise format("Undefined Variable\n\t%04d: %s <- `%s` is undefined", pc, @instructions[pc].decompile, var)
+    def undefined(var, line = pc)
+      raise format("Undefined Variable\n\t%04d: %s <- `%s` is undefined", line, @instructions[line].decompile, var)
     end
   end
 end
+
+begin
+  require 'seccomp-tools/lanes'
+rescue LoadError
+  # Not compiled, e.g. on an unsupported compiler: {SeccompTools::Emulator#run_batch} interprets in Ruby.
+end
@@ -30,4 +30,12 @@ module SeccompTools
   # Raised when a jump is longer than supported distance.
   class LongJumpError < Error
   end
+
+  # Raised when a filter cannot be rewritten by {SeccompTools::Optimizer}.
+  class OptimizeError < Error
+  end
+
+  # Raised when filters cannot be merged by {SeccompTools::Merger}.
+  class MergeError < Error
+  end
 end
@@ -22,16 +22,19 @@ module SeccompTools
     #   The architecture the filter is written for, used for syscall/argument names.
     # @param [String?] source
     #   A label for the filter (e.g. a filename) shown in the summary header.
-    def initialize(instructions, arch:, source: nil)
+    # @param [Array(Array<Symbolic::Executor::Leaf>, Boolean)?] walk
+    #   The filter's walk, when already known (e.g. from an {AnalysisCache}), instead of walking it.
+    def initialize(instructions, arch:, source: nil, walk: nil)
       @instructions = instructions
       @arch = arch
       @source = source
+      @walk = walk
     end
 
     # Walks the filter and returns a printable {Summary}.
     # @return [Summary]
     def summarize
-      leaves, truncated = Symbolic::Executor.new(@instructions).run
+      leaves, truncated = @walk || Symbolic::Executor.new(@instructions).run
       Summary.new(leaves, arch: @arch, source: @source, truncated:)
     end
   end
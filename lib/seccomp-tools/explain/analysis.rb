@@ -48,6 +48,14 @@ module SeccompTools
         end
       end
 
+      # Leaves reachable when +arch+ is +val+, whether or not the filter checks that value: every leaf
+      # whose +arch+ facts +val+ satisfies.
+      # @param [Integer] val
+      # @return [Array<Symbolic::Executor::Leaf>]
+      def leaves_for(val)
+        @leaves.select { |l| facts(l).arch_consistent?(val) }
+      end
+
       # Leaves reachable when +arch+ is none of the explicitly-checked values.
       # @return [Array<Symbolic::Executor::Leaf>]
       def other_leaves
@@ -40,11 +40,18 @@ module SeccompTools
         @analysis = Analysis.new(leaves)
       end
 
+      # The header line naming the filter, empty without a +source+.
+      # @param [String?] source
+      # @return [String]
+      def self.header(source)
+        source ? "Seccomp policy for #{source}\n" : ''
+      end
+
       # Renders the policy.
       # @return [String]
       def to_s
         out = +''
-        out << "Seccomp policy for #{@source}\n" if @source
+        out << self.class.header(@source)
         out << "WARNING: analysis truncated (filter too large); results may be incomplete.\n" if @truncated
         @analysis.sections(@arch).each do |_arch_val, arch_sym, title, leaves|
           out << "\n" << render_section(title, section_buckets(arch_sym, leaves))
@@ -209,7 +216,7 @@ module SeccompTools
       end
 
       def syscall_name(arch_sym, nr)
-        arch_sym && Const::Syscall.const_get(arch_sym.upcase).invert[nr]
+        arch_sym && Const::Syscall.name_of(arch_sym, nr)
       rescue NameError
         nil
       end
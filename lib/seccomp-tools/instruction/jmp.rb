@@ -68,7 +68,7 @@ module SeccompTools
         rhs = src == :x ? resolve(state, state.x) : Symbolic::Expr.imm(k)
         return state unless rhs.imm?
 
-        state.with(path: state.path + [Symbolic::Constraint.new(state.a, :==, rhs)])
+        state.with(path: state.path.add(Symbolic::Constraint.new(state.a, :==, rhs)))
       end
 
       # Replaces a data-word +expr+ with the constant it is pinned to on +state+'s path, if any;
@@ -111,7 +111,7 @@ module SeccompTools
 
       def sysname_by_k
         a = infer_arch || arch
-        name = Const::Syscall.const_get(a.upcase.to_sym).invert[k]
+        name = Const::Syscall.name_of(a, k)
         return name if name.nil?
 
         a == arch ? name : "#{a}.#{name}"
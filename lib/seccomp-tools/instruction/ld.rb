@@ -108,7 +108,7 @@ module SeccompTools
         return default if sys_nrs.size != 1 || sys_nrs.first.nil?
 
         a = infer_arch || arch
-        sys = Const::Syscall.const_get(a.upcase.to_sym).invert[sys_nrs.first]
+        sys = Const::Syscall.name_of(a, sys_nrs.first)
         args = Const::SYS_ARG[sys]
         return default if args.nil? || args[idx / 2].nil? # function prototype doesn't have that argument
 
@@ -13,12 +13,14 @@ module SeccompTools
 
     # Returns a +::Logger+ object for internal logging.
     #
-    # The returned logger writes to +$stdout+ with a formatter that prefixes each message with its
+    # The returned logger writes to +io+ with a formatter that prefixes each message with its
     # colorized severity and indents continuation lines to align with the first.
     #
+    # @param [IO] io
+    #   Where to write, +$stdout+ unless the output there is data that must not be mixed with notes.
     # @return [::Logger]
-    def logger
-      ::Logger.new($stdout).tap do |log|
+    def logger(io = $stdout)
+      ::Logger.new(io).tap do |log|
         log.formatter = proc do |severity, _datetime, _progname, msg|
           prep = ' ' * (severity.size + 3)
           message = msg.lines.map.with_index do |str, i|
@@ -34,19 +36,23 @@ module SeccompTools
       end
     end
 
-    # @!method error(msg)
+    # @!method error(msg, io: $stdout)
     #   Logs +msg+ at the +error+ severity.
     #   @param [String] msg
     #     The message to be logged.
+    #   @param [IO] io
+    #     See {logger}.
     #   @return [true]
-    # @!method warn(msg)
+    # @!method warn(msg, io: $stdout)
     #   Logs +msg+ at the +warn+ severity.
     #   @param [String] msg
     #     The message to be logged.
+    #   @param [IO] io
+    #     See {logger}.
     #   @return [true]
     %i[error warn].each do |sym|
-      define_method(sym) do |msg|
-        logger.__send__(sym, msg)
+      define_method(sym) do |msg, io: $stdout|
+        logger(io).__send__(sym, msg)
       end
     end
   end
@@ -0,0 +1,196 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/const'
+require 'seccomp-tools/disasm/disasm'
+require 'seccomp-tools/emulator'
+require 'seccomp-tools/error'
+require 'seccomp-tools/optimizer'
+require 'seccomp-tools/util'
+
+module SeccompTools
+  # Merges filters stacked on one process into a single equivalent filter.
+  #
+  # The kernel runs every filter of a process on each syscall, newest first, and keeps the most
+  # restrictive result: the lowest +SECCOMP_RET_ACTION_FULL+ bits compared as a signed value, the
+  # newer filter's on a tie (see {.precedence}). So a launcher's filter and a runtime's each cost a
+  # full run on every call.
+  #
+  # {#merge} first composes the filters into one program: the newest runs as it is, except that each
+  # of its +return k+ jumps to a copy of the next filter whose returns are all combined with +k+ -
+  # one copy per distinct result so far, so the product of the filters' paths is spelled out and
+  # every return is a constant again. Copies that cannot change the result are skipped: once the
+  # result is as restrictive as anything the remaining filters return, it is returned. The
+  # composition is checked against the stack with the {Emulator}, then rewritten by the {Optimizer},
+  # whose symbolic walk of it follows exactly that product of paths, to decide the frequent syscalls
+  # first - in most cases by the syscall number alone, without running any original filter at all.
+  #
+  # @example
+  #   SeccompTools::Merger.new([launcher, runtime], arch: :amd64).merge
+  #   #=> <raw binary bytes>
+  class Merger
+    # The most instructions the kernel accepts in one filter (+BPF_MAXINSNS+).
+    MAX_INSTRUCTIONS = Optimizer::MAX_INSTRUCTIONS
+
+    # @param [Array<String>] filters
+    #   The stacked filters as raw BPF bytes, in the order they were installed.
+    # @param [Symbol] arch
+    #   The architecture the filters are installed on.
+    # @param [{Symbol => Integer}?] profile
+    #   Call counts by syscall name, see {Optimizer#initialize}.
+    def initialize(filters, arch:, profile: nil)
+      @arch = arch
+      @profile = profile
+      # the order the kernel runs them in
+      @programs = filters.reverse.map { |raw| Disasm.to_bpf(raw, arch) }
+    end
+
+    # The action the kernel takes when a filter returning +newer+ is stacked on one returning +older+.
+    # @param [Integer] newer
+    # @param [Integer] older
+    # @return [Integer]
+    def self.precedence(newer, older)
+      rank(older) < rank(newer) ? older : newer
+    end
+
+    # The value the kernel orders actions by: +SECCOMP_RET_ACTION_FULL+ bits as a signed 32-bit
+    # value, so +KILL_PROCESS+ is the lowest, i.e. the most restrictive.
+    # @param [Integer] ret
+    # @return [Integer]
+    def self.rank(ret)
+      v = ret & Const::BPF::SECCOMP_RET_ACTION_FULL
+      v >= 2**31 ? v - (2**32) : v
+    end
+
+    # Builds the merged filter.
+    # @return [String]
+    #   Raw BPF bytes of one filter equivalent to all of them stacked, optimized when the
+    #   {Optimizer} can rewrite the composition.
+    # @raise [SeccompTools::MergeError]
+    #   When the filters cannot be composed: one returns +A+, or the composition exceeds the
+    #   kernel's instruction limit.
+    def merge
+      raw = compose
+      verify!(raw)
+      Optimizer.new(raw, arch: @arch, profile: @profile).optimize
+    rescue OptimizeError
+      raw
+    end
+
+    # The filters composed into one program, without the rewrite {#merge} applies to it.
+    # @return [String]
+    # @raise [SeccompTools::MergeError]
+    def compose
+      levels = copies
+      size = levels.each_with_index.sum { |results, i| results.size * block_size(i) }
+      if size > MAX_INSTRUCTIONS
+        raise MergeError, "The merged filter has #{size} instructions, more than the kernel accepts."
+      end
+
+      starts = {}
+      pos = 0
+      levels.each_with_index do |results, i|
+        results.each do |result|
+          starts[[i, result]] = pos
+          pos += block_size(i)
+        end
+      end
+      levels.each_with_index.flat_map do |results, i|
+        results.flat_map { |result| block(i, result, starts) }
+      end.map { |inst| encode(inst) }.join
+    end
+
+    private
+
+    # The distinct results so far each filter is copied for, in the order the copies are laid out;
+    # the newest filter runs once, with no result yet (+nil+).
+    def copies
+      levels = [[nil]]
+      (1...@programs.size).each do |i|
+        levels << levels.last.flat_map { |so_far| returns(i - 1).map { |k| combine(so_far, k) } }
+                        .uniq.reject { |result| decided?(i, result) }
+      end
+      levels
+    end
+
+    # The constants filter +i+ (in the kernel's order) returns.
+    def returns(idx)
+      @returns ||= @programs.each_with_index.map do |insts, i|
+        insts.filter_map do |bpf|
+          op, val = bpf.inst.symbolize
+          next unless op == :ret
+          raise MergeError, "Filter ##{@programs.size - 1 - i} returns A at line #{bpf.line}." if val == :a
+
+          val
+        end.uniq
+      end
+      @returns[idx]
+    end
+
+    def combine(so_far, ret)
+      so_far.nil? ? ret : self.class.precedence(so_far, ret)
+    end
+
+    # Is +result+ final before filter +i+ runs, nothing it or a later filter returns being more
+    # restrictive?
+    def decided?(idx, result)
+      rank = self.class.rank(result)
+      (idx...@programs.size).all? { |i| returns(i).all? { |k| self.class.rank(k) >= rank } }
+    end
+
+    # A copy of filter +i+ clears the registers it may read first, as the kernel does before
+    # running a filter, unless it loads A first.
+    def prologue(idx)
+      insts = @programs[idx].map(&:inst)
+      pro = []
+      pro << { code: Const::BPF::COMMAND[:ld] | Const::BPF::MODE[:imm], jt: 0, jf: 0, k: 0 } unless
+        idx.zero? || insts.first.symbolize.first(2) == %i[ld a]
+      pro << { code: Const::BPF::COMMAND[:ldx] | Const::BPF::MODE[:imm], jt: 0, jf: 0, k: 0 } if
+        idx.positive? && insts.any? { |inst| inst.symbolize.include?(:x) || inst.symbolize.first == :misc }
+      pro
+    end
+
+    def block_size(idx)
+      prologue(idx).size + @programs[idx].size
+    end
+
+    # The copy of filter +i+ run after the result so far is +result+, starting at +starts[[i, result]]+.
+    def block(idx, result, starts)
+      base = starts[[idx, result]] + prologue(idx).size
+      last = idx == @programs.size - 1
+      prologue(idx) + @programs[idx].each_with_index.map do |bpf, line|
+        op, val = bpf.inst.symbolize
+        next { code: bpf.code, jt: bpf.jt, jf: bpf.jf, k: bpf.k } unless op == :ret
+
+        ret = combine(result, val)
+        next { code: bpf.code, jt: 0, jf: 0, k: ret } if last || decided?(idx + 1, ret)
+
+        { code: Const::BPF::COMMAND[:jmp] | Const::BPF::JMP[:ja], jt: 0, jf: 0,
+          k: starts[[idx + 1, ret]] - (base + line) - 1 }
+      end
+    end
+
+    def encode(inst)
+      endian = Const::Endian::ENDIAN[@arch]
+      [inst[:code], inst[:jt], inst[:jf], inst[:k]].pack("S#{endian}CCL#{endian}")
+    end
+
+    # Runs the stacked filters and the composition on every syscall number of every supported
+    # architecture, under a few choices of arguments, raising unless they agree each time.
+    def verify!(raw)
+      composed = Disasm.to_bpf(raw, @arch).map(&:inst)
+      Util.supported_archs.each do |arch|
+        inputs = Optimizer.sample_inputs(arch)
+        rets = @programs.map { |insts| Emulator.evaluate_many(insts.map(&:inst), arch:, inputs:) }
+        expected = rets.transpose.map { |each| each.reduce { |so_far, k| self.class.precedence(so_far, k) } }
+        actual = Emulator.evaluate_many(composed, arch:, inputs:)
+        idx = expected.zip(actual).index { |e, a| e != a }
+        next if idx.nil?
+
+        raise MergeError, format('The merged filter returns 0x%x instead of 0x%x for syscall 0x%x on %s.',
+                                 actual[idx], expected[idx], inputs[idx][:sys_nr], arch)
+      end
+    rescue RuntimeError, IndexError => e
+      raise MergeError, "The filters cannot be emulated to verify the merge: #{e.message.lines.first.chomp}"
+    end
+  end
+end
@@ -0,0 +1,141 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/asm/asm'
+require 'seccomp-tools/audit/policy'
+require 'seccomp-tools/const'
+require 'seccomp-tools/disasm/disasm'
+require 'seccomp-tools/emulator'
+require 'seccomp-tools/error'
+require 'seccomp-tools/explain/analysis'
+require 'seccomp-tools/optimizer/dispatch'
+require 'seccomp-tools/symbolic/executor'
+require 'seccomp-tools/util'
+
+module SeccompTools
+  # Rewrites a seccomp filter into an equivalent one that decides the frequent syscalls in fewer
+  # instructions.
+  #
+  # Generated filters often test syscalls in an order that has nothing to do with how often they are
+  # made, so a hot +read+ checked last pays for every check before it, on every call. The optimizer
+  # derives what the filter returns for each syscall with the {Symbolic::Executor} (split per
+  # architecture by {Explain::Analysis}, queried per syscall through {Audit::Policy}, as {Cost}
+  # does), then emits a new dispatch through the assembler: per architecture, a {Dispatch} that
+  # checks the hottest syscalls first and binary-searches the rest. Decisions the dispatch cannot
+  # take alone - a syscall whose action depends on its arguments - jump to the original filter,
+  # appended unchanged.
+  #
+  # The result is accepted only once the {Emulator} finds it returning what the original does for
+  # every syscall number that matters, on every supported architecture.
+  #
+  # @example
+  #   SeccompTools::Optimizer.new(raw, arch: :amd64, profile: { read: 1200, futex: 800 }).optimize
+  #   #=> <raw binary bytes>
+  class Optimizer
+    # The most instructions the kernel accepts in one filter (+BPF_MAXINSNS+).
+    MAX_INSTRUCTIONS = 4096
+
+    # @param [String] raw
+    #   The filter, as raw BPF bytes.
+    # @param [Symbol] arch
+    #   The architecture the filter is written for, used when it does not itself branch on +arch+.
+    # @param [{Symbol => Integer}?] profile
+    #   Call counts by syscall name (see {Cost::Profile}); without one every syscall is as frequent.
+    def initialize(raw, arch:, profile: nil)
+      @raw = raw
+      @arch = arch
+      @profile = profile || {}
+      @instructions = Disasm.to_bpf(raw, arch).map(&:inst)
+    end
+
+    # Builds the rewritten filter and checks it against the original.
+    # @return [String]
+    #   Raw BPF bytes of the rewritten filter.
+    # @raise [SeccompTools::OptimizeError]
+    #   When the filter is too large to analyse, the rewrite does not fit in a filter, or it is not
+    #   equivalent to the original.
+    def optimize
+      leaves, truncated = Symbolic::Executor.new(@instructions).run
+      raise OptimizeError, 'The filter is too large to be analysed.' if truncated
+
+      analysis = Explain::Analysis.new(leaves)
+      policies = analysis.sections(@arch).map { |section| Audit::Policy.new(analysis, section) }
+                         .sort_by.with_index { |p, i| [p.arch_sym == @arch ? 0 : 1, i] }
+      dispatches = policies.map { |p| Dispatch.of(p, @profile) }
+      raw = assemble(policies, dispatches, analysis)
+      verify!(raw, dispatches)
+      raw
+    end
+
+    # Inputs that tell filters apart on +arch+: every syscall number of its table and the one after,
+    # the largest one, and +numbers+, each under a few choices of instruction pointer and arguments.
+    # @param [Symbol] arch
+    # @param [Array<Integer>] numbers
+    # @return [Array<{Symbol => Object}>]
+    #   Inputs for {Emulator.evaluate_many}.
+    def self.sample_inputs(arch, numbers = [])
+      rng = Random.new(0)
+      samples = [[0] * 7, [(2**64) - 1] * 7, Array.new(7) { rng.rand(2**64) }, Array.new(7) { rng.rand(2**32) }]
+      table = Const::Syscall.const_get(arch.upcase).values.flat_map { |nr| [nr, nr + 1] }
+      nrs = (numbers + table + [Dispatch::U32_MAX]).uniq
+      nrs.product(samples).map { |nr, (ip, *args)| { sys_nr: nr, args:, instruction_pointer: ip } }
+    end
+
+    private
+
+    # Emits the dispatch of every section behind a check of +arch+ (when the filter branches on it),
+    # followed by the original filter if any decision is left to it.
+    def assemble(policies, dispatches, analysis)
+      lines = []
+      other = nil
+      if policies.first.arch_val
+        other = Dispatch.action_of(analysis.other_leaves)
+        lines << 'A = arch'
+        policies.each_with_index { |p, i| lines << format("A == 0x%x ? arch#{i} : next", p.arch_val) }
+        lines << Dispatch.action(other)
+      end
+      dispatches.each_with_index do |d, i|
+        lines << "arch#{i}:" if policies.first.arch_val
+        lines.concat(d.assembly("arch#{i}_"))
+      end
+      fallback = other == :fallback || dispatches.any?(&:fallback?)
+      # The original filter expects to start with A cleared.
+      lines << 'fallback:' << 'A = 0' if fallback
+      raw = Asm.asm(lines.join("\n"), arch: @arch)
+      raw = append_original(raw) if fallback
+      size = raw.size / 8
+      return raw if size <= MAX_INSTRUCTIONS
+
+      raise OptimizeError, "The rewritten filter has #{size} instructions, more than the kernel accepts."
+    rescue LongJumpError => e
+      raise OptimizeError, "The rewritten dispatch is too large for a conditional jump: #{e.message}"
+    end
+
+    # Appends the original filter to +raw+, whose last instruction clears A for it. When the original
+    # loads A first anyway, that load replaces the clearing: the kernel's action cache emulation
+    # stops at +A = 0+, but follows +A = sys_number+ into the original.
+    def append_original(raw)
+      @instructions.first.symbolize.first(2) == %i[ld a] ? raw[0...-8] + @raw : raw + @raw
+    end
+
+    # Runs the original and the rewritten filter on every syscall number of every supported
+    # architecture's table, and at every point where the dispatches cut, under a few choices of
+    # arguments, raising unless they return the same each time.
+    def verify!(raw, dispatches)
+      rewritten = Disasm.to_bpf(raw, @arch).map(&:inst)
+      numbers = dispatches.flat_map(&:points).flat_map { |p| [p, p - 1] }.select { |nr| nr >= 0 }
+      Util.supported_archs.each do |arch|
+        inputs = self.class.sample_inputs(arch, numbers)
+        expected = Emulator.evaluate_many(@instructions, arch:, inputs:)
+        actual = Emulator.evaluate_many(rewritten, arch:, inputs:)
+        idx = expected.zip(actual).index { |e, a| e != a }
+        next if idx.nil?
+
+        raise OptimizeError, format('The rewritten filter returns 0x%x instead of 0x%x for syscall 0x%x on %s.',
+                                    actual[idx], expected[idx], inputs[idx][:sys_nr], arch)
+      end
+    rescue RuntimeError, IndexError => e
+      # the emulator cannot run the filter, e.g. it reads an unset scratch slot
+      raise OptimizeError, "The filter cannot be emulated to verify the rewrite: #{e.message.lines.first.chomp}"
+    end
+  end
+end
@@ -0,0 +1,153 @@
+# frozen_string_literal: true
+
+module SeccompTools
+  class Optimizer
+    # The syscall-number dispatch of one architecture section, derived from its {Audit::Policy} and
+    # written back as seccomp assembly.
+    #
+    # The 32-bit syscall-number space is cut at every constant a +sys_number+ fact of the section
+    # compares against, and around every syscall of the architecture's table, so no fact changes its
+    # outcome within a piece. Each piece then gets the action all of its reachable leaves return,
+    # or +:fallback+ - run the original filter - when they disagree (the filter checks arguments) or
+    # return +A+. Adjacent pieces with the same action are merged into a {Range}.
+    #
+    # The ranges are dispatched by a binary search whose splits balance the profile's call counts,
+    # as libseccomp's does, after a linear run of +==+ checks for as many of the hottest syscalls as
+    # pay for themselves.
+    class Dispatch
+      # Largest syscall number, i.e. 32-bit value.
+      U32_MAX = 0xffffffff
+
+      # A run of syscall numbers, +lo+ to +hi+ inclusive, sharing one action: the value returned,
+      # or +:fallback+. +weight+ is how many calls of the profile fall in it.
+      Range = Struct.new(:lo, :hi, :action, :weight)
+
+      # @return [Array<Range>] The merged ranges, in order, covering every syscall number.
+      attr_reader :ranges
+      # @return [Array<Integer>] Every number a piece starts at, before merging.
+      attr_reader :points
+
+      # @param [Audit::Policy] policy
+      # @param [{Symbol => Integer}] profile
+      #   Call counts by syscall name.
+      # @return [Dispatch]
+      def self.of(policy, profile)
+        new(policy, profile)
+      end
+
+      # @param [Audit::Policy] policy
+      # @param [{Symbol => Integer}] profile
+      def initialize(policy, profile)
+        @policy = policy
+        table = policy.table || {}
+        @calls = profile.filter_map { |name, n| [table[name], n] if table[name] && n.positive? }
+                        .each_with_object(Hash.new(0)) { |(nr, n), h| h[nr] += n }
+        @points, pieces = cut(table.values)
+        @hot = @calls.keys.filter_map { |nr| [nr, @calls[nr], pieces[nr]] unless pieces[nr] == :fallback }
+                     .sort_by { |nr, n, _| [-n, nr] }
+        @ranges = merge(pieces)
+      end
+
+      # Whether some syscall number (or argument choice) leaves the decision to the original filter.
+      # @return [Boolean]
+      def fallback?
+        @ranges.any? { |r| r.action == :fallback }
+      end
+
+      # The assembly of this dispatch, from loading +sys_number+ to every return.
+      # @param [String] prefix
+      #   Prepended to every label, so several sections can share one program.
+      # @return [Array<String>]
+      #   One statement per element; +:fallback+ is +goto fallback+.
+      def assembly(prefix)
+        # nothing to tell apart, e.g. an architecture whose every syscall is killed
+        return [self.class.action(@ranges.first.action)] if @ranges.size == 1
+
+        @label = 0
+        @prefix = prefix
+        depth = {}
+        tree = search(0, @ranges.size - 1, 0, depth)
+        hot = @hot.first(linear_count(depth))
+        lines = ['A = sys_number']
+        hot.each_with_index do |(nr, _, action), i|
+          label = "#{prefix}hot#{i}"
+          lines << format("A != 0x%x ? #{label} : next", nr) << self.class.action(action) << "#{label}:"
+        end
+        lines.concat(tree)
+      end
+
+      # The statement that takes +action+.
+      # @param [Integer, :fallback] action
+      # @return [String]
+      def self.action(action)
+        action == :fallback ? 'goto fallback' : format('return 0x%x', action)
+      end
+
+      # The one constant all of +leaves+ return, else +:fallback+.
+      # @param [Array<Symbolic::Executor::Leaf>] leaves
+      # @return [Integer, :fallback]
+      def self.action_of(leaves)
+        rets = leaves.map(&:ret).uniq(&:key)
+        rets.size == 1 && rets.first.imm? ? rets.first.val : :fallback
+      end
+
+      private
+
+      # Splits the syscall-number space at the intervals of the policy's {Audit::SyscallIndex} and
+      # around +numbers+, returning the piece starts and the action of each start.
+      def cut(numbers)
+        index = @policy.index
+        points = (index.starts + numbers.flat_map { |nr| [nr, nr + 1] }).select { |b| b <= U32_MAX }.uniq.sort
+        pieces = points.each_with_index.to_h do |lo, i|
+          hi = (points[i + 1] || (U32_MAX + 1)) - 1
+          [lo, self.class.action_of(index.exact? || lo == hi ? index.leaves_at(lo) : @policy.leaves)]
+        end
+        [points, pieces]
+      end
+
+      def merge(pieces)
+        ranges = []
+        @points.each_with_index do |lo, i|
+          hi = (@points[i + 1] || (U32_MAX + 1)) - 1
+          weight = @calls.sum { |nr, n| nr.between?(lo, hi) ? n : 0 }
+          last = ranges.last
+          next ranges << Range.new(lo, hi, pieces[lo], weight) unless last&.action == pieces[lo]
+
+          last.hi = hi
+          last.weight += weight
+        end
+        ranges
+      end
+
+      # The binary search over +@ranges[from..to]+, recording how many comparisons reach each range
+      # in +depth+. Every range weighs one call more than the profile says, so syscalls it never
+      # made are still searched in logarithmic time.
+      def search(from, to, level, depth)
+        if from == to
+          depth[from] = level
+          return [self.class.action(@ranges[from].action)]
+        end
+
+        weights = @ranges[from..to].map { |r| r.weight + 1 }
+        total = weights.sum
+        left = 0
+        split = (1..to - from).min_by { |m| (total - (2 * (left += weights[m - 1]))).abs } + from
+        label = "#{@prefix}range#{@label += 1}"
+        [format("A >= 0x%x ? #{label} : next", @ranges[split].lo),
+         *search(from, split - 1, level + 1, depth), "#{label}:", *search(split, to, level + 1, depth)]
+      end
+
+      # How many of the hottest syscalls to check one by one before the search: the count that
+      # minimizes the instructions the profile's calls execute. Each check costs every call that
+      # reaches it one instruction, and saves the searched ones their comparisons.
+      def linear_count(depth)
+        searched = @calls.to_h { |nr, _| [nr, depth[@ranges.bsearch_index { |r| r.hi >= nr }] + 1] }
+        (0..@hot.size).min_by do |k|
+          checked = @hot.first(k).to_h { |nr, _| [nr, true] }
+          linear = @hot.first(k).each_with_index.sum { |(_, n, _), i| n * (i + 2) }
+          linear + @calls.sum { |nr, n| checked[nr] ? 0 : n * (k + searched[nr]) }
+        end
+      end
+    end
+  end
+end
@@ -0,0 +1,160 @@
+# frozen_string_literal: true
+
+require 'socket'
+
+require 'seccomp-tools/client'
+require 'seccomp-tools/const'
+require 'seccomp-tools/logger'
+require 'seccomp-tools/util'
+require 'seccomp-tools/version'
+
+module SeccompTools
+  # The server of +seccomp-tools serve+: loads the whole library once, then runs the command lines
+  # {Client}s send over a Unix socket, so they skip starting Ruby and loading it themselves.
+  #
+  # Every request runs in a process forked for it, with the client's stdin, stdout and stderr,
+  # working directory and environment, exactly as +bin/seccomp-tools+ would run it: requests run
+  # concurrently, share the loaded library copy-on-write, and leave nothing behind - a color
+  # setting, a cache in memory - for the next. See {Client} for the protocol.
+  #
+  # What the client does not send is the server's: resource limits, the umask and credentials,
+  # so a program +dump+ runs is limited as the server is.
+  #
+  # The command runs in a process group of its own, along with the programs it starts, which gets
+  # the signals the client relays and is killed when the client hangs up.
+  class Server
+    # @return [String] The socket path.
+    attr_reader :path
+
+    # @param [String] path
+    #   Where to listen. The socket is made accessible to this user only.
+    def initialize(path)
+      @path = path
+    end
+
+    # Loads everything a command may need, including what the library otherwise loads on first use,
+    # such as the syscall table of each architecture.
+    # @return [void]
+    def self.preload
+      # Here rather than above: the CLI loads this file for +serve+.
+      require 'seccomp-tools/cli/cli'
+
+      CLI::COMMANDS.each_value { |name| CLI.const_get(name) }
+      Util.supported_archs.each { |arch| Const::Syscall.index(arch) }
+      Const::SYS_ARG
+    end
+
+    # Listens until interrupted, then removes the socket.
+    # @yieldparam [String] path
+    #   Called once the server accepts requests.
+    # @return [void]
+    # @raise [Errno::EADDRINUSE]
+    #   When another server is listening at {#path}.
+    def run
+      self.class.preload
+      server = listen
+      yield path if block_given?
+      trap_signals(server)
+      loop do
+        conn = server.accept
+        Process.detach(fork { serve(server, conn) })
+        conn.close
+      end
+    rescue IOError, Errno::EBADF
+      nil # closed by a signal
+    ensure
+      server&.close unless server&.closed?
+      File.unlink(path) if server && File.socket?(path)
+    end
+
+    private
+
+    # A socket at +path+ nobody listens on is left from a server that died, and replaced.
+    def listen
+      if File.socket?(path)
+        begin
+          UNIXSocket.open(path).close
+          raise Errno::EADDRINUSE, path
+        rescue Errno::ECONNREFUSED
+          File.unlink(path)
+        end
+      end
+      old = File.umask(0o077)
+      UNIXServer.new(path)
+    ensure
+      File.umask(old) if old
+    end
+
+    def trap_signals(server)
+      %w[INT TERM].each { |sig| Signal.trap(sig) { server.close } }
+    end
+
+    # Runs one request in this forked process, which it ends.
+    def serve(server, conn)
+      server.close
+      %w[INT TERM].each { |sig| Signal.trap(sig, 'DEFAULT') }
+      ios = Array.new(3) { conn.recv_io }
+      version, cwd, env, *argv = Client.read_frames(conn)
+      return Client.write_frame(conn, 'refused') unless version == VERSION
+
+      pid = fork do
+        Process.setpgid(0, 0)
+        # killed as the program the client stands for would be
+        %w[INT TERM].each { |sig| Signal.trap(sig, 'SYSTEM_DEFAULT') }
+        exit!(run_command(ios, cwd, Client.read_env(env), argv))
+      end
+      watch(conn, pid)
+      _, status = Process.wait2(pid)
+      Client.write_frame(conn, status.signaled? ? "signal #{status.termsig}" : status.exitstatus.to_s)
+    rescue SystemCallError, SocketError
+      nil # the client went away
+    ensure
+      exit!(0)
+    end
+
+    # Sends the signals the client relays on +conn+ to the process group of +pid+, and kills it when
+    # the client hangs up.
+    # @return [Thread]
+    def watch(conn, pid)
+      begin
+        # set here too, so no signal comes before the child has set it
+        Process.setpgid(pid, pid)
+      rescue Errno::ESRCH
+        nil # done already
+      end
+      Thread.new do
+        while (sig = Client.read_frame(conn))
+          signal_group(sig, pid) if Client::SIGNALS.include?(sig)
+        end
+        signal_group('KILL', pid)
+      rescue SystemCallError, IOError
+        signal_group('KILL', pid)
+      end
+    end
+
+    def signal_group(sig, pid)
+      Process.kill(sig, -pid)
+    rescue Errno::ESRCH
+      nil # all gone
+    end
+
+    # Runs +argv+ as +bin/seccomp-tools+ would, with the client's standard streams, directory and
+    # environment.
+    # @return [Integer] The exit status.
+    def run_command(ios, cwd, env, argv)
+      [$stdin, $stdout, $stderr].zip(ios) { |std, io| std.reopen(io) }
+      Dir.chdir(cwd)
+      ENV.replace(env)
+      ARGV.replace(argv)
+      CLI.work(argv)
+      0
+    rescue SystemExit => e
+      e.status
+    rescue StandardError => e
+      Logger.error("#{e.class}: #{e.message}")
+      1
+    ensure
+      [$stdout, $stderr].each(&:flush)
+    end
+  end
+end
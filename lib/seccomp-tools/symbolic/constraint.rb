@@ -13,6 +13,9 @@ module SeccompTools
     # or +k+, but A itself may hold the constant (e.g. +A = 5+ compared against a data word +tax+'d
     # into X earlier), and every consumer reads "expression op constant". So +Constraint.new(5, :>,
     # word)+ normalizes to +word < 5+ at construction - the two spellings are one value.
+    #
+    # Like {Expr}s, constraints are hash-consed, and held weakly: the same normalized comparison is
+    # always the same object while it is referred to, numbered by {#id}.
     class Constraint
       # The same comparison with its two sides swapped: +5 > x+ is +x < 5+. The bit tests are
       # symmetric (+&+ commutes).
@@ -20,6 +23,29 @@ module SeccompTools
         :== => :==, :!= => :!=, :> => :<, :>= => :<=, :< => :>, :<= => :>=, set: :set, unset: :unset
       }.freeze
 
+      # The comparison holding exactly when the other does not: the two sides of a jump.
+      NEGATE = {
+        :== => :!=, :!= => :==, :> => :<=, :<= => :>, :>= => :<, :< => :>=, set: :unset, unset: :set
+      }.freeze
+
+      # Numbers the operators in interning signatures, for the reason given at {Expr::CODES}.
+      CODES = MIRROR.keys.each_with_index.to_h.freeze
+
+      @table = Interner.new
+
+      class << self
+        # Returns the one constraint with these (normalized) contents, building it on first use.
+        # @param [Expr] lhs
+        # @param [Symbol] op
+        # @param [Expr] rhs
+        # @return [Constraint]
+        def new(lhs, op, rhs)
+          lhs, op, rhs = rhs, MIRROR[op], lhs if lhs.imm? && !rhs.imm? # keep the constant on the right
+          sig = [lhs.id, CODES[op], rhs.id]
+          @table.fetch(sig) { |id| super(lhs, op, rhs, id) }
+        end
+      end
+
       # Applies one of the constraint operators to concrete operands: the +jset+ bit tests
       # (+:set+/+:unset+) and the Integer comparisons. Stateless - used to evaluate a pinned
       # constraint or a candidate value, without building a {Constraint}.
@@ -42,15 +68,19 @@ module SeccompTools
       attr_reader :op
       # @return [Expr] The right-hand side (what it is compared against).
       attr_reader :rhs
+      # @return [Integer] Numbers this constraint among all the interned ones.
+      attr_reader :id
 
       # @param [Expr] lhs
       # @param [Symbol] op
       # @param [Expr] rhs
-      def initialize(lhs, op, rhs)
-        lhs, op, rhs = rhs, MIRROR[op], lhs if lhs.imm? && !rhs.imm? # keep the constant on the right
+      # @param [Integer] id
+      #   Assigned by {.new}, which has already normalized the sides.
+      def initialize(lhs, op, rhs, id)
         @lhs = lhs
         @op = op
         @rhs = rhs
+        @id = id
       end
 
       # Is this a fact about one plain data word compared against a constant - about the word at
@@ -69,11 +99,16 @@ module SeccompTools
         op == :== && plain_data_fact?(offset)
       end
 
-      # A string that uniquely identifies this constraint, for both equality and hashing; the
-      # +expr op expr+ counterpart of {Expr#key}, injective for the same reason.
-      # @return [String]
+      # Identifies this constraint for equality and hashing: its {#id}, the counterpart of
+      # {Expr#key}.
+      # @return [Integer]
       def key
-        @key ||= "#{lhs.key}#{op}#{rhs.key}"
+        id
+      end
+
+      # @return [Integer]
+      def hash
+        id.hash
       end
     end
   end
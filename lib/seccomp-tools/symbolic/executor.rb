@@ -4,6 +4,7 @@ require 'set'
 
 require 'seccomp-tools/symbolic/constraint'
 require 'seccomp-tools/symbolic/expr'
+require 'seccomp-tools/symbolic/path'
 require 'seccomp-tools/symbolic/state'
 
 module SeccompTools
@@ -22,20 +23,40 @@ module SeccompTools
     # read-only input buffer addressed by byte offset. Jumps are always forward, so a single walk
     # with a visited-set terminates and never loops.
     #
+    # Enumerating whole paths multiplies them at every join: a filter testing several arguments of
+    # a syscall and then continuing walks everything after those tests once per combination. So
+    # {#run} first walks the lines in order instead, merging the states that meet on a line with
+    # the same registers and scratch memory into as few path conditions as describe exactly the
+    # same inputs (see {#join}), which keeps the walk linear in the size of typical filters. Only
+    # when more than {MERGE_BOUND} states remain apart on one line does it fall back to enumerating
+    # paths.
+    #
     # @example
     #   # instructions come from `SeccompTools::Disasm.to_bpf(raw, arch).map(&:inst)`
     #   leaves, truncated = SeccompTools::Symbolic::Executor.new(instructions).run
     #   leaves.first.ret   #=> an Expr describing the returned value
     #   leaves.first.path  #=> the Array<Constraint> under which it is returned
     class Executor
-      # A reached +return+: the accumulated path condition, the value returned (an {Expr}), and the
-      # line the +return+ is on.
-      Leaf = Struct.new(:path, :ret, :line)
+      # A reached +return+: the accumulated path condition, the value returned (an {Expr}), the
+      # line the +return+ is on, and how many instructions the path executes, the +return+ included:
+      # +steps+ at least and +max_steps+ at most, the two differing when merged paths of different
+      # lengths reach the +return+ under one condition.
+      Leaf = Struct.new(:path, :ret, :line, :steps, :max_steps)
 
       # Upper bound on the number of states visited, so a pathological program cannot make the walk
       # run unboundedly. When hit, {#run} stops early and reports +truncated+.
       STEP_CAP = 100_000
 
+      # Upper bound on the states the merging walk keeps apart on one line. Past it, {#run} enumerates
+      # paths instead.
+      MERGE_BOUND = 64
+
+      # A state waiting on a line of the merging walk, with the fewest and the most instructions the
+      # paths it stands for have executed, and the order the path-enumerating walk would reach it
+      # in: the sides of each jump its first path takes, +0+ for not taken (walked first), +1+ for
+      # taken.
+      Entry = Struct.new(:state, :min, :max, :order)
+
       # Maps a comparison operator to the pair of {Constraint} operators implied on the taken and
       # not-taken branches (e.g. a +>=+ test learns +>=+ if taken, +<+ if not).
       SPLIT = {
@@ -48,8 +69,11 @@ module SeccompTools
       # @param [Array<Instruction::Base>] instructions
       #   The program to execute, as +SeccompTools::Disasm.to_bpf(raw, arch).map(&:inst)+. Only the
       #   duck-typed +#symbolize+ method is used, so any classic-BPF instruction set works.
-      def initialize(instructions)
+      # @param [Boolean] exact
+      #   Enumerate every path instead of merging states first, so each leaf is one path.
+      def initialize(instructions, exact: false)
         @instructions = instructions
+        @exact = exact
       end
 
       # Walks every path and returns the reachable leaves.
@@ -61,46 +85,224 @@ module SeccompTools
       # @return [Array(Array<Leaf>, Boolean)]
       #   The feasible leaves, and whether the walk was truncated at {STEP_CAP}.
       def run
+        merged = merge_walk unless @exact
+        return merged if merged
+
         leaves, truncated = walk
         [leaves.select { |leaf| feasible?(leaf.path) }, truncated]
       end
 
       private
 
+      # Walks the lines in order - every jump is forward, so all the states reaching a line are known
+      # by the time it is interpreted - joining the states that meet on each one. Paths are pruned
+      # as they grow, so the leaves need no {#feasible?} check.
+      # @return [Array(Array<Leaf>, false)?]
+      #   The leaves, or +nil+ when more than {MERGE_BOUND} states stay apart on one line.
+      def merge_walk
+        @cells = { Path.empty => [{}.freeze, {}.freeze] }
+        pending = Array.new(@instructions.size) { [] }
+        pending[0] << Entry.new(State.initial, 0, 0, '')
+        leaves = []
+        pending.each_index do |pc|
+          entries = join(pending[pc])
+          pending[pc] = nil
+          return nil if entries.size > MERGE_BOUND
+
+          entries.each { |entry| advance(pc, entry, pending, leaves) }
+        end
+        [leaves.each_with_index.sort_by { |(_, order), i| [order, i] }.map { |(leaf, _), _| leaf }, false]
+      end
+
+      # Interprets line +pc+ for +entry+, queueing its successors on their lines, or adding its
+      # {Leaf} to +leaves+ along with its order. A successor whose new fact contradicts its path is
+      # dropped right away, so it never keeps others from merging.
+      def advance(pc, entry, pending, leaves)
+        succ = []
+        found = []
+        step(pc, entry.state, entry.min + 1, found, succ)
+        found.each do |leaf|
+          leaf.max_steps = entry.max + 1
+          leaves << [leaf, entry.order]
+        end
+        succ.each_with_index do |(target, st, _), i|
+          next if target >= pending.size
+          next unless st.path.equal?(entry.state.path) || extends_feasibly?(st.path)
+
+          order = succ.size == 2 ? entry.order + (i.zero? ? '1' : '0') : entry.order
+          pending[target] << Entry.new(st, entry.min + 1, entry.max + 1, order)
+        end
+      end
+
+      # Is +path+ feasible, given that it was before its last fact was added? The same decision as
+      # {#cell_feasible?} on the word the fact is about, from {#cells} of the path before it: a
+      # pinned word decides the fact, and an unpinned one must keep a non-empty range, which an +==+
+      # must also not leave or contradict another fact of the word with.
+      def extends_feasibly?(path)
+        c = path.last
+        return true unless c.plain_data_fact?
+
+        offset = c.lhs.offset
+        eqs, bounds = cells(path.parent)
+        return Constraint.evaluate(eqs[offset], c.op, c.rhs.val) if eqs.key?(offset)
+
+        lo, hi = bound(bounds[offset], c)
+        return lo <= hi unless c.op == :==
+
+        lo <= c.rhs.val && c.rhs.val <= hi && path.parent.all? do |d|
+          !d.plain_data_fact?(offset) || Constraint.evaluate(c.rhs.val, d.op, d.rhs.val)
+        end
+      end
+
+      # What +path+ says about each data word on its own: the values +==+ facts pin words to, and the
+      # +[lo, hi]+ ranges the bound facts leave them, each keyed by offset. Derived from the path
+      # before the last fact and kept, so each costs one step.
+      # @return [Array({Integer => Integer}, {Integer => Array(Integer, Integer)})]
+      def cells(path)
+        @cells[path] ||= begin
+          eqs, bounds = cells(path.parent)
+          c = path.last
+          if !c.plain_data_fact? || eqs.key?(c.lhs.offset)
+            [eqs, bounds]
+          elsif c.op == :==
+            [eqs.merge(c.lhs.offset => c.rhs.val).freeze, bounds]
+          else
+            [eqs, bounds.merge(c.lhs.offset => bound(bounds[c.lhs.offset], c)).freeze]
+          end
+        end
+      end
+
+      # The range +range+ (the whole 32 bits when +nil+) narrowed by the fact +c+.
+      def bound(range, c)
+        lo, hi = range || [0, 0xffffffff]
+        case c.op
+        when :> then [[lo, c.rhs.val + 1].max, hi]
+        when :>= then [[lo, c.rhs.val].max, hi]
+        when :< then [lo, [hi, c.rhs.val - 1].min]
+        when :<= then [lo, [hi, c.rhs.val].min]
+        else [lo, hi]
+        end
+      end
+
+      # Merges the states meeting on one line. States differing in registers or scratch memory stay
+      # apart; of those that agree, the path conditions are rewritten into fewer ones covering
+      # exactly the same inputs, repeatedly:
+      # * the same path twice is one;
+      # * a path extending another is absorbed by it (whatever follows from the longer one also
+      #   follows from the shorter);
+      # * two paths alike but for one fact that the other one negates (+P, c, S+ and +P, !c, S+),
+      #   typically the two sides of a jump that meet again, are +P, S+.
+      # None of this loses a case, so the leaves describe what the filter does as exactly as whole
+      # paths do, in fewer and shorter conditions.
+      # @param [Array<Entry>] entries
+      # @return [Array<Entry>]
+      def join(entries)
+        return entries if entries.size < 2
+
+        entries.group_by { |e| e.state.machine_key }.flat_map do |_, group|
+          next group if group.size == 1
+
+          spans = {}
+          group.each { |e| widen(spans, e.state.path, [e.min, e.max, e.order]) }
+          nil while absorb(spans) || cancel(spans)
+          spans.map { |path, span| Entry.new(group.first.state.with(path:), *span) }
+        end.sort_by(&:order)
+      end
+
+      # Records that +path+ is reached as +span+ says: after +min+ to +max+ instructions, and in
+      # +order+.
+      def widen(spans, path, span)
+        old = spans[path]
+        spans[path] = old ? [[old[0], span[0]].min, [old[1], span[1]].max, [old[2], span[2]].min] : span
+      end
+
+      # Drops every path that extends another one in +spans+, returning whether any was.
+      def absorb(spans)
+        spans.keys.reduce(false) do |changed, path|
+          node = path.parent
+          node = node.parent until node.nil? || spans.key?(node)
+          next changed if node.nil?
+
+          widen(spans, node, spans.delete(path))
+          true
+        end
+      end
+
+      # Merges the pairs of paths alike but for a fact and its negation, returning whether it found
+      # any. Only paths of one length can pair up. Each fact of each such path is indexed by the
+      # path before it, what it compares and the facts after it (kept as an interned {Path}, newest
+      # first, so the key stays small); a fact meeting the index entry of its negation completes a
+      # pair.
+      def cancel(spans)
+        merged = spans.keys.group_by(&:size).values.flat_map do |paths|
+          next [] if paths.size < 2
+
+          seen = {}
+          paths.filter_map { |path| pair(path, seen) }
+        end
+        merged.each do |path, other, joined|
+          next unless spans.key?(path) && spans.key?(other)
+
+          widen(spans, joined, spans.delete(path))
+          widen(spans, joined, spans.delete(other))
+        end
+        !merged.empty?
+      end
+
+      # Indexes the facts of +path+ in +seen+ (see {#cancel}), returning +path+, the earlier path it
+      # pairs up with and the two joined, or +nil+ when it pairs with none.
+      def pair(path, seen)
+        node = path
+        after = Path.empty
+        until node.empty?
+          c = node.last
+          key = [node.parent.id, c.lhs.id, c.rhs.id, after.id]
+          other = seen[key + [Constraint::CODES[Constraint::NEGATE[c.op]]]]
+          return [path, other, after.to_a.reverse.reduce(node.parent) { |acc, d| acc.add(d) }] if other
+
+          seen[key << Constraint::CODES[c.op]] ||= path
+          after = after.add(c)
+          node = node.parent
+        end
+        nil
+      end
+
       # Depth-first walk of the control-flow graph. Because jumps are always forward, every successor
       # line is strictly greater, so the walk terminates; identical +(line, state)+ pairs are
-      # visited once so that re-merging control-flow does not explode.
+      # visited once so that re-merging control-flow does not explode. Each stack entry also counts
+      # the instructions executed to reach it, for {Leaf#steps}.
       # @return [Array(Array<Leaf>, Boolean)]
       def walk
         leaves = []
         visited = Set.new
-        stack = [[0, State.initial]]
+        stack = [[0, State.initial, 0]]
         steps = 0
         until stack.empty?
           return [leaves, true] if steps >= STEP_CAP
 
           steps += 1
-          pc, st = stack.pop
+          pc, st, depth = stack.pop
           next if pc >= @instructions.size
           next unless visited.add?([pc, st.key])
 
-          step(pc, st, leaves, stack)
+          step(pc, st, depth + 1, leaves, stack)
         end
         [leaves, false]
       end
 
       # Interprets one instruction symbolically, pushing the successor state(s) onto +stack+ (or
-      # appending a {Leaf} when it is a +return+).
-      def step(pc, st, leaves, stack)
+      # appending a {Leaf} when it is a +return+). +depth+ counts the instructions executed so far,
+      # this one included.
+      def step(pc, st, depth, leaves, stack)
         op, *args = @instructions[pc].symbolize
         case op
-        when :ret then leaves << Leaf.new(st.path, args[0] == :a ? st.a : Expr.imm(args[0]), pc)
-        when :ld then stack << [pc + 1, load(st, args[0], args[1])]
-        when :st then stack << [pc + 1, store(st, args[0], args[1])]
-        when :alu then stack << [pc + 1, st.with(a: st.a.apply(args[0], alu_operand(st, args[1])))]
-        when :misc then stack << [pc + 1, args[0] == :txa ? st.with(a: st.x) : st.with(x: st.a)]
-        when :jmp then stack << [pc + args[0] + 1, st]
-        when :cmp then branch_cmp(pc, st, args, stack)
+        when :ret then leaves << Leaf.new(st.path.to_a, args[0] == :a ? st.a : Expr.imm(args[0]), pc, depth, depth)
+        when :ld then stack << [pc + 1, load(st, args[0], args[1]), depth]
+        when :st then stack << [pc + 1, store(st, args[0], args[1]), depth]
+        when :alu then stack << [pc + 1, st.with(a: st.a.apply(args[0], alu_operand(st, args[1]))), depth]
+        when :misc then stack << [pc + 1, args[0] == :txa ? st.with(a: st.x) : st.with(x: st.a), depth]
+        when :jmp then stack << [pc + args[0] + 1, st, depth]
+        when :cmp then branch_cmp(pc, st, depth, args, stack)
         end
       end
 
@@ -133,20 +335,20 @@ module SeccompTools
       # each branch implies. A comparison between two constants (e.g. against the guaranteed-zero
       # initial A or X) does not fork: only the branch it actually selects is walked, and no fact
       # is recorded.
-      def branch_cmp(pc, st, args, stack)
+      def branch_cmp(pc, st, depth, args, stack)
         op, src, jt, jf = args
         # jt == jf: the jump is unconditional, so no fact is learned.
-        return stack << [pc + jt + 1, st] if jt == jf
+        return stack << [pc + jt + 1, st, depth] if jt == jf
 
         rhs = src == :x ? st.x : Expr.imm(src)
         taken, els = SPLIT[op]
         if st.a.imm? && rhs.imm?
           j = Constraint.evaluate(st.a.val, taken, rhs.val) ? jt : jf
-          return stack << [pc + j + 1, st]
+          return stack << [pc + j + 1, st, depth]
         end
 
-        stack << [pc + jt + 1, st.with(path: st.path + [Constraint.new(st.a, taken, rhs)])]
-        stack << [pc + jf + 1, st.with(path: st.path + [Constraint.new(st.a, els, rhs)])]
+        stack << [pc + jt + 1, st.with(path: st.path.add(Constraint.new(st.a, taken, rhs))), depth]
+        stack << [pc + jf + 1, st.with(path: st.path.add(Constraint.new(st.a, els, rhs))), depth]
       end
 
       # Is +path+ satisfiable? Deliberately a small rule-based check, not a solver.
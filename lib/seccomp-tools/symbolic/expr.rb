@@ -1,6 +1,7 @@
 # frozen_string_literal: true
 
 require 'seccomp-tools/instruction/alu'
+require 'seccomp-tools/symbolic/interner'
 
 module SeccompTools
   # Generic symbolic execution of classic BPF, with no seccomp knowledge. Where +SeccompTools::Emulator+
@@ -21,11 +22,36 @@ module SeccompTools
     # * {.unop} - a unary operation on a sub-expression; the only one BPF has is negation (+-A+).
     # * {.opaque} - a value we cannot describe (an unsupported operation, or one whose operand is
     #   itself opaque). Nothing can be concluded about it.
+    #
+    # Expressions are hash-consed: building one with the same contents as an existing one returns
+    # that very object, so equal expressions are identical, compare in O(1), and carry a small
+    # integer {#id} that the {Constraint}s, {Path}s and {State}s built on them key on. The
+    # {Interner} holds them weakly, so those no walk refers to any more are collected.
     class Expr
       # The binary ALU operators {#apply} accepts - exactly the ones +Instruction::ALU#symbolize+
       # can produce (its unary +neg+ is handled separately).
       REPRESENTABLE = Instruction::ALU::OP_SYM.values.freeze
 
+      # Numbers the kinds and operators in interning signatures. Integers rather than the symbols
+      # themselves, because Ruby's +Symbol#hash+ maps the operators to very few values (+:==+ and
+      # +:!=+ hash alike), which would collapse the signatures' hashes.
+      CODES = (%i[imm data binop unop opaque neg] + REPRESENTABLE).each_with_index.to_h.freeze
+
+      @table = Interner.new
+
+      class << self
+        # Returns the one expression with these contents, building it on first use.
+        # @param [:imm, :data, :binop, :unop, :opaque] kind
+        # @param [Hash] fields
+        #   See {#initialize}.
+        # @return [Expr]
+        def new(kind, **fields)
+          sig = [CODES[kind], fields[:val] || fields[:offset], fields[:op] && CODES[fields[:op]],
+                 fields[:lhs]&.id, fields[:rhs]&.id]
+          @table.fetch(sig) { |id| super(kind, id:, **fields) }
+        end
+      end
+
       # @return [:imm, :data, :binop, :unop, :opaque] Which kind of expression this is.
       attr_reader :kind
       # @return [Integer?] The constant, when +kind+ is +:imm+.
@@ -37,6 +63,8 @@ module SeccompTools
       # @return [Expr?] The left and right operands, when +kind+ is +:binop+; a +:unop+ keeps its
       #   only operand in +lhs+.
       attr_reader :lhs, :rhs
+      # @return [Integer] Numbers this expression among all the interned ones.
+      attr_reader :id
 
       # A known constant.
       # @param [Integer] val
@@ -77,10 +105,13 @@ module SeccompTools
       end
 
       # @param [:imm, :data, :binop, :unop, :opaque] kind
+      # @param [Integer] id
+      #   Assigned by {.new}.
       # @param [Hash] fields
       #   The kind-specific fields: +:val+, +:offset+, +:op+, +:lhs+, +:rhs+.
-      def initialize(kind, **fields)
+      def initialize(kind, id:, **fields)
         @kind = kind
+        @id = id
         @val = fields[:val]
         @offset = fields[:offset]
         @op = fields[:op]
@@ -124,35 +155,23 @@ module SeccompTools
         Expr.binop(op, self, operand)
       end
 
-      # A string that uniquely identifies this expression, used for both equality and hashing;
-      # memoized, since an {Expr} is immutable. The operator is written as text, not left a {Symbol},
-      # because Ruby's +Symbol#hash+ maps the operators to very few values (+:==+ and +:!=+ hash
-      # alike) - a key carrying them would collapse when hashed and drag the walk's visited +Set+
-      # down to a linear scan; a string hashes over its bytes cleanly. The encoding is injective
-      # (leaves are +i<val>+ / +d<offset>+ / +o+, compounds are parenthesised, and no operator
-      # contains a leaf-start char, a digit, or the +;+ / +,+ that {State} joins with), so it is
-      # safe to compare on.
-      # @return [String]
+      # Identifies this expression for equality and hashing: its {#id}, which interning makes
+      # equal for equal contents.
+      # @return [Integer]
       def key
-        @key ||= case kind
-                 when :binop then "(#{lhs.key}#{op}#{rhs.key})"
-                 when :unop  then "(#{op}#{lhs.key})"
-                 when :imm   then "i#{val}"
-                 when :data  then "d#{offset}"
-                 else 'o'
-                 end
+        id
       end
 
       # @param [Expr] other
       # @return [Boolean]
       def ==(other)
-        other.is_a?(Expr) && key == other.key
+        equal?(other)
       end
       alias eql? ==
 
       # @return [Integer]
       def hash
-        key.hash
+        id.hash
       end
 
       # Folds a binary ALU operation on two constants, wrapping to 32 bits (classic BPF is 32-bit).
@@ -0,0 +1,66 @@
+# frozen_string_literal: true
+
+module SeccompTools
+  module Symbolic
+    # The table behind hash-consing ({Expr}, {Constraint}, {Path}, and {State}'s scratch memory): it
+    # returns the one live object built for a signature, building it on first use.
+    #
+    # The objects are held weakly, so one nothing else refers to any more - say, from a walk over a
+    # filter long done with - is collected and the table does not grow with every filter a process
+    # analyzes. A signature whose object was collected builds a new one, with a new id: ids are never
+    # reused, so a signature holding the ids of live objects always means the same contents.
+    class Interner
+      # The table is swept of the signatures of collected objects once it holds this many, or twice as
+      # many as after the last sweep.
+      SWEEP_MIN = 4096
+
+      # @param [Integer] first_id
+      #   The first id handed out.
+      def initialize(first_id = 0)
+        @ids = {}
+        @objects = ObjectSpace::WeakMap.new
+        @next_id = first_id
+        @sweep_at = SWEEP_MIN
+        @mutex = Mutex.new
+      end
+
+      # The live object interned under +sig+, or the one the block builds.
+      # @param [Array<Integer>] sig
+      #   Identifies the contents; must only hold the ids of live objects.
+      # @yieldparam [Integer] id
+      #   A fresh id for the object.
+      # @yieldreturn [Object]
+      # @return [Object]
+      def fetch(sig)
+        live(sig) || @mutex.synchronize do
+          live(sig) || begin
+            sweep if @ids.size >= @sweep_at
+            id = @next_id
+            @next_id += 1
+            obj = yield(id)
+            @objects[id] = obj
+            @ids[sig] = id
+            obj
+          end
+        end
+      end
+
+      # @return [Integer] Number of signatures held, some of whose objects may have been collected.
+      def size
+        @ids.size
+      end
+
+      private
+
+      def live(sig)
+        id = @ids[sig]
+        id && @objects[id]
+      end
+
+      def sweep
+        @ids.delete_if { |_, id| !@objects.key?(id) }
+        @sweep_at = [2 * @ids.size, SWEEP_MIN].max
+      end
+    end
+  end
+end
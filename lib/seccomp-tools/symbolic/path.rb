@@ -0,0 +1,116 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/symbolic/constraint'
+
+module SeccompTools
+  module Symbolic
+    # A path condition: the {Constraint}s a walk has assumed to get somewhere, oldest first.
+    #
+    # A path is a persistent linked list - {#add} returns a new path whose tail is this one - so the
+    # two branches of a conditional jump share everything before it instead of each copying it.
+    # Paths are also hash-consed like {Expr}s: adding the same constraint to the same path yields the
+    # same object while it is referred to, so two walks reaching a line under the same facts hold one
+    # {#id}, and comparing them costs nothing.
+    class Path
+      include Enumerable
+
+      @table = Interner.new(1)
+
+      class << self
+        # @return [Path] The path with no constraints, the root of all others.
+        attr_reader :empty
+
+        # The path holding +constraints+, oldest first.
+        # @param [Array<Constraint>, Path] constraints
+        # @return [Path]
+        def [](constraints)
+          return constraints if constraints.is_a?(Path)
+
+          constraints.reduce(empty) { |path, c| path.add(c) }
+        end
+
+        # @private
+        def intern(parent, constraint)
+          sig = [parent.id, constraint.id]
+          @table.fetch(sig) { |id| new(parent, constraint, id) }
+        end
+      end
+
+      # @return [Path?] The path before {#last} was added; +nil+ for {.empty}.
+      attr_reader :parent
+      # @return [Constraint?] The latest constraint; +nil+ for {.empty}.
+      attr_reader :last
+      # @return [Integer] Numbers this path among all the interned ones; +0+ is {.empty}.
+      attr_reader :id
+      # @return [Integer] The number of constraints.
+      attr_reader :size
+
+      # @param [Path?] parent
+      # @param [Constraint?] last
+      # @param [Integer] id
+      def initialize(parent, last, id)
+        @parent = parent
+        @last = last
+        @id = id
+        @size = parent ? parent.size + 1 : 0
+      end
+      private_class_method :new
+
+      @empty = new(nil, nil, 0)
+
+      # This path with +constraint+ assumed after the rest.
+      # @param [Constraint] constraint
+      # @return [Path]
+      def add(constraint)
+        Path.intern(self, constraint)
+      end
+
+      # @return [Boolean]
+      def empty?
+        size.zero?
+      end
+
+      # Yields the constraints, oldest first.
+      # @yieldparam [Constraint] constraint
+      # @return [self, Enumerator]
+      def each(&)
+        return enum_for(:each) { size } unless block_given?
+
+        to_a.each(&)
+        self
+      end
+
+      # @return [Array<Constraint>] The constraints, oldest first (a frozen array, built once).
+      def to_a
+        @to_a ||= begin
+          list = []
+          node = self
+          until node.empty?
+            list << node.last
+            node = node.parent
+          end
+          list.reverse!.freeze
+        end
+      end
+      alias to_ary to_a
+
+      # Interning makes equal paths the same object; a path also equals the array of its constraints.
+      # @param [Path, Array<Constraint>] other
+      # @return [Boolean]
+      def ==(other)
+        other.is_a?(Path) ? equal?(other) : other.is_a?(Array) && to_a == other
+      end
+
+      # @param [Object] other
+      # @return [Boolean]
+      def eql?(other)
+        equal?(other)
+      end
+
+      # @return [Integer]
+      def hash
+        id.hash
+      end
+    end
+  end
+end
@@ -1,6 +1,7 @@
 # frozen_string_literal: true
 
 require 'seccomp-tools/symbolic/expr'
+require 'seccomp-tools/symbolic/path'
 
 module SeccompTools
   module Symbolic
@@ -18,44 +19,68 @@ module SeccompTools
       attr_reader :x
       # @return [Array<Expr>] The 16 scratch-memory slots (+mem[0..15]+).
       attr_reader :mem
-      # @return [Array<Constraint>] The path condition accumulated so far.
+      # @return [Path] The path condition accumulated so far.
       attr_reader :path
 
+      @mems = Interner.new
+
+      # The one frozen scratch memory with the contents of +mem+, interned as {Expr}s are; its
+      # +object_id+ numbers the distinct contents.
+      # @param [Array<Expr>] mem
+      # @return [Array<Expr>]
+      def self.intern_mem(mem)
+        @mems.fetch(mem.map(&:id)) { mem.frozen? ? mem : mem.dup.freeze }
+      end
+
       # The starting state, as the kernel sets it up: both registers zero (a classic BPF program is
       # guaranteed +A = X = 0+ on entry - the cBPF-to-eBPF converter clears them first), the
       # scratch slots unknown, and no facts assumed. The slots stay {Expr.opaque} because nothing
       # can rely on them: the kernel rejects a filter that reads a slot before writing it.
       # @return [State]
       def self.initial
-        new(a: Expr.imm(0), x: Expr.imm(0), mem: Array.new(16, Expr.opaque), path: [])
+        new(a: Expr.imm(0), x: Expr.imm(0), mem: Array.new(16, Expr.opaque), path: Path.empty)
       end
 
       # @param [Expr] a
       # @param [Expr] x
       # @param [Array<Expr>] mem
-      # @param [Array<Constraint>] path
-      def initialize(a:, x:, mem:, path:)
+      # @param [Path, Array<Constraint>] path
+      # @param [Integer?] mem_id
+      #   The number {#key} gives +mem+, when the caller already knows it (+mem+ then being the
+      #   interned one, see {.intern_mem}).
+      def initialize(a:, x:, mem:, path:, mem_id: nil)
         @a = a
         @x = x
         @mem = mem
-        @path = path
+        @path = Path[path]
+        @mem_id = mem_id
       end
 
       # Returns a copy with the given fields replaced; unreplaced fields are shared (the state is
       # immutable).
       # @return [State]
       def with(a: @a, x: @x, mem: @mem, path: @path)
-        State.new(a:, x:, mem:, path:)
+        State.new(a:, x:, mem:, path:, mem_id: mem.equal?(@mem) ? @mem_id : nil)
       end
 
-      # A string that identifies this state exactly, joined from each part's {Expr#key} /
-      # {Constraint#key} (the same identity, one level up). The walk uses it to skip a
-      # +(line, state)+ pair it has already visited, which keeps merging control-flow from blowing
-      # up. Both {#==} and {#hash} are decided on it; see {Expr#key} for why the key is a string.
-      # The +;+ / +,+ separators appear in no part's key, so the join stays injective.
-      # @return [String]
+      # Identifies this state exactly: the ids of its registers, scratch memory and path, which
+      # interning makes equal for equal contents. The walk uses it to skip a +(line, state)+ pair it
+      # has already visited, which keeps merging control-flow from blowing up. Both {#==} and
+      # {#hash} are decided on it. The state holds on to its interned scratch memory from then on,
+      # so the number stays that of its contents.
+      # @return [Array<Integer>]
       def key
-        @key ||= "#{a.key};#{x.key};#{mem.map(&:key).join(',')};#{path.map(&:key).join(',')}"
+        @key ||= begin
+          @mem, @mem_id = State.intern_mem(@mem).then { |m| [m, m.object_id] } unless @mem_id
+          [a.id, x.id, @mem_id, path.id]
+        end
+      end
+
+      # Identifies the registers and scratch memory, leaving out the path: states with the same
+      # machine key run the rest of the program alike, under their own conditions.
+      # @return [Array<Integer>]
+      def machine_key
+        key.take(3)
       end
 
       # The constant the data word at byte +offset+ is pinned to on this path (by an +==+ fact), or
@@ -8,15 +8,17 @@ require 'seccomp-tools/ptrace' if SeccompTools::Util.linux?
 module SeccompTools
   # Record syscall number, arguments, return value.
   class Syscall
-    # Syscall arguments offset of +struct user+ in different arch.
+    # Word size in bits, and syscall register offsets into the +NT_PRSTATUS+ regset (+struct user+),
+    # of different arch. The offsets are only needed when the kernel lacks +PTRACE_GET_SYSCALL_INFO+,
+    # see {Ptrace.syscall_info}.
     ABI = {
-      amd64: { number: 120, args: [112, 104, 96, 56, 72, 44], ret: 80, SYS_prctl: 157, SYS_seccomp: 317 },
-      i386: { number: 44, args: [0, 4, 8, 12, 16, 20], ret: 24, SYS_prctl: 172, SYS_seccomp: 354 },
-      aarch64: { number: 64, args: [0, 8, 16, 24, 32, 40, 48], ret: 0, SYS_prctl: 167, SYS_seccomp: 277 },
-      riscv64: { number: 136, args: [80, 88, 96, 104, 112, 120], ret: 80, SYS_prctl: 167, SYS_seccomp: 277 },
+      amd64: { bits: 64, number: 120, args: [112, 104, 96, 56, 72, 44], ret: 80, SYS_prctl: 157, SYS_seccomp: 317 },
+      i386: { bits: 32, number: 44, args: [0, 4, 8, 12, 16, 20], ret: 24, SYS_prctl: 172, SYS_seccomp: 354 },
+      aarch64: { bits: 64, number: 64, args: [0, 8, 16, 24, 32, 40, 48], ret: 0, SYS_prctl: 167, SYS_seccomp: 277 },
+      riscv64: { bits: 64, number: 136, args: [80, 88, 96, 104, 112, 120], ret: 80, SYS_prctl: 167, SYS_seccomp: 277 },
       # Most software invokes syscalls through "svc 0", in which case the syscall number is in r1.
       # However, it's also possible to use "svc NR": this case is not handled here.
-      s390x: { number: 24, args: [32, 40, 48, 56, 64, 72], ret: 32, SYS_prctl: 172, SYS_seccomp: 348 }
+      s390x: { bits: 64, number: 24, args: [32, 40, 48, 56, 64, 72], ret: 32, SYS_prctl: 172, SYS_seccomp: 348 }
     }.freeze
 
     # @return [Integer] Id of the traced process.
@@ -24,29 +26,27 @@ module SeccompTools
     # @return [{Symbol => Integer, Array<Integer>}]
     #   The {ABI} entry of this syscall's architecture.
     attr_reader :abi
-    # @return [Integer] Syscall number.
+    # @return [Integer?] Syscall number, +nil+ at a syscall exit when read through +PTRACE_GET_SYSCALL_INFO+.
     attr_reader :number
-    # @return [Array<Integer>] Syscall arguments, in register order.
+    # @return [Array<Integer>?] Syscall arguments, in register order. +nil+ when {#number} is.
     attr_reader :args
-    # @return [Integer] Syscall return value.
+    # @return [Integer?] Syscall return value, +nil+ at a syscall entry when read through +PTRACE_GET_SYSCALL_INFO+.
     attr_reader :ret
 
     # Instantiate a {Syscall} object.
     #
-    # Reads the syscall number, arguments and return value of +pid+ through ptrace, so the process
-    # must already be stopped and attached.
+    # Reads the syscall number, arguments and return value of +pid+ in a single ptrace call (see
+    # {Ptrace.syscall_info}), so the process must already be stopped and attached.
     # @param [Integer] pid
     #   Id of the traced process.
     # @raise [ArgumentError]
     #   If the architecture of +pid+ is not one of {ABI}'s keys.
     def initialize(pid)
       @pid = pid
-      raise ArgumentError, "Only supports #{ABI.keys.join(', ')}" if ABI[arch].nil?
-
+      @number, @args, @ret, audit = Ptrace.syscall_info(pid) { layout }
+      @arch = Const::Audit.arch_symbol(audit) if audit
       @abi = ABI[arch]
-      @number = peek(abi[:number])
-      @args = abi[:args].map { |off| peek(off) }
-      @ret = peek(abi[:ret])
+      raise ArgumentError, "Only supports #{ABI.keys.join(', ')}" if abi.nil?
     end
 
     # Is this a seccomp installation syscall?
@@ -77,6 +77,16 @@ module SeccompTools
       number == abi[:SYS_prctl] && args[0] == Const::BPF::PR_SET_SECCOMP && args[1] == Const::BPF::SECCOMP_MODE_STRICT
     end
 
+    # Are the arguments of this strict-mode installation ones the kernel accepts? +seccomp+ wants
+    # its flags and pointer zero, and +prctl+ ignores the rest. libseccomp, for one, probes with
+    # +seccomp(SECCOMP_SET_MODE_STRICT, 1, NULL)+, which fails whatever the mode.
+    #
+    # Only meaningful when {#strict_mode?} is +true+.
+    # @return [Boolean]
+    def strict_args_valid?
+      number != abi[:SYS_seccomp] || (args[1].zero? && args[2].zero?)
+    end
+
     # Constructs a BPF program equivalent to what +SECCOMP_MODE_STRICT+ enforces: only read, write,
     # exit, and sigreturn are allowed, while any other syscall kills the thread.
     #
@@ -102,23 +112,60 @@ module SeccompTools
       EOS
     end
 
+    # Constructs the filter {Dumper} installs in trap mode, before executing the target: it returns
+    # +TRACE+ for +seccomp+ and +prctl(PR_SET_SECCOMP, ...)+ on every architecture of {ABI} and
+    # +ALLOW+ for anything else, so the tracer is stopped only at seccomp installations.
+    #
+    # @param [Symbol] arch
+    #   Architecture of the host, which decides the byte order of +args[0]+.
+    # @return [String]
+    #   Raw BPF bytes.
+    def self.trap_bpf(arch)
+      require 'seccomp-tools/asm/asm'
+
+      dispatch = ABI.keys.map { |a| "A == #{Const::Audit::ARCH_NAME[a]} ? #{a} : next" }
+      checks = ABI.map do |a, abi|
+        <<-EOS
+        #{a}:
+        A = sys_number
+        A == #{abi[:SYS_seccomp]} ? trace : next
+        A == #{abi[:SYS_prctl]} ? prctl : allow
+        EOS
+      end
+      Asm.asm(<<-EOS, arch: arch)
+        A = arch
+        #{dispatch.join("\n")}
+        return ALLOW
+        #{checks.join}
+        prctl:
+        A = args[0]
+        A == #{Const::BPF::PR_SET_SECCOMP} ? trace : allow
+        trace:
+        return TRACE
+        allow:
+        return ALLOW
+      EOS
+    end
+
     # Dumps the BPF of the filter being installed.
     #
     # Only meaningful when {#set_seccomp?} is +true+. In filter mode +args[2]+ points to a
-    # +struct sock_fprog+ in the traced process, whose BPF bytes are read out. Strict mode installs
+    # +struct sock_fprog+ in the traced process, whose BPF bytes are read out with two
+    # {Ptrace.read_memory} calls: the header, then the whole instruction array. Strict mode installs
     # no BPF, so an equivalent filter built by {.strict_bpf} is returned instead.
     # @return [String]
     #   The raw BPF bytes of the filter being installed.
     def dump_bpf
       return self.class.strict_bpf(arch) if strict_mode?
 
-      addr = args[2]
-      len = Ptrace.peekdata(pid, addr, 0) & 0xffff # len is unsigned short
-      filter = Ptrace.peekdata(pid, addr + (bits / 8), 0) & ((1 << bits) - 1)
-      Array.new(len) { |i| Ptrace.peekdata(pid, filter + (i * 8), 0) }.pack('Q*')
+      # struct sock_fprog { unsigned short len; struct sock_filter *filter; }, the pointer aligned to its size
+      ptr = abi[:bits] / 8
+      len, filter = Ptrace.read_memory(pid, args[2], ptr * 2).unpack(ptr == 4 ? 'SxxL' : 'Sx6Q')
+      Ptrace.read_memory(pid, filter, len * 8)
     end
 
-    # Architecture of this syscall, i.e. of the traced process.
+    # Architecture of this syscall: as reported by +PTRACE_GET_SYSCALL_INFO+, otherwise that of the
+    # traced process.
     # @return [Symbol?]
     #   See {SeccompTools::Util.process_arch}.
     def arch
@@ -127,18 +174,11 @@ module SeccompTools
 
     private
 
-    def bits
-      {
-        i386: 32,
-        amd64: 64,
-        aarch64: 64,
-        riscv64: 64,
-        s390x: 64
-      }[arch]
-    end
+    # The register layout {Ptrace.syscall_info} falls back to: +[bits, number, ret, *args]+.
+    def layout
+      raise ArgumentError, "Only supports #{ABI.keys.join(', ')}" if ABI[arch].nil?
 
-    def peek(offset)
-      Ptrace.peekuser(pid, offset, 0, bits)
+      ABI[arch].values_at(:bits, :number, :ret) + ABI[arch][:args]
     end
   end
 end
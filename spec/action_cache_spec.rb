@@ -0,0 +1,138 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/action_cache'
+require 'seccomp-tools/asm/asm'
+require 'seccomp-tools/disasm/disasm'
+require 'seccomp-tools/optimizer'
+require 'seccomp-tools/util'
+
+describe SeccompTools::ActionCache do
+  before { SeccompTools::Util.disable_color! }
+
+  def insts_of(raw, arch = :amd64)
+    SeccompTools::Disasm.to_bpf(raw, arch).map(&:inst)
+  end
+
+  def data(name)
+    File.binread(File.join(__dir__, 'data', name))
+  end
+
+  def cache_of(raw, arch = :amd64)
+    described_class.new(insts_of(raw, arch), arch:)
+  end
+
+  def section_of(raw, arch = :amd64)
+    cache_of(raw, arch).analyze.sections.first
+  end
+
+  # read checks its arguments but allows every value; ioctl's action depends on them.
+  let(:hoistable) do
+    SeccompTools::Asm.asm(<<-EOS, arch: :amd64)
+      A = arch
+      A == ARCH_X86_64 ? next : kill
+      A = sys_number
+      A == read ? read : next
+      A == write ? allow : next
+      A == ioctl ? ioctl : next
+      return ERRNO(1)
+      read:
+      A = args[0]
+      A == 0 ? allow : next
+      return ALLOW
+      ioctl:
+      A = args[1]
+      A == 0x5401 ? allow : next
+      return ERRNO(25)
+      allow:
+      return ALLOW
+      kill:
+      return KILL
+    EOS
+  end
+
+  it 'caches every allowed syscall of a filter that checks only nr and arch' do
+    report = cache_of(data('libseccomp.bpf')).analyze
+    expect(report.sections.map(&:arch)).to eq %w[amd64 i386]
+    amd64, i386 = report.sections
+    expect(amd64.entries).to all(have_attributes(cacheable: true))
+    expect(amd64.entries.map(&:name)).to include('write')
+    expect(i386.entries).to be_empty
+  end
+
+  it 'explains where the emulation stops for an uncached syscall' do
+    section = section_of(hoistable)
+    expect(section.cached.map(&:name)).to eq %w[write]
+    read, ioctl = section.uncached
+    expect(read).to have_attributes(name: 'read', line: 7, instruction: 'A = args[0]', reason: :args,
+                                    hoistable: true)
+    expect(ioctl).to have_attributes(name: 'ioctl', reason: :args, hoistable: false)
+  end
+
+  it 'names the reason of each blocking instruction' do
+    raw = SeccompTools::Asm.asm(<<-EOS, arch: :amd64)
+      A = sys_number
+      A == read ? ip : next
+      A == write ? alu : next
+      A == close ? x : next
+      return KILL
+      ip:
+      A = instruction_pointer >> 32
+      return ALLOW
+      alu:
+      A += 0
+      return ALLOW
+      x:
+      X = 1
+      return ALLOW
+    EOS
+    reasons = section_of(raw).uncached.to_h { |e| [e.name, e.reason] }
+    expect(reasons).to eq('read' => :instruction_pointer, 'write' => :alu, 'close' => :other)
+  end
+
+  it 'follows A &= k and jset like the kernel' do
+    raw = SeccompTools::Asm.asm(<<-EOS, arch: :amd64)
+      A = sys_number
+      A &= 0xfffffffe
+      A == 0 ? allow : next
+      A & 0x40000000 ? kill : next
+      return ERRNO(1)
+      allow:
+      return ALLOW
+      kill:
+      return KILL
+    EOS
+    cache = cache_of(raw)
+    expect(cache.cacheable?(:amd64, 0)).to be true
+    expect(cache.cacheable?(:amd64, 1)).to be true
+    expect(cache.cacheable?(:amd64, 2)).to be false
+    # the walk cannot follow the ALU, so it finds ALLOW reachable for every syscall; the emulation
+    # knows better and lists only read and write
+    expect(cache.analyze.sections.first.entries.map(&:name)).to eq %w[read write]
+  end
+
+  it 'sees the filter from the compat architecture too' do
+    report = cache_of(data('CONFidence-2017-amigo.bpf')).analyze
+    amd64, i386 = report.sections
+    expect(amd64.cached).to be_empty
+    expect(i386.cached.size).to be > 0
+    expect(i386.uncached.map(&:name)).to include('kill')
+  end
+
+  it 'caches the always-allowed syscalls once optimized' do
+    optimized = SeccompTools::Optimizer.new(hoistable, arch: :amd64).optimize
+    section = section_of(optimized)
+    expect(section.cached.map(&:name)).to eq %w[read write]
+    expect(section.uncached.map(&:name)).to eq %w[ioctl]
+  end
+
+  it 'intersects stacked filters' do
+    allow_all = SeccompTools::Asm.asm('return ALLOW', arch: :amd64)
+    reports = [allow_all, hoistable].map { |raw| cache_of(raw).analyze }
+    stacked = described_class::Report.stack(reports, source: 'both')
+    amd64 = stacked.sections.first
+    expect(amd64.entries.map(&:name)).to eq %w[read write ioctl]
+    expect(amd64.cached.map(&:name)).to eq %w[write]
+    expect(stacked.to_s).to include('Action cache of both', '1 of 3 allowed syscalls cached',
+                                    'read   0007: A = args[0]')
+  end
+end
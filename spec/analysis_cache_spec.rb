@@ -0,0 +1,120 @@
+# encoding: ascii-8bit
+# frozen_string_literal: true
+
+require 'tmpdir'
+
+require 'seccomp-tools/analysis_cache'
+require 'seccomp-tools/disasm/disasm'
+require 'seccomp-tools/symbolic/executor'
+
+describe SeccompTools::AnalysisCache do
+  around do |example|
+    Dir.mktmpdir do |dir|
+      @dir = dir
+      example.run
+    end
+  end
+
+  def cache(**opt)
+    described_class.new(dir: @dir, **opt)
+  end
+
+  def fixture(name)
+    File.binread(File.join(__dir__, 'data', name))
+  end
+
+  def entries
+    Dir[File.join(@dir, '*', '*')]
+  end
+
+  it 'computes a result once and serves it afterwards' do
+    calls = 0
+    2.times do
+      value = cache.fetch(:test, 'raw', :amd64) do
+        calls += 1
+        [1, 'two']
+      end
+      expect(value).to eq [1, 'two']
+    end
+    expect(calls).to eq 1
+    expect(entries.size).to eq 1
+  end
+
+  it 'keys results by kind, bytes, architecture and extra inputs' do
+    cache.fetch(:test, 'raw', :amd64) { 1 }
+    [[:other, 'raw', :amd64], [:test, 'raw2', :amd64], [:test, 'raw', :i386], [:test, 'raw', :amd64, true]]
+      .each { |key| expect(cache.fetch(*key) { 2 }).to eq 2 }
+    expect(entries.size).to eq 5
+  end
+
+  it 'stores walks that compare equal to fresh ones' do
+    %w[libseccomp.bpf twctf-2016-diary.bpf tctf-2023-nothing-is-true.bpf].each do |name|
+      raw = fixture(name)
+      fresh = SeccompTools::Symbolic::Executor.new(SeccompTools::Disasm.to_bpf(raw, :amd64).map(&:inst)).run
+      cache.walk(raw, :amd64) { fresh }
+      leaves, truncated = cache.walk(raw, :amd64) { raise 'walked again' }
+      expect(truncated).to eq fresh.last
+      expect(leaves).to eq fresh.first
+      expect(leaves.map(&:ret)).to all(satisfy { |e| fresh.first.any? { |l| l.ret.equal?(e) } })
+    end
+  end
+
+  it 'evicts the least recently used entries past its size bound' do
+    small = cache(max_bytes: 2048)
+    payload = Random.new(0).bytes(900)
+    small.fetch(:test, 'a', :amd64) { payload }
+    small.fetch(:test, 'b', :amd64) { payload }
+    File.utime(Time.now - 60, Time.now - 60, *entries)
+    small.fetch(:test, 'a', :amd64) { raise 'evicted too early' }
+    small.fetch(:test, 'c', :amd64) { payload }
+    expect(entries.size).to eq 2
+    expect(small.fetch(:test, 'a', :amd64) { :gone }).to eq payload
+    expect(small.fetch(:test, 'b', :amd64) { :gone }).to eq :gone
+  end
+
+  it 'treats an unreadable entry as a miss' do
+    cache.fetch(:test, 'raw', :amd64) { 1 }
+    File.binwrite(entries.first, 'garbage')
+    expect(cache.fetch(:test, 'raw', :amd64) { 2 }).to eq 2
+    expect(cache.fetch(:test, 'raw', :amd64) { 3 }).to eq 2
+  end
+
+  it 'creates its directory accessible to its user only' do
+    nested = described_class.new(dir: File.join(@dir, 'cache'))
+    nested.fetch(:test, 'raw', :amd64) { 1 }
+    expect(File.stat(nested.dir).mode & 0o777).to eq 0o700
+    expect(nested.fetch(:test, 'raw', :amd64) { 2 }).to eq 1
+  end
+
+  it 'leaves alone a directory others may write to or own' do
+    allow(SeccompTools::Logger).to receive(:warn)
+    File.chmod(0o777, @dir)
+    expect(cache.fetch(:test, 'raw', :amd64) { 1 }).to eq 1
+    expect(cache.fetch(:test, 'raw', :amd64) { 2 }).to eq 2
+    expect(entries).to be_empty
+    File.chmod(0o700, @dir)
+    uid = Process.uid
+    allow(Process).to receive(:uid).and_return(uid + 1)
+    expect(cache.fetch(:test, 'raw', :amd64) { 3 }).to eq 3
+    expect(entries).to be_empty
+  end
+
+  it 'warns once about a directory it leaves alone' do
+    File.chmod(0o777, @dir)
+    shared = cache
+    expect { 2.times { shared.fetch(:test, 'raw', :amd64) { 1 } } }
+      .to output("[WARN] Not using the cache at #{@dir}: another user owns it or may write to it.\n").to_stderr
+  end
+
+  it 'is safe for concurrent writers' do
+    pids = Array.new(4) do |i|
+      fork do
+        50.times { |j| cache.fetch(:test, (j % 5).to_s, :amd64) { [j % 5, i] * 100 } }
+        exit!(0)
+      end
+    end
+    pids.each { |pid| Process.wait(pid) }
+    expect(Dir[File.join(@dir, '**', '*.tmp')]).to be_empty
+    5.times { |k| expect(cache.fetch(:test, k.to_s, :amd64) { :miss }.first).to eq k }
+  end
+end
@@ -1,6 +1,7 @@
 # frozen_string_literal: true
 
 require 'seccomp-tools/asm/compiler'
+require 'seccomp-tools/emulator'
 require 'seccomp-tools/error'
 
 describe SeccompTools::Asm::Compiler do
@@ -255,7 +256,7 @@ label: A = X
       EOS
     end
 
-    it 'raises on long jump' do
+    it 'relaxes a long jump' do
       compiler = described_class.new(<<-EOS, nil, :amd64)
        A = args[0]
        A == 0 ? next : end
@@ -263,11 +264,70 @@ label: A = X
 end:   return ALLOW
       EOS
 
-      expect { compiler.compile! }.to raise_error(SeccompTools::LongJumpError, <<-EOS)
-<inline>:2:24 Does not support jumping farther than 255, got: 260
-       A == 0 ? next : end
-                       ^^^
+      # a copy of the return within reach, jumped over by the path falling through
+      bpfs = compiler.compile!
+      expect(bpfs.size).to eq 265
+      expect(bpfs[1].decompile).to eq 'if (A != 0) goto 0256'
+      expect(bpfs[255].decompile).to eq 'goto 0257'
+      expect(bpfs[256].decompile).to eq 'return ALLOW'
+    end
+  end
+
+  describe 'branch relaxation' do
+    def compile(src)
+      described_class.new(src, nil, :amd64).compile!.map(&:decompile)
+    end
+
+    it 'places trampolines after a return' do
+      insts = compile(<<-EOS)
+        A = sys_number
+        A == 0 ? far : next
+        A == 1 ? far : next
+        A == 2 ? near : next
+        return KILL
+        near:
+        #{"A = args[0]\n" * 300}
+        return ERRNO(1)
+        far:
+        A = args[1]
+        return ALLOW
       EOS
+      expect(insts.size).to eq 309
+      # one trampoline serves both jumps, run by no other path
+      expect(insts.first(6)).to eq ['A = sys_number', 'if (A == 0) goto 0005', 'if (A == 1) goto 0005',
+                                    'if (A == 2) goto 0006', 'return KILL', 'goto 0307']
+    end
+
+    it 'keeps scratch memory loads where the kernel knows them written' do
+      # after 'return KILL', reached before mem[0] is written, a trampoline to 'far' would make the
+      # kernel take mem[0] as unwritten there, so it is inserted inline
+      src = "A = sys_number\nA != 1 ? nw : next\nmem[0] = A\nA == 1 ? far : next\n#{"X = 1\n" * 10}" \
+            "nw:\nreturn KILL\n#{"X = 1\n" * 300}mem[0] = X\nreturn ALLOW\nfar:\nA = mem[0]\nreturn A\n"
+      bpfs = described_class.new(src, nil, :amd64).compile!
+      expect(bpfs[3].decompile).to eq 'if (A == 1) goto 0258'
+      expect(bpfs[257..258].map(&:decompile)).to eq ['goto 0259', 'goto 0319']
+      expect(SeccompTools::Disasm.decode(bpfs.map(&:asm).join, :amd64).check).to be_nil
+      inputs = [0, 1].map { |nr| { sys_nr: nr, args: [0] * 6, arch: 0xc000003e, instruction_pointer: 0 } }
+      expect(SeccompTools::Emulator.new(bpfs.map(&:inst), arch: :amd64).run_batch(inputs)).to eq [0, 1]
+    end
+
+    it 'scales up to the kernel limit' do
+      src = "A = sys_number\n#{(0...1000).map { |i| "A == #{i} ? a#{i} : next" }.join("\n")}\nreturn KILL\n" \
+            "#{(0...1000).map { |i| "a#{i}:\nA = args[0]\nA == #{i} ? ok : bad" }.join("\n")}\n" \
+            "ok:\nreturn ALLOW\nbad:\nreturn ERRNO(1)\n"
+      bpfs = described_class.new(src, nil, :amd64).compile!
+      expect(bpfs.size).to be <= 4096
+      expect(bpfs.all? { |b| b.jt <= 255 && b.jf <= 255 }).to be true
+      insts = bpfs.map(&:inst)
+      inputs = [0, 1, 500, 999, 1000].product([0, 1, 999]).map do |nr, arg|
+        { sys_nr: nr, args: [arg, 0, 0, 0, 0, 0], arch: 0xc000003e, instruction_pointer: 0 }
+      end
+      expected = inputs.map do |i|
+        next 0 if i[:sys_nr] >= 1000
+
+        i[:args][0] == i[:sys_nr] ? 0x7fff0000 : 0x50001
+      end
+      expect(SeccompTools::Emulator.new(insts, arch: :amd64).run_batch(inputs)).to eq expected
     end
   end
 end
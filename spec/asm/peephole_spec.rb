@@ -0,0 +1,119 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/asm/asm'
+require 'seccomp-tools/disasm/disasm'
+require 'seccomp-tools/emulator'
+require 'seccomp-tools/util'
+
+describe SeccompTools::Asm::Peephole do
+  before { SeccompTools::Util.disable_color! }
+
+  def optimize(src)
+    SeccompTools::Disasm.disasm(SeccompTools::Asm.asm(src, arch: :amd64, optimize: true),
+                                arch: :amd64, display_bpf: false)
+  end
+
+  it 'drops reloads, dead code and jumps to jumps, and shares tails' do
+    expect(optimize(<<-EOS)).to eq <<-EOS
+      A = sys_number
+      A == read ? chk_read : next
+      A == write ? chk_write : next
+      A = sys_number
+      A == openat ? hop : allow
+      hop:
+      goto chk_open
+      chk_read:
+      A = sys_number
+      A == read ? next : kill
+      A = args[0]
+      A == 0 ? allow : deny
+      return KILL
+      chk_write:
+      A = args[0]
+      A == 1 ? allow2 : deny2
+      chk_open:
+      A = args[1]
+      A == 0 ? allow : deny
+      allow2:
+      return ALLOW
+      deny2:
+      return ERRNO(1)
+      allow:
+      return ALLOW
+      deny:
+      return ERRNO(1)
+      kill:
+      return KILL
+    EOS
+0000: A = sys_number
+0001: if (A == read) goto 0004
+0002: if (A == write) goto 0006
+0003: if (A == openat) goto 0008 else goto 0010
+0004: A = fd # read(fd, buf, count)
+0005: if (A == 0x0) goto 0010 else goto 0011
+0006: A = fd # write(fd, buf, count)
+0007: if (A == 0x1) goto 0010 else goto 0011
+0008: A = filename # openat(dfd, filename, flags, mode)
+0009: if (A != 0x0) goto 0011
+0010: return ALLOW
+0011: return ERRNO(1)
+    EOS
+  end
+
+  it 'folds comparisons with a known outcome' do
+    expect(optimize(<<-EOS)).to eq <<-EOS
+      A = 5
+      X = A
+      A == X ? next : bad
+      A > 4 ? next : bad
+      A & 2 ? bad : next
+      return ALLOW
+      bad:
+      return KILL
+    EOS
+0000: A = 5
+0001: X = A
+0002: return ALLOW
+    EOS
+  end
+
+  it 'keeps conditional jumps within reach' do
+    # line 1 would rather jump straight to 'far', over 300 lines away
+    src = "A = sys_number\nA == 1 ? hop : body\nhop:\ngoto far\nbody:\n" \
+          "#{"A = args[0]\nA = args[1]\n" * 150}return ALLOW\nfar:\nA = arch\nreturn KILL\n"
+    raw = SeccompTools::Asm.asm(src, arch: :amd64, optimize: true)
+    expect(SeccompTools::Disasm.disasm(raw, arch: :amd64, display_bpf: false).lines.first(3)).to eq [
+      "0000: A = sys_number\n", "0001: if (A != write) goto 0003\n", "0002: goto 0304\n"
+    ]
+  end
+
+  it 'loads scratch memory only where the kernel knows it written' do
+    # line 66 is reached from the sys_number dispatch, before any mem[] is written, and would be
+    # followed by the tail's 'A = mem[1]' after a 'return KILL'
+    raw = File.binread(File.join(__dir__, '..', 'data', 'CONFidence-2017-amigo.bpf'))
+    src = SeccompTools::Disasm.disasm(raw, arch: :amd64, display_bpf: false, arg_infer: false)
+    optimized = SeccompTools::Asm.asm(src, arch: :amd64, optimize: true)
+    expect(optimized.size).to be < raw.size
+    expect(SeccompTools::Disasm.decode(optimized, :amd64).check).to be_nil
+  end
+
+  %w[libseccomp.asm complex.asm example.asm mixed_arch.asm operator_precedence.asm].each do |name|
+    it "keeps #{name} equivalent" do
+      src = File.read(File.join(__dir__, '..', 'data', name))
+      insts = [false, true].map do |optimize|
+        raw = SeccompTools::Asm.asm(src, arch: :amd64, optimize:)
+        SeccompTools::Disasm.to_bpf(raw, :amd64).map(&:inst)
+      end
+      expect(insts[1].size).to be <= insts[0].size
+      rng = Random.new(1)
+      inputs = (0..400).flat_map do |nr|
+        [0, 1, 0x1337].map do |x|
+          { sys_nr: nr, arch: [0xc000003e, 0x40000003][rng.rand(2)], instruction_pointer: rng.rand(2**64),
+            args: Array.new(6) { [x, rng.rand(2**64)][rng.rand(2)] } }
+        end
+      end
+      expected, actual = insts.map { |i| SeccompTools::Emulator.evaluate_many(i, arch: :amd64, inputs:) }
+      expect(actual).to eq expected
+    end
+  end
+end
@@ -0,0 +1,68 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/asm/asm'
+require 'seccomp-tools/audit/syscall_index'
+require 'seccomp-tools/const'
+require 'seccomp-tools/disasm/disasm'
+require 'seccomp-tools/symbolic/executor'
+
+describe SeccompTools::Audit::SyscallIndex do
+  def sys = SeccompTools::Const::BPF::SeccompData::SYS_NUMBER
+
+  def leaves(raw)
+    SeccompTools::Symbolic::Executor.new(SeccompTools::Disasm.to_bpf(raw, :amd64).map(&:inst)).run.first
+  end
+
+  def index(src)
+    described_class.new(leaves(SeccompTools::Asm.asm(src, arch: :amd64)))
+  end
+
+  # What the index answers, the slow way: every sys_number fact of each leaf evaluated on +nr+.
+  def brute(ls, nr)
+    ls.select do |l|
+      l.path.all? { |c| !c.plain_data_fact?(sys) || SeccompTools::Symbolic::Constraint.evaluate(nr, c.op, c.rhs.val) }
+    end
+  end
+
+  it 'partitions at the constants ==, != and range facts compare against' do
+    idx = index(<<~ASM)
+      A = sys_number
+      A >= 0x40000000 ? dead : next
+      A == 1 ? ok : next
+      A > 10 ? ok : next
+      return ERRNO(1)
+      ok:
+      return ALLOW
+      dead:
+      return KILL
+    ASM
+    expect(idx.starts).to eq [0, 1, 2, 11, 0x40000000]
+    expect(idx).to be_exact
+    expect(idx.leaves_at(1).map { |l| l.ret.val }).to eq [0x7fff0000]
+    expect(idx.leaves_at(5).map { |l| l.ret.val }).to eq [0x50001]
+    expect(idx.leaves_at(11).map { |l| l.ret.val }).to eq [0x7fff0000]
+    expect(idx.leaves_at(0xffffffff).map { |l| l.ret.val }).to eq [0]
+  end
+
+  it 'folds a bit test on high bits, and evaluates one on low bits per number' do
+    high = index("A = sys_number\nA & 0x40000000 ? dead : next\nreturn ALLOW\ndead:\nreturn KILL\n")
+    expect(high).to be_exact
+    expect(high.leaves_at(0x40000002).map { |l| l.ret.val }).to eq [0]
+    expect(high.leaves_at(0x80000002).map { |l| l.ret.val }).to eq [0x7fff0000]
+    low = index("A = sys_number\nA & 1 ? odd : next\nreturn ALLOW\nodd:\nreturn KILL\n")
+    expect(low).not_to be_exact
+    expect(low.leaves_at(2).map { |l| l.ret.val }).to eq [0x7fff0000]
+    expect(low.leaves_at(3).map { |l| l.ret.val }).to eq [0]
+    expect(low.sweep([3, 2, 5, 4]) { |ls| ls.any? { |l| l.ret.val.zero? } }).to eq [3, 5]
+  end
+
+  it 'answers as evaluating every leaf does, on the sample filters' do
+    nrs = SeccompTools::Const::Syscall::AMD64.values + [0x40000000, 0x40000001, 0x7fffffff, 0xffffffff]
+    Dir[File.join(__dir__, '..', 'data', '*.bpf')].each do |file|
+      ls = leaves(File.binread(file))
+      idx = described_class.new(ls)
+      nrs.each { |nr| expect(idx.leaves_at(nr)).to eq brute(ls, nr) }
+      expect(idx.sweep(nrs) { |r| r.size.odd? }).to eq(nrs.sort.select { |nr| brute(ls, nr).size.odd? })
+    end
+  end
+end
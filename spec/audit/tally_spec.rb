@@ -0,0 +1,46 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/audit/finding'
+require 'seccomp-tools/audit/report'
+require 'seccomp-tools/audit/tally'
+
+describe SeccompTools::Audit::Tally do
+  def finding(id, severity, arch)
+    SeccompTools::Audit::Finding.new(id:, severity:, arch:, title: id, detail: id, syscalls: [])
+  end
+
+  def report(arches, *findings)
+    SeccompTools::Audit::Report.new(source: nil, arches:, findings:, truncated: false)
+  end
+
+  let(:tally) do
+    described_class.new
+                   .add(report(%w[amd64 i386], finding('dangerous-allow', :medium, 'amd64'),
+                               finding('dangerous-allow', :high, 'amd64'), finding('dangerous-allow', :high, 'i386'),
+                               finding('arch-unchecked', :high, nil)))
+                   .add(report(%w[amd64], finding('dangerous-allow', :medium, 'amd64')))
+                   .add(report(%w[aarch64]))
+                   .fail!
+  end
+
+  it 'counts each finding once per filter and architecture' do
+    expect(tally.to_h).to eq(
+      filters: 3, failed: 1, clean: 1, truncated: 0, arches: { 'amd64' => 2, 'i386' => 1, 'aarch64' => 1 },
+      findings: {
+        'dangerous-allow' => { severity: :high, filters: 2, arches: { 'amd64' => 2, 'i386' => 1 } },
+        'arch-unchecked' => { severity: :high, filters: 1, arches: {} }
+      }
+    )
+  end
+
+  it 'renders a table of findings by architecture' do
+    expect(tally.to_s).to eq <<~EOS
+      Batch summary: 3 filters audited, 1 without weaknesses, 1 failed
+      Architectures: aarch64 (1), amd64 (2), i386 (1)
+
+        Finding          Filters  aarch64  amd64  i386
+        dangerous-allow        2        -      2     1
+        arch-unchecked         1        -      -     -
+    EOS
+  end
+end
@@ -156,7 +156,8 @@ describe SeccompTools::Audit do
   end
 
   it 'warns when the analysis was truncated, rather than reporting it as a weakness' do
-    stub_const('SeccompTools::Symbolic::Executor::STEP_CAP', 1)
+    stub_const('SeccompTools::Symbolic::Executor::MERGE_BOUND', 0) # enumerate paths...
+    stub_const('SeccompTools::Symbolic::Executor::STEP_CAP', 1) # ...and stop at once
     report = audit_file('libseccomp.bpf', :amd64)
     expect(report.to_s).to include('WARNING: analysis truncated')
     expect(report.to_h[:truncated]).to be true
@@ -0,0 +1,51 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/batch'
+
+describe SeccompTools::Batch do
+  def run(items, ordered: true, jobs: 3, &work)
+    out = []
+    described_class.new(items, jobs:, &work).each(ordered:) { |*got| out << got }
+    out
+  end
+
+  it 'runs the block in worker processes and yields results in input order' do
+    out = run((1..20).to_a) do |i|
+      sleep(0.001 * ((i * 7) % 5))
+      [i * i, Process.pid]
+    end
+    expect(out.map(&:first)).to eq((1..20).to_a)
+    expect(out.map { |_, (sq, _), _| sq }).to eq((1..20).map { |i| i * i })
+    expect(out.map { |_, (_, pid), _| pid }).not_to include(Process.pid)
+    expect(Process.waitall).to be_empty
+  end
+
+  it 'yields each result as it is ready when not ordered' do
+    out = run([3, 0, 0], ordered: false, jobs: 2) do |i|
+      sleep(0.2 * i)
+      i
+    end
+    expect(out).to eq [[0, 0, nil], [0, 0, nil], [3, 3, nil]]
+  end
+
+  it 'fails only the inputs whose block raises or whose worker dies' do
+    out = run((1..8).to_a) do |i|
+      raise ArgumentError, 'bad input' if i == 2
+      exit!(1) if i == 5
+
+      i
+    end
+    expect(out).to eq [[1, 1, nil], [2, nil, 'bad input'], [3, 3, nil], [4, 4, nil],
+                       [5, nil, 'worker process died'], [6, 6, nil], [7, 7, nil], [8, 8, nil]]
+  end
+
+  it 'reports results Marshal cannot dump as errors' do
+    out = run([1, 2]) { |i| i == 1 ? -> {} : i }
+    expect(out.first.last).to include('Proc')
+    expect(out.last).to eq [2, 2, nil]
+  end
+
+  it 'runs in this process with one job' do
+    expect(run([1, 2], jobs: 1) { |i| [i, Process.pid] }).to eq [[1, [1, Process.pid], nil], [2, [2, Process.pid], nil]]
+  end
+end
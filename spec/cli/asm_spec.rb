@@ -121,4 +121,11 @@ _filter_end:
     FileUtils.rm(tmp)
     expect(content).to eq @bpf
   end
+
+  it 'optimize' do
+    asm = File.join(__dir__, '..', 'data', 'mixed_arch.asm')
+    raw = SeccompTools::Asm.asm(File.read(asm), arch: :amd64, optimize: true)
+    expect(raw.size).to be < SeccompTools::Asm.asm(File.read(asm), arch: :amd64).size
+    expect { described_class.new([asm, '-O', '-a', 'amd64']).handle }.to output("#{raw.inspect}\n").to_stdout
+  end
 end
@@ -1,8 +1,10 @@
 # encoding: ascii-8bit
 # frozen_string_literal: true
 
+require 'fileutils'
 require 'json'
 require 'stringio'
+require 'tmpdir'
 
 require 'seccomp-tools/cli/audit'
 require 'seccomp-tools/util'
@@ -14,12 +16,17 @@ describe SeccompTools::CLI::Audit do
     File.join(__dir__, '..', 'data', name)
   end
 
+  # The output of +argv+; the exit status, when it exits, is left in +@status+.
   def capture(argv)
     io = StringIO.new
     orig = $stdout
     $stdout = io
+    @status = nil
     described_class.new(argv).handle
     io.string
+  rescue SystemExit => e
+    @status = e.status
+    io.string
   ensure
     $stdout = orig
   end
@@ -70,4 +77,52 @@ describe SeccompTools::CLI::Audit do
     out = capture(['-p', '1234', '-a', 'amd64'])
     expect(out).to include('x32 ABI is not guarded')
   end
+
+  it 'reuses the report kept by --cache' do
+    Dir.mktmpdir do |dir|
+      argv = [data('twctf-2016-diary.bpf'), '-a', 'amd64', '--cache', dir]
+      fresh = capture(argv.dup)
+      expect(SeccompTools::Audit).not_to receive(:new)
+      expect(capture(argv.dup)).to eq fresh
+      expect(capture(argv + %w[-f json])).to include('"id": "dangerous-allow"')
+    end
+  end
+
+  context 'with --batch' do
+    around do |example|
+      Dir.mktmpdir do |dir|
+        @dir = dir
+        %w[twctf-2016-diary.bpf libseccomp.bpf].each { |f| FileUtils.cp(data(f), dir) }
+        File.binwrite(File.join(dir, 'broken.bpf'), "\x06")
+        example.run
+      end
+    end
+
+    it 'audits every file in order and adds them up' do
+      out = capture(['--batch', @dir, '-a', 'amd64', '-j', '2'])
+      expect(out).to include("[ERROR] #{File.join(@dir, 'broken.bpf')}: ")
+      expect(out.scan(/^Seccomp audit of (.*)$/).flatten).to eq(%w[libseccomp.bpf twctf-2016-diary.bpf]
+                                                                  .map { |f| File.join(@dir, f) })
+      expect(out).to include('Batch summary: 2 filters audited, 1 without weaknesses, 1 failed')
+      expect(out).to match(/^  x32-guard +1 +1$/)
+      expect(@status).to eq 1
+    end
+
+    it 'lists the files that failed in the JSON document' do
+      doc = JSON.parse(capture(['--batch', @dir, '-a', 'amd64', '-f', 'json']))
+      expect(doc['summary']).to include('filters' => 2, 'failed' => 1)
+      expect(doc['errors'].map { |e| e['source'] }).to eq [File.join(@dir, 'broken.bpf')]
+      expect(doc['errors'].first['error']).to be_a(String)
+      expect(@status).to eq 1
+    end
+
+    it 'reads a list of files and emits one JSON document' do
+      File.write(list = File.join(@dir, 'list'), "# filters\n#{File.join(@dir, 'libseccomp.bpf')}\n\n")
+      doc = JSON.parse(capture(['--batch', "@#{list}", '-a', 'amd64', '-f', 'json', '--unordered']))
+      expect(doc['summary']).to include('filters' => 1, 'clean' => 1, 'failed' => 0)
+      expect(doc['reports'].map { |r| r['source'] }).to eq [File.join(@dir, 'libseccomp.bpf')]
+      expect(doc['errors']).to eq []
+      expect(@status).to be_nil
+    end
+  end
 end
@@ -0,0 +1,55 @@
+# frozen_string_literal: true
+
+require 'json'
+require 'stringio'
+
+require 'seccomp-tools/cli/cache'
+require 'seccomp-tools/util'
+
+describe SeccompTools::CLI::Cache do
+  before { SeccompTools::Util.disable_color! }
+
+  def data(name)
+    File.join(__dir__, '..', 'data', name)
+  end
+
+  def capture(argv)
+    io = StringIO.new
+    orig = $stdout
+    $stdout = io
+    described_class.new(argv).handle
+    io.string
+  ensure
+    $stdout = orig
+  end
+
+  it 'prints a human report' do
+    out = capture([data('gctf-2019-quals-caas.bpf'), '-a', 'amd64'])
+    expect(out).to include("Action cache of #{data('gctf-2019-quals-caas.bpf')}",
+                           '14 of 17 allowed syscalls cached',
+                           '    mmap    0037: A = args[0] >> 32 (loads an argument)',
+                           "Architecture: i386\n\n  (no syscall is allowed)")
+  end
+
+  it 'emits a valid JSON document with --format json' do
+    doc = JSON.parse(capture([data('gctf-2019-quals-caas.bpf'), '-a', 'amd64', '-f', 'json']))
+    expect(doc['stacked_filters']).to eq 1
+    arch = doc['reports'].first['arches'].first
+    expect(arch['arch']).to eq 'amd64'
+    expect(arch['cached']).to include('read', 'write')
+    expect(arch['uncached'].first).to eq('name' => 'mmap', 'number' => 9, 'line' => 37,
+                                         'instruction' => 'A = args[0] >> 32', 'reason' => 'args',
+                                         'hoistable' => false)
+  end
+
+  it 'intersects several stacked filters' do
+    f0 = File.binread(data('twctf-2016-diary.bpf'))
+    f1 = File.binread(data('libseccomp.bpf'))
+    stub_const('SeccompTools::Dumper::SUPPORTED', true)
+    allow(SeccompTools::Dumper).to receive(:dump) do |*, **, &blk|
+      [blk.call(f0, :amd64), blk.call(f1, :amd64)]
+    end
+    out = capture(['-c', './x', '-a', 'amd64', '-l', '2'])
+    expect(out).to include('filters are installed', '(filter #0)', '(filter #1)', 'Action cache of all 2 filters')
+  end
+end
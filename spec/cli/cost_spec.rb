@@ -0,0 +1,68 @@
+# encoding: ascii-8bit
+# frozen_string_literal: true
+
+require 'json'
+require 'stringio'
+require 'tempfile'
+
+require 'seccomp-tools/cli/cost'
+require 'seccomp-tools/util'
+
+describe SeccompTools::CLI::Cost do
+  before { SeccompTools::Util.disable_color! }
+
+  def data(name)
+    File.join(__dir__, '..', 'data', name)
+  end
+
+  def capture(argv)
+    io = StringIO.new
+    orig = $stdout
+    $stdout = io
+    described_class.new(argv).handle
+    io.string
+  ensure
+    $stdout = orig
+  end
+
+  it 'prints a human report' do
+    out = capture([data('gctf-2019-quals-caas.bpf'), '-a', 'amd64', '-n', '2'])
+    expect(out).to include("Syscall cost of #{data('gctf-2019-quals-caas.bpf')}",
+                           '    mmap    24 - 46', '    socket  23 - 33', 'more')
+    expect(out).not_to include('    clone')
+  end
+
+  it 'emits a valid JSON document with --format json' do
+    doc = JSON.parse(capture([data('libseccomp.bpf'), '-a', 'amd64', '-f', 'json']))
+    expect(doc['stacked_filters']).to eq 1
+    arch = doc['reports'].first['arches'].first
+    expect(arch['arch']).to eq 'amd64'
+    write = arch['syscalls'].find { |s| s['name'] == 'write' }
+    expect(write['min']).to eq write['max']
+  end
+
+  it 'weights the average by --profile' do
+    Tempfile.create(%w[profile .txt]) do |f|
+      f.write("read 10\nmmap 2\n")
+      f.close
+      out = capture([data('gctf-2019-quals-caas.bpf'), '-a', 'amd64', '--profile', f.path, '-n', '1'])
+      expect(out).to include('Weighted by the profile (12 calls)')
+    end
+  end
+
+  it 'complains about an unreadable profile' do
+    expect { described_class.new([data('libseccomp.bpf'), '--profile', '/nonexistent/profile']).handle }
+      .to output(/No such file or directory/).to_stdout
+  end
+
+  it 'adds up several stacked filters' do
+    f0 = File.binread(data('twctf-2016-diary.bpf'))
+    f1 = File.binread(data('libseccomp.bpf'))
+    stub_const('SeccompTools::Dumper::SUPPORTED', true)
+    allow(SeccompTools::Dumper).to receive(:dump) do |*, **, &blk|
+      [blk.call(f0, :amd64), blk.call(f1, :amd64)]
+    end
+    out = capture(['-c', './x', '-a', 'amd64', '-l', '2', '-n', '1'])
+    expect(out).to include('filters are installed', '(filter #0)', '(filter #1)', 'Syscall cost of all 2 filters')
+  end
+end
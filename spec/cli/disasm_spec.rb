@@ -24,6 +24,15 @@ describe SeccompTools::CLI::Disasm do
     expect(content).not_to be_empty
   end
 
+  it 'warns on stderr when the kernel would refuse the filter' do
+    tmp = File.join('/tmp', SecureRandom.hex)
+    File.binwrite(tmp, [0x20, 0, 0, 0x40, 0x06, 0, 0, 0x7fff0000].pack('S<CCL<' * 2))
+    expect { described_class.new([tmp]).handle }
+      .to output("[WARN] The kernel would refuse this filter at line 0000: invalid seccomp_data offset.\n").to_stderr
+    FileUtils.rm(tmp)
+    expect { described_class.new([@bpf]).handle }.not_to output.to_stderr
+  end
+
   it 'arch' do
     expect { described_class.new([@bpf, '-a', 'i386']).handle }.to output(<<EOS).to_stdout
  line  CODE  JT   JF      K
@@ -25,6 +25,11 @@ EOS
     expect { described_class.new([@bin]).handle }.to output(@bpf_disasm).to_stdout
   end
 
+  it 'trap' do
+    skip_unless_amd64
+    expect { described_class.new([@bin, '--trap']).handle }.to output(@bpf_disasm).to_stdout
+  end
+
   it 'by pid' do
     skip_unless_amd64
     skip_unless_root
@@ -39,6 +44,25 @@ EOS
     end
   end
 
+  it 'all' do
+    skip_unless_amd64
+    skip_unless_root
+
+    popen2(bin_of('two_filters')) do |i, o, pid|
+      o.gets # seccomp installed
+      expect { described_class.new(%w[--all -f inspect]).handle }
+        .to output(/^pid (\d+, )*#{pid}(, \d+)*\n"\\x20\\x00/).to_stdout
+      i.puts
+    end
+  end
+
+  it 'all without root' do
+    error = /PTRACE_SECCOMP_GET_FILTER requires CAP_SYS_ADMIN/
+    allow(SeccompTools::Dumper).to receive(:seccomp_tids).and_return({ 1 => 1 })
+    dumper = described_class.new(['--all'])
+    expect { as_nobody { dumper.handle } }.to terminate.with_code(1).and output(error).to_stdout
+  end
+
   it 'by pid without root' do
     pid = Process.spawn('sleep 60')
     begin
@@ -110,6 +134,16 @@ EOS
       expect(command.call).to eq './bin'
     end
 
+    it 'writes each filter as soon as it is dumped' do
+      written = []
+      allow(SeccompTools::Dumper).to receive(:dump) do |*, **, &blk|
+        Array.new(2) { blk.call(allow_filter, :amd64).tap { written << $stdout.string.dup } }
+      end
+      disasm = SeccompTools::Disasm.disasm(allow_filter, arch: :amd64)
+      expect { described_class.new(['-c', './x', '-l', '2']).handle }.to output(disasm * 2).to_stdout
+      expect(written).to eq [disasm, disasm * 2]
+    end
+
     it 'warns about positional arguments left after --pid' do
       allow(SeccompTools::Dumper).to receive(:dump_by_pid) { |*, &blk| [blk.call(allow_filter, :amd64)] }
       expect { described_class.new(['-p', '123', './extra', '-f', 'raw']).handle }
@@ -2,6 +2,7 @@
 # frozen_string_literal: true
 
 require 'tempfile'
+require 'tmpdir'
 
 require 'seccomp-tools/cli/cli'
 require 'seccomp-tools/cli/explain'
@@ -137,6 +138,35 @@ EOS
     end
   end
 
+  it 'reuses the summary kept by --cache under its own label' do
+    Dir.mktmpdir do |dir|
+      fresh = described_class.new([data('libseccomp.bpf'), '-a', 'amd64', '--cache', dir])
+      expect { fresh.handle }.to output(/\ASeccomp policy for .*libseccomp.bpf\n.*ALLOW:/m).to_stdout
+      allow($stdin).to receive(:read).and_return(File.binread(data('libseccomp.bpf')))
+      expect(SeccompTools::Explain).not_to receive(:new)
+      expect { described_class.new(['-', '-a', 'amd64', '--cache', dir]).handle }
+        .to output(/\ASeccomp policy for <STDIN>\n.*ALLOW:/m).to_stdout
+    end
+  end
+
+  it 'explains every file of --batch, labelled with its path' do
+    Dir.mktmpdir do |dir|
+      File.write(list = File.join(dir, 'list'), "#{data('libseccomp.bpf')}\n#{data('twctf-2016-diary.bpf')}\n")
+      first, second = %w[libseccomp.bpf twctf-2016-diary.bpf].map { |f| Regexp.escape("Seccomp policy for #{data(f)}") }
+      expect { described_class.new(['--batch', "@#{list}", '-a', 'amd64', '-j', '2']).handle }
+        .to output(/\A#{first}\n.*^#{second}\n/m).to_stdout
+    end
+  end
+
+  it 'fails a --batch run when a file fails' do
+    Dir.mktmpdir do |dir|
+      File.write(list = File.join(dir, 'list'), "#{data('libseccomp.bpf')}\n#{File.join(dir, 'missing.bpf')}\n")
+      expect { described_class.new(['--batch', "@#{list}", '-a', 'amd64', '-j', '1']).handle }
+        .to raise_error(SystemExit) { |e| expect(e.status).to eq 1 }
+        .and output(/^\[ERROR\] #{Regexp.escape(File.join(dir, 'missing.bpf'))}: /).to_stdout
+    end
+  end
+
   it 'reports when dumping is unsupported' do
     stub_const('SeccompTools::Dumper::SUPPORTED', false)
     expect { described_class.new(['-p', '1']).handle }.to output(/only available on Linux/).to_stdout
@@ -11,11 +11,16 @@ List of commands:
 
 	asm	Seccomp bpf assembler.
 	audit	Assess a seccomp filter for weaknesses and escape routes.
+	cache	Report which allowed syscalls skip a seccomp filter through the kernel's action cache.
 	completion	Print a shell completion script.
+	cost	Report how many instructions a seccomp filter executes for each syscall.
 	disasm	Disassemble seccomp bpf.
 	dump	Automatically dump seccomp bpf from executable(s).
 	emu	Emulate seccomp rules.
 	explain	Summarize a seccomp filter as a per-action policy.
+	merge	Merge stacked seccomp filters into a single equivalent one.
+	optimize	Rewrite a seccomp filter so the most frequent syscalls are decided first.
+	serve	Keep the library loaded and run the commands of other invocations.
 
 See 'seccomp-tools <command> --help' to read about a specific subcommand.
     EOS
@@ -42,8 +47,15 @@ Usage: seccomp-tools dump [EXEC] [options]
                                      You must have CAP_SYS_ADMIN (e.g. be root) to use this option.
     -t, --timeout SEC                Timeout (seconds) for the execution. Default: no timeout
                                      This option is ignored when --pid is given.
+        --trap                       Stop the executable only at its seccomp installations instead of at every syscall,
+                                     by installing a filter that traps them first. Much faster on syscall-heavy programs,
+                                     but the extra filter is visible to the program and sets no_new_privs when not root.
+                                     This option is ignored when --pid is given.
     -f, --format FORMAT              Output format. FORMAT can only be one of <disasm|raw|inspect>.
                                      Default: disasm
+        --all                        Dump the filters of every process on this host that has seccomp filters installed.
+                                     Each distinct filter is shown once, after the pids sharing it. --limit applies per thread.
+                                     You must have CAP_SYS_ADMIN (e.g. be root) to use this option.
     -o, --output FILE                Write output to FILE instead of stdout.
                                      If multiple seccomp syscalls have been invoked (see --limit),
                                      results are written to FILE, FILE_1, FILE_2, etc.
@@ -67,6 +79,78 @@ Usage: seccomp-tools audit [options] [BPF_FILE|EXEC]
                                      You must have CAP_SYS_ADMIN (e.g. be root) to use this option.
     -t, --timeout SEC                Timeout (seconds) for the execution. Default: no timeout
                                      This option is ignored when --pid is given.
+        --trap                       Stop the executable only at its seccomp installations instead of at every syscall,
+                                     by installing a filter that traps them first. Much faster on syscall-heavy programs,
+                                     but the extra filter is visible to the program and sets no_new_privs when not root.
+                                     This option is ignored when --pid is given.
+    -a, --arch ARCH                  Specify architecture.
+                                     Supported architectures are <aarch64|amd64|i386|riscv64|s390x>.
+                                     Default: auto-detected from the host machine.
+                                     Set it when the filter targets an architecture other than the host.
+                                     With an executable or --pid the architecture is auto-detected instead.
+        --cache [DIR]                Reuse the results for filters analyzed before, kept on disk under DIR by
+                                     their bytes, architecture and the seccomp-tools version.
+                                     Default DIR: $XDG_CACHE_HOME/seccomp-tools (or ~/.cache/seccomp-tools)
+        --batch DIR|@LIST            Audit every file under DIR, or listed one per line in LIST,
+                                     as a raw BPF of --arch, in one run. Takes precedence over the other inputs.
+    -j, --jobs N                     Worker processes for --batch. Default: the number of processors
+        --unordered                  With --batch, print each result as soon as it is ready instead of in input order.
+    -f, --format FORMAT              Output format, one of <human|json>.
+                                     Default: human
+EOS
+  end
+
+  it 'help cache' do
+    expect { described_class.work(%w[cache --help]) }.to output(<<EOS).to_stdout
+cache - Report which allowed syscalls skip a seccomp filter through the kernel's action cache.
+
+Usage: seccomp-tools cache [options] [BPF_FILE|EXEC]
+    -c, --sh-exec <command>          Executes the given command (via sh) and analyzes its seccomp.
+                                     Use this to pass arguments or pipe things to the executable.
+                                     e.g. use `-c "./bin > /dev/null"` to keep the program output out of the result.
+                                     Takes precedence over the positional argument.
+    -l, --limit LIMIT                Analyze only the first LIMIT installed filters.
+                                     Only meaningful when the input is an executable or --pid. Default: 1
+                                     An executable is killed once it reaches LIMIT.
+    -p, --pid PID                    Analyze the seccomp filters installed on an existing process.
+                                     You must have CAP_SYS_ADMIN (e.g. be root) to use this option.
+    -t, --timeout SEC                Timeout (seconds) for the execution. Default: no timeout
+                                     This option is ignored when --pid is given.
+        --trap                       Stop the executable only at its seccomp installations instead of at every syscall,
+                                     by installing a filter that traps them first. Much faster on syscall-heavy programs,
+                                     but the extra filter is visible to the program and sets no_new_privs when not root.
+                                     This option is ignored when --pid is given.
+    -a, --arch ARCH                  Specify architecture.
+                                     Supported architectures are <aarch64|amd64|i386|riscv64|s390x>.
+                                     Default: auto-detected from the host machine.
+                                     Set it when the filter targets an architecture other than the host.
+                                     Its compat architecture (i386 for amd64) is analysed too.
+                                     With an executable or --pid the architecture is auto-detected instead.
+    -f, --format FORMAT              Output format, one of <human|json>.
+                                     Default: human
+EOS
+  end
+
+  it 'help cost' do
+    expect { described_class.work(%w[cost --help]) }.to output(<<EOS).to_stdout
+cost - Report how many instructions a seccomp filter executes for each syscall.
+
+Usage: seccomp-tools cost [options] [BPF_FILE|EXEC]
+    -c, --sh-exec <command>          Executes the given command (via sh) and measures its seccomp.
+                                     Use this to pass arguments or pipe things to the executable.
+                                     e.g. use `-c "./bin > /dev/null"` to keep the program output out of the result.
+                                     Takes precedence over the positional argument.
+    -l, --limit LIMIT                Measure only the first LIMIT installed filters.
+                                     Only meaningful when the input is an executable or --pid. Default: 1
+                                     An executable is killed once it reaches LIMIT.
+    -p, --pid PID                    Measure the seccomp filters installed on an existing process.
+                                     You must have CAP_SYS_ADMIN (e.g. be root) to use this option.
+    -t, --timeout SEC                Timeout (seconds) for the execution. Default: no timeout
+                                     This option is ignored when --pid is given.
+        --trap                       Stop the executable only at its seccomp installations instead of at every syscall,
+                                     by installing a filter that traps them first. Much faster on syscall-heavy programs,
+                                     but the extra filter is visible to the program and sets no_new_privs when not root.
+                                     This option is ignored when --pid is given.
     -a, --arch ARCH                  Specify architecture.
                                      Supported architectures are <aarch64|amd64|i386|riscv64|s390x>.
                                      Default: auto-detected from the host machine.
@@ -74,6 +158,10 @@ Usage: seccomp-tools audit [options] [BPF_FILE|EXEC]
                                      With an executable or --pid the architecture is auto-detected instead.
     -f, --format FORMAT              Output format, one of <human|json>.
                                      Default: human
+    -n, --top N                      List only the N most expensive syscalls of each architecture.
+                                     Default: all of them
+        --profile FILE               Also report the average cost weighted by how often each syscall is made.
+                                     FILE is the output of `strace -c`, or one "syscall count" pair per line.
 EOS
   end
 
@@ -129,11 +217,91 @@ Usage: seccomp-tools explain [options] [BPF_FILE|EXEC]
                                      You must have CAP_SYS_ADMIN (e.g. be root) to use this option.
     -t, --timeout SEC                Timeout (seconds) for the execution. Default: no timeout
                                      This option is ignored when --pid is given.
+        --trap                       Stop the executable only at its seccomp installations instead of at every syscall,
+                                     by installing a filter that traps them first. Much faster on syscall-heavy programs,
+                                     but the extra filter is visible to the program and sets no_new_privs when not root.
+                                     This option is ignored when --pid is given.
     -a, --arch ARCH                  Specify architecture.
                                      Supported architectures are <aarch64|amd64|i386|riscv64|s390x>.
                                      Default: auto-detected from the host machine.
                                      Set it when the filter targets an architecture other than the host.
                                      With an executable or --pid the architecture is auto-detected instead.
+        --cache [DIR]                Reuse the results for filters analyzed before, kept on disk under DIR by
+                                     their bytes, architecture and the seccomp-tools version.
+                                     Default DIR: $XDG_CACHE_HOME/seccomp-tools (or ~/.cache/seccomp-tools)
+        --batch DIR|@LIST            Explain every file under DIR, or listed one per line in LIST,
+                                     as a raw BPF of --arch, in one run. Takes precedence over the other inputs.
+    -j, --jobs N                     Worker processes for --batch. Default: the number of processors
+        --unordered                  With --batch, print each result as soon as it is ready instead of in input order.
+EOS
+  end
+
+  it 'help serve' do
+    expect { described_class.work(%w[serve --help]) }.to output(<<EOS).to_stdout
+serve - Keep the library loaded and run the commands of other invocations.
+
+Usage: seccomp-tools serve [options]
+    While it runs, seccomp-tools commands run in it instead of starting afresh.
+    -s, --socket PATH                Listen on the Unix socket PATH.
+                                     Default: $SECCOMP_TOOLS_SOCKET, else seccomp-tools-UID.sock in $XDG_RUNTIME_DIR or /tmp.
+                                     Set SECCOMP_TOOLS_SOCKET to the same PATH for commands to find it.
+EOS
+  end
+
+  it 'help merge' do
+    expect { described_class.work(%w[merge --help]) }.to output(<<EOS).to_stdout
+merge - Merge stacked seccomp filters into a single equivalent one.
+
+Usage: seccomp-tools merge [options] BPF_FILE... | EXEC
+    BPF_FILEs are given in the order they are installed, the oldest first.
+    -c, --sh-exec <command>          Executes the given command (via sh) and merges its seccomp.
+                                     Use this to pass arguments or pipe things to the executable.
+                                     e.g. use `-c "./bin > /dev/null"` to keep the program output out of the result.
+                                     Takes precedence over the positional argument.
+    -l, --limit LIMIT                Merge only the first LIMIT installed filters.
+                                     Only meaningful when the input is an executable or --pid. Default: 1
+                                     An executable is killed once it reaches LIMIT.
+    -p, --pid PID                    Merge the seccomp filters installed on an existing process.
+                                     You must have CAP_SYS_ADMIN (e.g. be root) to use this option.
+    -t, --timeout SEC                Timeout (seconds) for the execution. Default: no timeout
+                                     This option is ignored when --pid is given.
+        --trap                       Stop the executable only at its seccomp installations instead of at every syscall,
+                                     by installing a filter that traps them first. Much faster on syscall-heavy programs,
+                                     but the extra filter is visible to the program and sets no_new_privs when not root.
+                                     This option is ignored when --pid is given.
+    -o, --output FILE                Write output to FILE instead of stdout,
+                                     and report how many instructions each syscall executes before and after.
+    -f, --format FORMAT              Output format. FORMAT can only be one of <inspect|raw|c_array|c_source|assembly>.
+                                     Default: inspect
+    -a, --arch ARCH                  Specify architecture.
+                                     Supported architectures are <aarch64|amd64|i386|riscv64|s390x>.
+                                     Default: auto-detected from the host machine.
+                                     Set it when the filter targets an architecture other than the host.
+                                     With an executable or --pid the architecture is auto-detected instead.
+    -n, --top N                      Report only the N syscalls of each architecture dearest before merging.
+                                     Default: all of them
+        --profile FILE               How often each syscall is made, to decide the hottest ones first.
+                                     FILE is the output of `strace -c`, or one "syscall count" pair per line.
+                                     Default: every syscall is as frequent
+EOS
+  end
+
+  it 'help optimize' do
+    expect { described_class.work(%w[optimize --help]) }.to output(<<EOS).to_stdout
+optimize - Rewrite a seccomp filter so the most frequent syscalls are decided first.
+
+Usage: seccomp-tools optimize BPF_FILE [options]
+    -o, --output FILE                Write output to FILE instead of stdout,
+                                     and report how many instructions the rewrite saves.
+    -f, --format FORMAT              Output format. FORMAT can only be one of <inspect|raw|c_array|c_source|assembly>.
+                                     Default: inspect
+    -a, --arch ARCH                  Specify architecture.
+                                     Supported architectures are <aarch64|amd64|i386|riscv64|s390x>.
+                                     Default: auto-detected from the host machine.
+                                     Set it when the filter targets an architecture other than the host.
+        --profile FILE               How often each syscall is made, to decide the hottest ones first.
+                                     FILE is the output of `strace -c`, or one "syscall count" pair per line.
+                                     Default: every syscall is as frequent
 EOS
   end
 
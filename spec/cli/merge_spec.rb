@@ -0,0 +1,71 @@
+# frozen_string_literal: true
+
+require 'stringio'
+require 'tempfile'
+
+require 'seccomp-tools/cli/cli'
+require 'seccomp-tools/cli/merge'
+require 'seccomp-tools/disasm/disasm'
+require 'seccomp-tools/util'
+
+describe SeccompTools::CLI::Merge do
+  before { SeccompTools::Util.disable_color! }
+
+  def data(name)
+    File.join(__dir__, '..', 'data', name)
+  end
+
+  def capture(argv)
+    io = StringIO.new
+    orig = $stdout
+    $stdout = io
+    described_class.new(argv).handle
+    io.string
+  ensure
+    $stdout = orig
+  end
+
+  it 'merges BPF files given oldest first' do
+    files = [data('libseccomp.bpf'), data('gctf-2019-quals-caas.bpf')]
+    expect { described_class.new([*files, '-a', 'amd64', '-f', 'assembly']).handle }
+      .to output(/^\.ascii /).to_stdout
+  end
+
+  it 'writes the merged filter and reports the cost of each syscall' do
+    Tempfile.create(%w[merged .bpf]) do |out|
+      argv = [data('libseccomp.bpf'), data('gctf-2019-quals-caas.bpf'), '-a', 'amd64', '-f', 'raw',
+              '-o', out.path, '-n', '1', '--profile', data('caas.strace')]
+      out_text = capture(argv)
+      expect(out_text).to match(/: 11 \+ 63 -> \d+ instructions\n/)
+      expect(out_text).to match(/^  774 syscalls: 20\.4 -> [\d.]+ on average, 16\.5 -> [\d.]+ weighted by the profile$/)
+      expect(out_text).to match(/^    mmap  33 - 55 -> \d+ - \d+\n    \.\.\. 773 more$/)
+      expect(SeccompTools::Disasm.disasm(File.binread(out.path), arch: :amd64)).to include('A = sys_number')
+    end
+  end
+
+  it 'merges the filters dumped from an executable' do
+    allow_all = "\x06\x00\x00\x00\x00\x00\xff\x7f".b
+    stub_const('SeccompTools::Dumper::SUPPORTED', true)
+    allow(SeccompTools::Dumper).to receive(:dump) do |*, **, &blk|
+      [blk.call(File.binread(data('libseccomp.bpf')), :amd64), blk.call(allow_all, :amd64)]
+    end
+    Tempfile.create(%w[merged .bpf]) do |out|
+      expect { described_class.new(['-c', './x', '-l', '2', '-f', 'raw', '-o', out.path]).handle }
+        .to output(/Merged 2 filters of \.\/x: 11 \+ 1 -> \d+ instructions/).to_stdout
+    end
+  end
+
+  it 'warns about a single filter' do
+    expect { described_class.new([data('libseccomp.bpf'), '-a', 'amd64']).handle }
+      .to output(/\[WARN\] Only one filter is given; it is optimized alone\./).to_stdout
+  end
+
+  it 'complains about a filter it cannot merge' do
+    Tempfile.create(%w[ret_a .bpf]) do |f|
+      f.write("\x16\x00\x00\x00\x00\x00\x00\x00".b)
+      f.close
+      expect { described_class.new([f.path, data('libseccomp.bpf'), '-a', 'amd64']).handle }
+        .to output("[ERROR] Filter #0 returns A at line 0.\n").to_stdout
+    end
+  end
+end
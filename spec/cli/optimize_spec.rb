@@ -0,0 +1,62 @@
+# frozen_string_literal: true
+
+require 'tempfile'
+
+require 'seccomp-tools/cli/cli'
+require 'seccomp-tools/cli/optimize'
+require 'seccomp-tools/disasm/disasm'
+require 'seccomp-tools/util'
+
+describe SeccompTools::CLI::Optimize do
+  before { SeccompTools::Util.disable_color! }
+
+  def data(name)
+    File.join(__dir__, '..', 'data', name)
+  end
+
+  def with_profile(text)
+    Tempfile.create(%w[profile .txt]) do |f|
+      f.write(text)
+      f.close
+      yield f.path
+    end
+  end
+
+  it 'writes the rewritten filter and reports the saving' do
+    with_profile("read 1000\nwrite 800\n") do |profile|
+      Tempfile.create(%w[optimized .bpf]) do |out|
+        argv = [data('gctf-2019-quals-caas.bpf'), '-a', 'amd64', '--profile', profile, '-f', 'raw', '-o', out.path]
+        expect { described_class.new(argv).handle }
+          .to output(/caas\.bpf: 63 -> \d+ instructions, [\d.]+ -> [\d.]+ executed on average weighted by the profile/)
+          .to_stdout
+        raw = File.binread(out.path)
+        expect(raw).to end_with(File.binread(data('gctf-2019-quals-caas.bpf')))
+        expect(SeccompTools::Disasm.disasm(raw, arch: :amd64, display_bpf: false)).to start_with("0000: A = arch\n")
+      end
+    end
+  end
+
+  it 'writes the filter unchanged when the rewrite is no faster' do
+    raw = File.binread(data('libseccomp.bpf'))
+    expect { described_class.new([data('libseccomp.bpf'), '-a', 'amd64', '-f', 'c_array']).handle }
+      .to output("unsigned char bpf[] = {#{raw.bytes.join(',')}};\n").to_stdout
+      .and output("[WARN] The rewrite is not faster for this profile; the filter is written unchanged.\n").to_stderr
+  end
+
+  it 'keeps the warning out of a raw filter written to stdout' do
+    Tempfile.create(%w[kill .bpf]) do |f|
+      kill_all = [0x06, 0, 0, 0].pack('S<CCL<')
+      f.write(kill_all)
+      f.close
+      expect { described_class.new([f.path, '-a', 'amd64', '-f', 'raw']).handle }
+        .to output(kill_all).to_stdout.and output(/\[WARN\]/).to_stderr
+    end
+  end
+
+  it 'reports a filter that cannot be rewritten and fails' do
+    allow(SeccompTools::Optimizer).to receive(:new).and_raise(SeccompTools::OptimizeError, 'The filter is too large.')
+    expect { described_class.new([data('libseccomp.bpf'), '-a', 'amd64']).handle }
+      .to raise_error(SystemExit) { |e| expect(e.status).to eq 1 }
+      .and output("[ERROR] The filter is too large.\n").to_stdout
+  end
+end
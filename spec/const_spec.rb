@@ -31,6 +31,25 @@ describe SeccompTools::Const::Syscall do
     expect(described_class::RISCV64).to include(clone3: 435, io_uring_setup: 425)
     expect(described_class::S390X).to include(clone3: 435, io_uring_setup: 425, futex_waitv: 449)
   end
+
+  describe '.name_of' do
+    it 'looks a number up in the index of its architecture, last name listed winning' do
+      expect(described_class.name_of(:amd64, 59)).to be :execve
+      expect(described_class.name_of(:aarch64, 221)).to be :execve
+      expect(described_class.name_of(:amd64, 0x40000000 | 59)).to eq described_class::AMD64.invert[0x40000000 | 59]
+      expect(described_class.name_of(:amd64, 4095)).to be_nil
+      expect(described_class.name_of(:amd64, -1)).to be_nil
+      expect(described_class.index(:amd64)).to be described_class.index(:amd64)
+      expect(described_class.index(:amd64)).to be_frozen
+    end
+
+    it 'agrees with the inverted table on every architecture' do
+      %i[amd64 i386 aarch64 riscv64 s390x].each do |arch|
+        table = described_class.const_get(arch.upcase)
+        expect(table.values.uniq.to_h { |nr| [nr, described_class.name_of(arch, nr)] }).to eq table.invert
+      end
+    end
+  end
 end
 
 describe 'SYS_ARG' do
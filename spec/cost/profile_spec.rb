@@ -0,0 +1,22 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/cost/profile'
+
+describe SeccompTools::Cost::Profile do
+  it 'parses syscall count pairs' do
+    expect(described_class.parse("# a comment\nfutex 1200\n\nread: 300\nfutex 5\n"))
+      .to eq(futex: 1205, read: 300)
+  end
+
+  it 'parses strace -c output' do
+    text = <<~EOS
+      % time     seconds  usecs/call     calls    errors syscall
+      ------ ----------- ----------- --------- --------- ----------------
+       62.50    0.000050          12         4           mmap
+       37.50    0.000030           3        10         2 openat
+      ------ ----------- ----------- --------- --------- ----------------
+      100.00    0.000080           5        14         2 total
+    EOS
+    expect(described_class.parse(text)).to eq(mmap: 4, openat: 10)
+  end
+end
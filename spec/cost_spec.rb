@@ -0,0 +1,107 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/asm/asm'
+require 'seccomp-tools/cost'
+require 'seccomp-tools/disasm/disasm'
+require 'seccomp-tools/emulator'
+require 'seccomp-tools/util'
+
+describe SeccompTools::Cost do
+  before { SeccompTools::Util.disable_color! }
+
+  def insts_of(raw, arch = :amd64)
+    SeccompTools::Disasm.to_bpf(raw, arch).map(&:inst)
+  end
+
+  def data(name)
+    File.binread(File.join(__dir__, 'data', name))
+  end
+
+  def report_of(raw, arch = :amd64, **opts)
+    described_class.new(insts_of(raw, arch), arch:).cost(**opts)
+  end
+
+  # Instructions the emulator executes for syscall +nr+ with all-zero arguments.
+  def emulated_steps(insts, nr)
+    steps = 0
+    SeccompTools::Emulator.new(insts, sys_nr: nr, args: [0] * 6, instruction_pointer: 0, arch: :amd64)
+                          .run { steps += 1 }
+    steps
+  end
+
+  it 'agrees with the emulator on a filter that checks no arguments' do
+    raw = data('libseccomp.bpf')
+    section = report_of(raw).sections.first
+    expect(section.arch).to eq 'amd64'
+    section.rows.each do |row|
+      expect([row.min, row.max]).to eq [emulated_steps(insts_of(raw), row.nr)] * 2
+    end
+  end
+
+  it 'spans the paths a syscall takes through argument checks' do
+    rows = report_of(data('gctf-2019-quals-caas.bpf')).sections.first.rows
+    mmap = rows.find { |r| r.name == 'mmap' }
+    expect(mmap.min).to be < mmap.max
+    expect(rows.first).to be mmap # dearest first
+    expect(rows.map(&:max)).to eq rows.map(&:max).sort.reverse
+  end
+
+  it 'measures each architecture the filter handles' do
+    raw = SeccompTools::Asm.asm(<<-EOS, arch: :amd64)
+      A = arch
+      A == ARCH_X86_64 ? amd64 : next
+      A == ARCH_I386 ? i386 : kill
+      amd64:
+      A = sys_number
+      A == read ? allow : kill
+      i386:
+      return ALLOW
+      kill:
+      return KILL
+      allow:
+      return ALLOW
+    EOS
+    rows = report_of(raw).sections.to_h { |s| [s.arch, s.rows.to_h { |r| [r.name, [r.min, r.max]] }] }
+    expect(rows.keys).to contain_exactly('amd64', 'i386')
+    # the allowed and the killed syscalls take paths of the same length
+    expect(rows['amd64'].values_at('read', 'write')).to eq [[5, 5], [5, 5]]
+    expect(rows['i386']['read']).to eq [4, 4]
+  end
+
+  it 'weights the average by a profile' do
+    report = report_of(data('gctf-2019-quals-caas.bpf'), profile: { read: 3, mmap: 1, nonexistent: 100 })
+    rows = report.sections.first.rows.to_h { |r| [r.name, r] }
+    min, max, calls = report.sections.first.weighted({ read: 3, mmap: 1, nonexistent: 100 })
+    expect(calls).to eq 4
+    expect(min).to eq ((rows['read'].min * 3) + rows['mmap'].min).fdiv(4)
+    expect(max).to eq ((rows['read'].max * 3) + rows['mmap'].max).fdiv(4)
+    expect(report.to_s).to include('Weighted by the profile (4 calls)')
+    expect(report.to_h[:arches].first[:profile]).to eq(calls: 4, min:, max:)
+  end
+
+  it 'adds up stacked filters' do
+    diary = report_of(data('twctf-2016-diary.bpf'))
+    lib = report_of(data('libseccomp.bpf'))
+    total = SeccompTools::Cost::Report.stack([diary, lib], source: 'both')
+    write = ->(r) { r.sections.first.rows.find { |row| row.name == 'write' } }
+    expect(write[total].max).to eq write[diary].max + write[lib].max
+    expect(total.to_s).to start_with('Syscall cost of both')
+  end
+
+  it 'lists only the dearest syscalls with top' do
+    out = report_of(data('gctf-2019-quals-caas.bpf')).to_s(top: 2)
+    expect(out).to include('    mmap    24 - 46', '    socket  23 - 33', "    ... #{774 - 2} more")
+  end
+
+  it 'has a single row for an architecture without a syscall table' do
+    raw = SeccompTools::Asm.asm(<<-EOS, arch: :amd64)
+      A = arch
+      A == 0x1234 ? next : kill
+      return ALLOW
+      kill:
+      return KILL
+    EOS
+    section = report_of(raw).sections.first
+    expect(section.rows.map(&:to_a)).to eq [[SeccompTools::Cost::Section::ANY, nil, 3, 3]]
+  end
+end
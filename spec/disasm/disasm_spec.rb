@@ -1,6 +1,8 @@
 # encoding: ascii-8bit
 # frozen_string_literal: true
 
+require 'stringio'
+
 require 'seccomp-tools/asm/asm'
 require 'seccomp-tools/disasm/disasm'
 require 'seccomp-tools/util'
@@ -420,6 +422,22 @@ describe SeccompTools::Disasm do
     )
   end
 
+  it 'streams lines as they are settled' do
+    bpf = File.binread(File.join(__dir__, '..', 'data', 'libseccomp.bpf'))
+    expect(described_class.each_line(bpf, arch: :amd64).to_a.join).to eq described_class.disasm(bpf, arch: :amd64)
+    io = StringIO.new
+    described_class.write(io, bpf, arch: :amd64, display_bpf: false)
+    expect(io.string).to eq described_class.disasm(bpf, arch: :amd64, display_bpf: false)
+
+    # The lines before an invalid one are out before it fails.
+    lines = []
+    bad = "#{SeccompTools::Asm.asm("A = sys_number\nreturn ALLOW", arch: :amd64)}#{0x55.chr}#{"\x00" * 7}"
+    expect { described_class.each_line(bad, arch: :amd64, display_bpf: false) { |l| lines << l } }
+      .to raise_error(ArgumentError, 'Line 2 is invalid: unknown jmp type')
+    expect(lines).to eq ["0000: A = sys_number\n", "0001: return ALLOW\n"]
+    expect(described_class.disasm('', arch: :amd64, display_bpf: false)).to eq "\n"
+  end
+
   it 'supports don\'t display BPF' do
     bpf = [0x15, 0x25, 0x35, 0x45].map { |c| "#{c.chr}\x00\x00\x01\x00\x00\x00\x00" }.join
     expect(described_class.disasm(bpf, arch: :amd64, display_bpf: false)).to eq(<<-EOS)
@@ -536,4 +554,16 @@ describe SeccompTools::Disasm do
       expect(SeccompTools::Asm.asm(out.sub(/\A\d+: /, ''), arch: :amd64)).to eq raw # faithful round-trip
     end
   end
+
+  it 'keeps a bounded number of states per line however many paths join' do
+    # Every block rejoins after testing the arguments of one syscall: enumerated, the paths
+    # reaching block n number 2**n.
+    src = Array.new(60) do |i|
+      "A = sys_number\nif (A != #{i}) goto b#{i}\nA = args[0]\nif (A == 1) goto b#{i}\nA = args[1]\nb#{i}:"
+    end.join("\n") + "\nreturn ALLOW"
+    codes = described_class.track(described_class.to_bpf(SeccompTools::Asm.asm(src, arch: :amd64), :amd64))
+    expect(codes.map { |c| c.states.size }.max).to be <= described_class::WIDEN
+    out = described_class.disasm(SeccompTools::Asm.asm(src, arch: :amd64), arch: :amd64, display_bpf: false)
+    expect(out).to include("0297: A = filename # execve(filename, argv, envp)")
+  end
 end
@@ -0,0 +1,74 @@
+# encoding: ascii-8bit
+# frozen_string_literal: true
+
+require 'seccomp-tools/disasm/program'
+
+describe SeccompTools::Disasm::Program do
+  def filter(*insts, endian: '<')
+    insts.map { |code, jt, jf, k| [code, jt, jf, k].pack("S#{endian}CCL#{endian}") }.join
+  end
+
+  ret_allow = [0x06, 0, 0, 0x7fff0000]
+  files = Dir[File.join(__dir__, '..', 'data', '*.bpf')].sort
+
+  shared_examples 'a decoder' do
+    it 'decodes the fields of every instruction in the byte order of the architecture' do
+      insts = [[0x20, 0, 0, 4], [0x15, 1, 2, 0xc000003e], ret_allow]
+      le = described_class.new(filter(*insts) + "\x01\x02".b, :amd64)
+      be = described_class.new(filter(*insts, endian: '>'), :s390x)
+      [le, be].each do |prog|
+        expect(prog.size).to be 3
+        expect([prog.codes, prog.jts, prog.jfs, prog.ks]).to eq insts.transpose
+      end
+    end
+
+    it 'builds the BPF of a line only when asked for, once' do
+      prog = described_class.new(File.binread(files.first), :amd64)
+      expect(prog.instance_variable_get(:@bpfs)).to be_empty
+      expect(prog[1]).to be prog[1]
+      expect(prog.instance_variable_get(:@bpfs).compact.size).to be 1
+      expect(prog[prog.size]).to be_nil
+      expect(prog.map(&:asm).join).to eq File.binread(files.first)
+    end
+
+    it 'accepts the filters the kernel accepts' do
+      (files - [File.join(__dir__, '..', 'data', 'all_inst.bpf')]).each do |f|
+        expect(described_class.new(File.binread(f), :amd64).check).to be_nil
+      end
+      stored = filter([0x00, 0, 0, 1], [0x15, 0, 1, 0], [0x02, 0, 0, 3], [0x03, 0, 0, 3], [0x60, 0, 0, 3], ret_allow)
+      expect(described_class.new(stored, :amd64)).to be_valid
+    end
+
+    it 'tells why the kernel refuses a filter' do
+      expect(described_class.new('', :amd64).check).to eq [nil, 'empty filter']
+      expect(described_class.new(filter(ret_allow) * 4097, :amd64).check).to eq [nil, 'too many instructions']
+      {
+        [[0x20, 0, 0, 64], ret_allow] => [0, 'invalid seccomp_data offset'],
+        [[0x20, 0, 0, 2], ret_allow] => [0, 'invalid seccomp_data offset'],
+        [[0x30, 0, 0, 0], ret_allow] => [0, 'invalid opcode'], # A = data[k] as a byte
+        [[0x94, 0, 0, 3], ret_allow] => [0, 'invalid opcode'], # A %= k
+        [[0x34, 0, 0, 0], ret_allow] => [0, 'division by zero'],
+        [[0x64, 0, 0, 32], ret_allow] => [0, 'shift out of range'],
+        [[0x02, 0, 0, 16], ret_allow] => [0, 'scratch memory index out of range'],
+        [[0x05, 0, 0, 1], ret_allow] => [0, 'jump out of range'],
+        [[0x15, 0, 1, 0], ret_allow] => [0, 'jump out of range'],
+        [[0x00, 0, 0, 0]] => [0, 'last instruction is not a return'],
+        [[0x15, 0, 1, 0], [0x02, 0, 0, 0], [0x60, 0, 0, 0], ret_allow] => [2, 'scratch memory read before written']
+      }.each do |insts, reason|
+        expect(described_class.new(filter(*insts), :amd64).check).to eq reason
+      end
+    end
+  end
+
+  context 'when native' do
+    before { skip 'C extension not built' unless described_class.native? }
+
+    include_examples 'a decoder'
+  end
+
+  context 'when in Ruby' do
+    before { allow(described_class).to receive(:native?).and_return(false) }
+
+    include_examples 'a decoder'
+  end
+end
@@ -61,6 +61,43 @@ describe SeccompTools::Dumper do
       end
     end
 
+    context 'trap' do
+      it 'dumps the same filters as single-stepping' do
+        # libseccomp probes strict mode with flags the kernel refuses before installing its filter
+        limits = { 'twctf-2016-diary' => 1, 'clone_two_seccomp' => 2, 'syscall_seccomp' => 1, 'libseccomp' => 1 }
+        limits.each do |name, limit|
+          bin = bin_of(name)
+          expect(described_class.dump(bin, limit:, trap: true)).to eq described_class.dump(bin, limit:)
+        end
+      end
+
+      it 'dumps strict mode' do
+        expect(described_class.dump(bin_of('strict_prctl'), trap: true))
+          .to eq described_class.dump(bin_of('strict_prctl'))
+      end
+
+      it 'follows forked children' do
+        output = described_class.dump("sleep 0; #{bin_of('syscall_seccomp')}", trap: true)
+        expect(output.size).to be 1
+      end
+    end
+
+    context 'native engine' do
+      it 'traces natively' do
+        expect(SeccompTools::Ptrace).to receive(:trace).and_call_original
+        expect(described_class.dump(bin_of('clone_two_seccomp'), limit: 2).size).to be 2
+      end
+
+      it 'falls back to tracing in Ruby' do
+        # as on a kernel without PTRACE_GET_SYSCALL_INFO
+        allow(SeccompTools::Ptrace).to receive(:trace).and_return(false)
+        expect(described_class.dump(bin_of('clone_two_seccomp'), limit: 2).size).to be 2
+        expect(described_class.dump(bin_of('strict_prctl'), trap: true).size).to be 1
+        # libseccomp probes strict mode with flags the kernel refuses before installing its filter
+        expect(described_class.dump(bin_of('libseccomp'), trap: true)).to eq described_class.dump(bin_of('libseccomp'))
+      end
+    end
+
     context 'no seccomp' do
       it { expect(described_class.dump('ls >/dev/null')).to be_empty }
     end
@@ -98,6 +135,28 @@ describe SeccompTools::Dumper do
       expect(Process.clock_gettime(Process::CLOCK_MONOTONIC) - start).to be < 1
     end
 
+    it 'kills the process when tracing in Ruby' do
+      allow(SeccompTools::Ptrace).to receive(:trace).and_return(false)
+      start = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+      expect(described_class.dump('sleep', '1d', timeout: 0.1)).to be_empty
+      expect(Process.clock_gettime(Process::CLOCK_MONOTONIC) - start).to be < 1
+    end
+
+    it 'waits no longer than the deadline' do
+      skip 'ptrace is Linux-only' unless described_class::SUPPORTED
+
+      pid = Process.spawn('sleep', '1d')
+      begin
+        start = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+        expect(SeccompTools::Ptrace.wait(start + 0.05)).to be_nil
+        expect(Process.clock_gettime(Process::CLOCK_MONOTONIC) - start).to be_between(0.05, 0.5)
+        expect(SeccompTools::Ptrace.wait(start)).to be_nil
+      ensure
+        Process.kill('KILL', pid)
+        Process.wait(pid)
+      end
+    end
+
     it 'returns the filters dumped before the timeout' do
       skip_unless_amd64
 
@@ -148,6 +207,37 @@ describe SeccompTools::Dumper do
     end
   end
 
+  describe 'all' do
+    it 'dumps every process once per distinct filter' do
+      skip_unless_amd64
+      skip_unless_root
+
+      ios = Array.new(3) { IO.popen(bin_of('two_filters'), 'r+') }
+      begin
+        ios.each(&:gets) # seccomp installed
+        pids = ios.map(&:pid).sort
+        expected = described_class.dump_by_pid(pids.first, -1)
+        output = described_class.dump_all(-1) { |bpf, arch, ps| [bpf, arch, ps & pids] }
+        expect(output).to include([expected[0], :amd64, pids], [expected[1], :amd64, pids])
+        expect(output.map(&:first).count(expected[0])).to be 1
+        expect(described_class.dump_all(1) { |bpf, _arch, ps| [bpf, ps & pids] }).not_to include([expected[1], pids])
+      ensure
+        ios.each do |io|
+          io.puts
+          io.close
+        end
+      end
+    end
+
+    it 'raises when permission is denied' do
+      skip 'ptrace is Linux-only' unless described_class::SUPPORTED
+
+      allow(described_class).to receive(:seccomp_tids).and_return({ 1 => 1 })
+      allow(SeccompTools::Ptrace).to receive(:seccomp_get_filters).and_return([Errno::EPERM::Errno])
+      expect { described_class.dump_all(1) }.to raise_error(Errno::EPERM)
+    end
+  end
+
   it 'should output warning and exit(1)' do
     allow(SeccompTools::Ptrace).to receive(:traceme_and_stop)
     expect { described_class.__send__(:handle_child, 'no_such_binary') }
@@ -193,4 +193,177 @@ describe SeccompTools::Emulator do
       expect(described_class.new(insts, instruction_pointer: 0xbeef0000dead, arch: :s390x).run[:ret]).to be 0x7fff0000
     end
   end
+
+  context 'run_batch' do
+    def insts_of(src, arch)
+      SeccompTools::Disasm.to_bpf(SeccompTools::Asm.asm(src, arch:), arch).map(&:inst)
+    end
+
+    def bpf_insts(file, arch)
+      SeccompTools::Disasm.to_bpf(File.binread(File.join(__dir__, 'data', file)), arch).map(&:inst)
+    end
+
+    it 'agrees with run' do
+      rng = Random.new(1337)
+      { 'twctf-2016-diary.bpf' => :amd64, 'libseccomp.bpf' => :amd64, 'CONFidence-2017-amigo.bpf' => :i386,
+        'misc_alu.bpf' => :i386, 'DEF-CON-2020-bdooos.bpf' => :aarch64, 'all_inst.bpf' => :amd64,
+        'gctf-2019-quals-caas.bpf' => :amd64 }.each do |file, arch|
+        insts = bpf_insts(file, arch)
+        inputs = Array.new(300) do |i|
+          { sys_nr: i, args: Array.new(6) { rng.rand(2**64) }, instruction_pointer: rng.rand(2**64) }
+        end
+        expected = inputs.map do |input|
+          described_class.new(insts, **input, arch:).run[:ret]
+        rescue StandardError
+          :error # +run+ does not check every fault, e.g. leaves an unset +mem+ slot as +nil+
+        end
+        actual = inputs.map do |input|
+          described_class.new(insts, arch:).run_batch([input]).first
+        rescue StandardError
+          :error
+        end
+        expect(actual).to eq(expected), file
+      end
+    end
+
+    it 'defaults missing keys to the instantiated values' do
+      insts = bpf_insts('CONFidence-2017-amigo.bpf', :i386)
+      emu = described_class.new(insts, sys_nr: 4, args: [0, 0, 0, 0, 0, 0x313373133731337], arch: :amd64)
+      expect(emu.run_batch([{}, { args: [0] * 6 }, { sys_nr: 4 }])).to eq [0x7fff0000, 0, 0x7fff0000]
+    end
+
+    it 'compiles once into four integers per instruction' do
+      insts = bpf_insts('twctf-2016-diary.bpf', :amd64)
+      emu = described_class.new(insts)
+      expect(emu.compile).to be emu.compile
+      expect(emu.compile.size).to be insts.size * 4
+      expect(emu.compile).to all(be_a(Integer))
+    end
+
+    it 'raises on undefined data like run' do
+      insts = bpf_insts('twctf-2016-diary.bpf', :amd64)
+      error = "Undefined Variable\n\t0000: A = sys_number <- `sys_number` is undefined"
+      expect { described_class.new(insts).run_batch([{}]) }.to raise_error(RuntimeError, error)
+    end
+
+    it 'aborts with KILL_THREAD on division by zero' do
+      insts = insts_of(<<-EOS, :amd64)
+        A = args[0]
+        X = A
+        A = 100
+        A /= X
+        return A
+      EOS
+      emu = described_class.new(insts, arch: :amd64)
+      expect(emu.run_batch([{ args: [0] }, { args: [7] }])).to eq [0, 14]
+    end
+
+    it 'keeps scratch memory per input' do
+      insts = insts_of(<<-EOS, :amd64)
+        A = sys_number
+        A == 1 ? next : load
+        mem[3] = A
+      load:
+        A = mem[3]
+        return A
+      EOS
+      emu = described_class.new(insts, arch: :amd64)
+      expect(emu.run_batch([{ sys_nr: 1 }])).to eq [1]
+      expect { emu.run_batch([{ sys_nr: 1 }, { sys_nr: 2 }]) }.to raise_error(RuntimeError, /`mem\[3\]` is undefined/)
+    end
+
+    it 'reads big-endian words' do
+      insts = insts_of(<<-EOS, :s390x)
+        A = data[32]
+        A == 0x11223344 ? next : allow
+        A = data[36]
+        A == 0x55667788 ? kill : allow
+      allow:
+        return ALLOW
+      kill:
+        return KILL
+      EOS
+      emu = described_class.new(insts, sys_nr: 4, arch: :s390x)
+      expect(emu.run_batch([{ args: [0, 0, 0x1122334455667788] }, { args: [0, 0, 0x5566778811223344] }]))
+        .to eq [0, 0x7fff0000]
+    end
+  end
+
+  context 'evaluate_many' do
+    # A random filter using every opcode, whose paths diverge across inputs. Shifting by X is left out:
+    # {SeccompTools::Emulator#run} would build a huge Integer for it.
+    def random_filter(rng, size)
+      insts = [[0x02, 0], [0x02, 1]] # mem[0], mem[1] = A
+      until insts.size == size - 2
+        left = size - insts.size - 1
+        insts << case rng.rand(9)
+                 when 0 then [0x20, [0, 4, 8, 12, 16, 20, 24, 36, 60].sample(random: rng)]
+                 when 1 then [[0x00, 0x01].sample(random: rng), rng.rand(2**32)]
+                 when 2 then [[0x60, 0x61, 0x02, 0x03].sample(random: rng), rng.rand(2)]
+                 when 3, 4
+                   [[0x04, 0x14, 0x24, 0x34, 0x44, 0x54, 0xa4, 0x0c, 0x1c, 0x2c, 0x3c, 0x4c, 0x5c, 0xac, 0x7c]
+                     .sample(random: rng), rng.rand(2**32)]
+                 when 5 then [[0x64, 0x74].sample(random: rng), rng.rand(40)]
+                 when 6 then [[0x84, 0x07, 0x87].sample(random: rng), 0]
+                 else
+                   [[0x05, 0x15, 0x25, 0x35, 0x45, 0x1d, 0x2d, 0x3d, 0x4d].sample(random: rng),
+                    [rng.rand(2**32), rng.rand(1024)].sample(random: rng), rng.rand(left), rng.rand(left)]
+                 end
+        insts[-1][1] = rng.rand(left) if insts[-1][0] == 0x05
+      end
+      insts << [0x16, 0] << [0x06, 0x7fff0000]
+      raw = insts.map { |code, k, jt = 0, jf = 0| [code, jt, jf, k].pack('SCCL') }.join
+      SeccompTools::Disasm.to_bpf(raw, :amd64).map(&:inst)
+    end
+
+    def actions_of(insts, inputs)
+      inputs.map do |input|
+        described_class.new(insts, **input, arch: :amd64).run[:ret]
+      rescue StandardError
+        :error
+      end
+    end
+
+    it 'agrees bit-for-bit with run' do
+      rng = Random.new(31_337)
+      50.times do
+        insts = random_filter(rng, 40)
+        inputs = Array.new(100) do
+          { sys_nr: rng.rand(1024), args: Array.new(6) { [rng.rand(2**64), rng.rand(4)].sample(random: rng) },
+            instruction_pointer: rng.rand(2**64) }
+        end
+        actual = described_class.evaluate_many(insts, arch: :amd64, inputs:)
+        expect(actual).to eq actions_of(insts, inputs)
+      end
+    end
+
+    it 'agrees with run without the C extension' do
+      allow(described_class).to receive(:native?).and_return(false)
+      rng = Random.new(7)
+      10.times do
+        insts = random_filter(rng, 40)
+        inputs = Array.new(20) do
+          { sys_nr: rng.rand(1024), args: Array.new(6) { rng.rand(2**64) }, instruction_pointer: rng.rand(2**64) }
+        end
+        actual = described_class.evaluate_many(insts, arch: :amd64, inputs:)
+        expect(actual).to eq actions_of(insts, inputs)
+      end
+    end
+
+    it 'sweeps every syscall number' do
+      raw = File.binread(File.join(__dir__, 'data', 'libseccomp.bpf'))
+      insts = SeccompTools::Disasm.to_bpf(raw, :amd64).map(&:inst)
+      inputs = (0..1023).map { |nr| { sys_nr: nr } } + [{ sys_nr: 0x40000000 }]
+      expected = inputs.map { |input| described_class.new(insts, **input, args: [0] * 6, arch: :amd64).run[:ret] }
+      expect(described_class.evaluate_many(insts, arch: :amd64, inputs: inputs.map { |i| i.merge(args: [0] * 6) }))
+        .to eq expected
+    end
+
+    it 'leaves undefined data to Ruby' do
+      raw = File.binread(File.join(__dir__, 'data', 'twctf-2016-diary.bpf'))
+      insts = SeccompTools::Disasm.to_bpf(raw, :amd64).map(&:inst)
+      expect { described_class.evaluate_many(insts, arch: :amd64, inputs: [{ sys_nr: 1 }, {}]) }
+        .to raise_error(RuntimeError, /`sys_number` is undefined/)
+    end
+  end
 end
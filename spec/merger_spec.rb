@@ -0,0 +1,118 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/asm/asm'
+require 'seccomp-tools/const'
+require 'seccomp-tools/disasm/disasm'
+require 'seccomp-tools/emulator'
+require 'seccomp-tools/merger'
+
+describe SeccompTools::Merger do
+  def data(name)
+    File.binread(File.join(__dir__, 'data', name))
+  end
+
+  def action(name)
+    SeccompTools::Const::BPF::ACTION[name]
+  end
+
+  # What the kernel returns with +filters+ (oldest first) stacked, by running each of them.
+  def stacked(filters, inputs)
+    rets = filters.reverse.map do |raw|
+      insts = SeccompTools::Disasm.to_bpf(raw, :amd64).map(&:inst)
+      SeccompTools::Emulator.evaluate_many(insts, arch: :amd64, inputs:)
+    end
+    rets.transpose.map { |each| each.reduce { |newer, older| described_class.precedence(newer, older) } }
+  end
+
+  def inputs
+    rng = Random.new(1)
+    [0, 1, 2, 3, 9, 41, 56, 59, 60, 231, 0x40000000, 0x40000001].product([0, 1, 0x1337]).map do |nr, arg|
+      { sys_nr: nr, args: [arg, rng.rand(2**64), 0, 0, 0, 0], instruction_pointer: 0 }
+    end
+  end
+
+  it 'orders actions as the kernel does' do
+    expect(described_class.precedence(action(:ALLOW), action(:KILL_PROCESS))).to eq action(:KILL_PROCESS)
+    expect(described_class.precedence(action(:KILL_PROCESS), action(:KILL_THREAD))).to eq action(:KILL_PROCESS)
+    expect(described_class.precedence(action(:ERRNO) | 1, action(:TRAP))).to eq action(:TRAP)
+    expect(described_class.precedence(action(:LOG), action(:ALLOW))).to eq action(:LOG)
+    # the newer filter's data wins a tie
+    expect(described_class.precedence(action(:ERRNO) | 1, action(:ERRNO) | 2)).to eq action(:ERRNO) | 1
+  end
+
+  [
+    %w[libseccomp.bpf gctf-2019-quals-caas.bpf],
+    %w[gctf-2019-quals-caas.bpf twctf-2016-diary.bpf],
+    %w[twctf-2016-diary.bpf mixed_arch.bpf libseccomp.bpf]
+  ].each do |names|
+    it "merges #{names.join(' and ')} into an equivalent filter" do
+      filters = names.map { |name| data(name) }
+      merger = described_class.new(filters, arch: :amd64)
+      expected = stacked(filters, inputs)
+      [merger.compose, merger.merge].each do |raw|
+        insts = SeccompTools::Disasm.to_bpf(raw, :amd64).map(&:inst)
+        expect(SeccompTools::Emulator.evaluate_many(insts, arch: :amd64, inputs:)).to eq expected
+      end
+    end
+  end
+
+  it 'stops once the result is as restrictive as anything left' do
+    allow_all = SeccompTools::Asm.asm('return ALLOW', arch: :amd64)
+    deny_read = SeccompTools::Asm.asm(<<-EOS, arch: :amd64)
+      A = sys_number
+      A == read ? kill : next
+      return ALLOW
+      kill:
+      return KILL_PROCESS
+    EOS
+    # the newest filter kills read, which nothing beats, and allows the rest, which is all the
+    # older one returns
+    raw = described_class.new([allow_all, deny_read], arch: :amd64).compose
+    expect(raw).to eq deny_read
+    expect(described_class.new([deny_read, allow_all], arch: :amd64).merge.size).to be < (deny_read + allow_all).size
+  end
+
+  it 'lets the newer filter decide a tie' do
+    older = SeccompTools::Asm.asm('return ERRNO(1)', arch: :amd64)
+    newer = SeccompTools::Asm.asm('return ERRNO(2)', arch: :amd64)
+    raw = described_class.new([older, newer], arch: :amd64).merge
+    expect(SeccompTools::Disasm.disasm(raw, arch: :amd64)).to include('return ERRNO(2)')
+  end
+
+  it 'clears A and X for a filter that relies on their initial value' do
+    first = SeccompTools::Asm.asm(<<-EOS, arch: :amd64)
+      A = sys_number
+      X = A
+      return ALLOW
+    EOS
+    second = SeccompTools::Asm.asm(<<-EOS, arch: :amd64)
+      A == X ? next : kill
+      return ERRNO(1)
+      kill:
+      return KILL
+    EOS
+    filters = [second, first]
+    raw = described_class.new(filters, arch: :amd64).compose
+    insts = SeccompTools::Disasm.to_bpf(raw, :amd64).map(&:inst)
+    expect(SeccompTools::Emulator.evaluate_many(insts, arch: :amd64, inputs:)).to eq stacked(filters, inputs)
+  end
+
+  it 'refuses a filter returning A' do
+    ret_a = SeccompTools::Asm.asm(<<-EOS, arch: :amd64)
+      A = 0x7fff0000
+      return A
+    EOS
+    expect { described_class.new([ret_a, data('libseccomp.bpf')], arch: :amd64).merge }
+      .to raise_error(SeccompTools::MergeError, 'Filter #0 returns A at line 1.')
+  end
+
+  it 'refuses a merge larger than the kernel accepts' do
+    # every result of the newer filter needs its own copy of the older one
+    many = lambda do |act|
+      SeccompTools::Asm.asm("#{(0...64).map { |i| "A == #{i} ? r#{i} : next" }.join("\n")}\nreturn ALLOW\n" \
+                            "#{(0...64).map { |i| "r#{i}:\nreturn #{act}(#{i})" }.join("\n")}", arch: :amd64)
+    end
+    expect { described_class.new([many['ERRNO'], many['TRACE']], arch: :amd64).compose }
+      .to raise_error(SeccompTools::MergeError, /more than the kernel accepts/)
+  end
+end
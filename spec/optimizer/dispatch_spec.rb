@@ -0,0 +1,64 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/asm/asm'
+require 'seccomp-tools/audit/policy'
+require 'seccomp-tools/disasm/disasm'
+require 'seccomp-tools/explain/analysis'
+require 'seccomp-tools/optimizer/dispatch'
+require 'seccomp-tools/symbolic/executor'
+
+describe SeccompTools::Optimizer::Dispatch do
+  def dispatch_of(src, profile = {})
+    insts = SeccompTools::Disasm.to_bpf(SeccompTools::Asm.asm(src, arch: :amd64), :amd64).map(&:inst)
+    analysis = SeccompTools::Explain::Analysis.new(SeccompTools::Symbolic::Executor.new(insts).run.first)
+    described_class.of(SeccompTools::Audit::Policy.new(analysis, analysis.sections(:amd64).first), profile)
+  end
+
+  let(:src) do
+    <<-EOS
+      A = sys_number
+      A >= 0x40000000 ? kill : next
+      A == read ? allow : next
+      A == write ? allow : next
+      A == socket ? check : kill
+      check:
+      A = args[0]
+      A == 1 ? allow : kill
+      kill:
+      return KILL
+      allow:
+      return ALLOW
+    EOS
+  end
+
+  it 'merges the syscall numbers into ranges of one action' do
+    allow_ = 0x7fff0000
+    ranges = dispatch_of(src).ranges.map { |r| [r.lo, r.hi, r.action] }
+    expect(ranges).to eq [[0, 1, allow_], [2, 40, 0], [41, 41, :fallback], [42, 0xffffffff, 0]]
+  end
+
+  it 'leaves a syscall checking its arguments to the original filter' do
+    d = dispatch_of(src, { socket: 50 })
+    expect(d.fallback?).to be true
+    # the search splits at socket first, as it weighs the most
+    expect(d.assembly('p_')).to eq ['A = sys_number', 'A >= 0x29 ? p_range1 : next', 'A >= 0x2 ? p_range2 : next',
+                                    'return 0x7fff0000', 'p_range2:', 'return 0x0', 'p_range1:',
+                                    'A >= 0x2a ? p_range3 : next', 'goto fallback', 'p_range3:', 'return 0x0']
+  end
+
+  it 'checks a hot syscall before searching when that is cheaper' do
+    d = dispatch_of(<<-EOS, { close: 100, mmap: 1 })
+      A = sys_number
+      A == read ? allow : next
+      A == close ? allow : next
+      A == mmap ? allow : next
+      return KILL
+      allow:
+      return ALLOW
+    EOS
+    expect(d.fallback?).to be false
+    # close would take two comparisons to single out in the search, but one here
+    expect(d.assembly('p_').first(4)).to eq ['A = sys_number', 'A != 0x3 ? p_hot0 : next', 'return 0x7fff0000',
+                                             'p_hot0:']
+  end
+end
@@ -0,0 +1,107 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/asm/asm'
+require 'seccomp-tools/cost'
+require 'seccomp-tools/disasm/disasm'
+require 'seccomp-tools/emulator'
+require 'seccomp-tools/optimizer'
+
+describe SeccompTools::Optimizer do
+  # What a config tool generates: the architecture check, then one test per allowed syscall, with
+  # the hot ones last.
+  let(:generated) do
+    allowed = %i[openat close fstat mmap mprotect munmap brk rt_sigaction rt_sigprocmask ioctl pread64 readv
+                 writev access pipe select sched_yield mremap madvise dup dup2 nanosleep getpid clone exit
+                 exit_group epoll_wait epoll_ctl read write futex]
+    SeccompTools::Asm.asm(<<~EOS, arch: :amd64)
+      A = arch
+      A == ARCH_X86_64 ? next : kill
+      A = sys_number
+      A >= 0x40000000 ? kill : next
+      #{allowed.map { |s| "A == #{s} ? allow : next" }.join("\n")}
+      kill:
+      return KILL
+      allow:
+      return ALLOW
+    EOS
+  end
+  let(:profile) { { read: 5000, write: 4000, futex: 2500, epoll_wait: 800, openat: 10 } }
+
+  def insts(raw)
+    SeccompTools::Disasm.to_bpf(raw, :amd64).map(&:inst)
+  end
+
+  def data(name)
+    File.binread(File.join(__dir__, 'data', name))
+  end
+
+  def cost_of(raw, name)
+    SeccompTools::Cost.new(insts(raw), arch: :amd64).cost.sections.first.rows.find { |r| r.name == name }.max
+  end
+
+  # Returns of +raw+ for every syscall number of both architectures, and a few around them.
+  def sweep(raw)
+    nrs = (0..500).to_a + [0x3fffffff, 0x40000000, 0x40000001, 0xffffffff]
+    inputs = nrs.map { |nr| { sys_nr: nr, args: [0, 2, 1, 0, 0, 0], instruction_pointer: 0 } }
+    %i[amd64 i386].map { |arch| SeccompTools::Emulator.evaluate_many(insts(raw), arch:, inputs:) }
+  end
+
+  it 'decides the hottest syscalls first' do
+    out = described_class.new(generated, arch: :amd64, profile:).optimize
+    expect(sweep(out)).to eq sweep(generated)
+    expect(cost_of(generated, 'read')).to eq 34
+    # A = arch, the arch check, A = sys_number, one comparison, return
+    expect([cost_of(out, 'read'), cost_of(out, 'write')]).to eq [5, 5]
+    expect(cost_of(out, 'futex')).to be < cost_of(out, 'epoll_wait')
+    # the filter decides every syscall on its own, so the original is not appended
+    expect(out).not_to include(generated)
+  end
+
+  it 'balances the search without a profile' do
+    out = described_class.new(generated, arch: :amd64).optimize
+    expect(sweep(out)).to eq sweep(generated)
+    costs = SeccompTools::Cost.new(insts(out), arch: :amd64).cost.sections.first.rows.map(&:max)
+    expect(costs.max).to be <= 12
+  end
+
+  it 'leaves argument checks to the original filter' do
+    raw = data('gctf-2019-quals-caas.bpf')
+    out = described_class.new(raw, arch: :amd64, profile: { read: 100, socket: 10 }).optimize
+    expect(out).to end_with(raw)
+    expect(sweep(out)).to eq sweep(raw)
+    expect(cost_of(out, 'read')).to be < cost_of(raw, 'read')
+  end
+
+  it 'dispatches every architecture the filter handles' do
+    raw = SeccompTools::Asm.asm(<<-EOS, arch: :amd64)
+      A = arch
+      A == ARCH_I386 ? i386 : next
+      A == ARCH_X86_64 ? next : kill
+      A = sys_number
+      A == read ? allow : next
+      A == write ? allow : kill
+      i386:
+      A = sys_number
+      A == 3 ? allow : kill
+      kill:
+      return KILL
+      allow:
+      return ALLOW
+    EOS
+    out = described_class.new(raw, arch: :amd64).optimize
+    expect(sweep(out)).to eq sweep(raw)
+    expect(SeccompTools::Disasm.disasm(out, arch: :amd64, display_bpf: false))
+      .to start_with("0000: A = arch\n0001: if (A == ARCH_X86_64) goto 0004\n")
+  end
+
+  it 'relaxes a dispatch beyond the reach of a conditional jump' do
+    rules = (0..299).map { |nr| "A != #{nr * 2} ? skip#{nr} : next\nreturn ALLOW\nskip#{nr}:" }
+    raw = SeccompTools::Asm.asm(<<~EOS, arch: :amd64)
+      A = sys_number
+      #{rules.join("\n")}
+      return KILL
+    EOS
+    out = described_class.new(raw, arch: :amd64).optimize
+    expect(sweep(out)).to eq sweep(raw)
+  end
+end
@@ -0,0 +1,175 @@
+# frozen_string_literal: true
+
+require 'socket'
+require 'tmpdir'
+
+require 'seccomp-tools/cli/cli'
+require 'seccomp-tools/client'
+require 'seccomp-tools/server'
+
+describe SeccompTools::Server do
+  around do |example|
+    Dir.mktmpdir do |dir|
+      @path = File.join(dir, 'serve.sock')
+      example.run
+    ensure
+      stop
+    end
+  end
+
+  def data(name)
+    File.join(__dir__, 'data', name)
+  end
+
+  def start
+    ready_r, ready_w = IO.pipe
+    @pid = fork do
+      ready_r.close
+      described_class.new(@path).run { ready_w.close }
+    ensure
+      exit!(0)
+    end
+    ready_w.close
+    ready_r.read
+  end
+
+  def stop
+    return unless @pid
+
+    Process.kill('TERM', @pid)
+    Process.wait(@pid)
+    @pid = nil
+  end
+
+  # The status and output of +argv+ run through the server, reading +stdin+.
+  def forward(argv, stdin: nil)
+    out_r, out_w = IO.pipe
+    orig = [$stdin, $stdout]
+    $stdin = stdin ? File.open(stdin, 'rb') : orig.first
+    $stdout = out_w
+    status = SeccompTools::Client.forward(argv, path: @path)
+    out_w.close
+    [status, out_r.read]
+  ensure
+    $stdin.close if stdin
+    $stdin, $stdout = orig
+  end
+
+  def local(argv)
+    out_r, out_w = IO.pipe
+    orig = $stdout
+    $stdout = out_w
+    SeccompTools::CLI.work(argv)
+    out_w.close
+    out_r.read
+  ensure
+    $stdout = orig
+  end
+
+  it 'runs the commands of clients in their directory, with their streams' do
+    start
+    expect(File.stat(@path).mode & 0o077).to eq 0
+    argv = ['disasm', data('libseccomp.bpf')]
+    expect(forward(argv)).to eq [0, local(argv)]
+    explained = local(['explain', data('libseccomp.bpf'), '-a', 'amd64']).sub(data('libseccomp.bpf'), '<STDIN>')
+    expect(forward(%w[explain - -a amd64], stdin: data('libseccomp.bpf'))).to eq [0, explained]
+    Dir.chdir(File.join(__dir__, 'data')) do
+      expect(forward(%w[disasm libseccomp.bpf]).last).to eq local(argv)
+    end
+  end
+
+  it 'runs the commands of clients in their environment' do
+    start
+    ENV['SECCOMP_TOOLS_SPEC'] = 'from the client'
+    status, out = forward(['dump', '-c', 'echo "$SECCOMP_TOOLS_SPEC"'])
+    expect(status).to eq 0
+    expect(out).to include 'from the client'
+  ensure
+    ENV.delete('SECCOMP_TOOLS_SPEC')
+  end
+
+  it 'ignores a socket owned by another user' do
+    start
+    uid = Process.uid
+    allow(Process).to receive(:uid).and_return(uid + 1)
+    expect(forward(%w[--version])).to eq [nil, '']
+  end
+
+  # A client forked to run a program under +dump+, and the pid of that program once it runs.
+  def client_running
+    pidfile = File.join(File.dirname(@path), 'pid')
+    client = fork do
+      $stdout.reopen(File::NULL)
+      exit!(SeccompTools::Client.forward(['dump', '-c', "echo $$ > #{pidfile}; exec sleep 60"], path: @path) || 2)
+    end
+    sleep(0.05) until File.size?(pidfile)
+    [client, Integer(File.read(pidfile))]
+  end
+
+  # Whether the process +pid+, not a child of ours, ends within 5 seconds.
+  def ends?(pid)
+    50.times do
+      state = File.read("/proc/#{pid}/stat")[/\) (\S)/, 1]
+      return true if state == 'Z'
+
+      sleep(0.1)
+    rescue Errno::ENOENT
+      return true
+    end
+    false
+  end
+
+  it 'relays signals to the command, and dies of the one that kills it' do
+    start
+    client, program = client_running
+    Process.kill('TERM', client)
+    expect(Process.wait2(client).last.termsig).to eq Signal.list['TERM']
+    expect(ends?(program)).to be true
+  end
+
+  it 'kills the command of a client that went away' do
+    start
+    client, program = client_running
+    Process.kill('KILL', client)
+    Process.wait(client)
+    expect(ends?(program)).to be true
+  end
+
+  it 'serves clients concurrently' do
+    start
+    clients = Array.new(4) do
+      r, w = IO.pipe
+      pid = fork do
+        r.close
+        w.write(Marshal.dump(forward(['audit', data('twctf-2016-diary.bpf'), '-a', 'amd64'])))
+      ensure
+        exit!(0)
+      end
+      w.close
+      [pid, r]
+    end
+    outs = clients.map do |pid, r|
+      Process.wait(pid)
+      Marshal.load(r.read) # rubocop:disable Security/MarshalLoad
+    end
+    expect(outs.uniq.size).to eq 1
+    expect(outs.first.first).to eq 0
+    expect(outs.first.last).to include('x32 ABI is not guarded')
+  end
+
+  it 'is not used when absent or running another version' do
+    expect(forward(%w[--version])).to eq [nil, '']
+    start
+    stub_const('SeccompTools::VERSION', '0.0.0')
+    expect(forward(%w[--version])).to eq [nil, '']
+  end
+
+  it 'replaces a socket left by a server that died, but not a live one' do
+    UNIXServer.new(@path).close
+    start
+    expect { described_class.new(@path).run }.to raise_error(Errno::EADDRINUSE)
+    expect(forward(%w[--version]).first).to eq 0
+    stop
+    expect(File.exist?(@path)).to be false
+  end
+end
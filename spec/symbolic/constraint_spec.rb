@@ -13,7 +13,7 @@ describe SeccompTools::Symbolic::Constraint do
       # an already-normal fact is untouched, and the two spellings are one value
       d = described_class.new(expr.data(0), :<, expr.imm(5))
       expect([d.lhs, d.op, d.rhs]).to eq [expr.data(0), :<, expr.imm(5)]
-      expect(c.key).to eq d.key
+      expect(c).to be d
     end
 
     it 'leaves facts with no lone constant to swap' do
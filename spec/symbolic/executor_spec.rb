@@ -20,12 +20,12 @@ describe SeccompTools::Symbolic::Executor do
     SeccompTools::BPF.new({ code:, jt:, jf:, k: }, :amd64, 0).inst
   end
 
-  def run(insts)
-    described_class.new(insts).run
+  def run(insts, exact: false)
+    described_class.new(insts, exact:).run
   end
 
-  def leaves_of(insts)
-    run(insts).first
+  def leaves_of(insts, exact: false)
+    run(insts, exact:).first
   end
 
   def rets(leaves)
@@ -85,6 +85,19 @@ describe SeccompTools::Symbolic::Executor do
     expect(allow_leaf.path.map(&:op)).to include(:==)
   end
 
+  it 'counts the instructions each path executes' do
+    insts = [
+      inst(cmd(:ld, mode: :abs), k: 0),
+      inst(cmd(:jmp, jmp: :jeq, src: :k), jt: 0, jf: 2, k: 1), # sys == 1 ? next : 0005
+      inst(cmd(:ld, mode: :abs), k: 16),
+      inst(cmd(:jmp, jmp: :ja), k: 1), # goto 0005, skipping 0004
+      inst(cmd(:ret), k: 0),
+      inst(cmd(:ret), k: 0x7fff0000)
+    ]
+    # the sys == 1 path runs 0000-0003 and 0005, the other 0000, 0001 and 0005
+    expect(leaves_of(insts).map(&:steps)).to contain_exactly(5, 3)
+  end
+
   it 'narrows on a comparison against register X' do
     insts = [
       inst(cmd(:ldx, mode: :imm), k: 1),
@@ -145,11 +158,11 @@ describe SeccompTools::Symbolic::Executor do
 
   it 'reports truncation when the step cap is hit' do
     stub_const('SeccompTools::Symbolic::Executor::STEP_CAP', 1)
-    _, truncated = run([inst(cmd(:ld, mode: :abs), k: 0), inst(cmd(:ret), k: 0)])
+    _, truncated = run([inst(cmd(:ld, mode: :abs), k: 0), inst(cmd(:ret), k: 0)], exact: true)
     expect(truncated).to be true
   end
 
-  it 'walks re-merging control flow without the visited set degrading to a linear scan' do
+  it 'enumerates re-merging control flow without the visited set degrading to a linear scan' do
     # A chain of N diamonds: each loads a distinct data word, forks on `== k`, and rejoins before
     # the next. Because both branches rejoin, 2^N distinct path conditions reach the final return.
     # The visited set dedups on the state key, which embeds the path condition; that only keeps the
@@ -163,12 +176,75 @@ describe SeccompTools::Symbolic::Executor do
        inst(cmd(:jmp, jmp: :ja), k: 0)] # ...the unconditional rejoin
     end.flatten << inst(cmd(:ret), k: 0x7fff0000)
 
-    leaves = Timeout.timeout(5) { leaves_of(insts) }
+    leaves = Timeout.timeout(5) { leaves_of(insts, exact: true) }
     # Every word is independent, so all 2^N paths are feasible and reach ALLOW.
     expect(leaves.size).to be(2**n)
     expect(rets(leaves).uniq).to eq [0x7fff0000]
   end
 
+  context 'merging' do
+    # N diamonds on distinct words, each side of one running a different number of instructions,
+    # then a test of the first word deciding the result.
+    def diamonds(n)
+      Array.new(n) do |i|
+        [inst(cmd(:ld, mode: :abs), k: 16 + (i * 4)),
+         inst(cmd(:jmp, jmp: :jeq, src: :k), jt: 1, jf: 0, k: i), # A == i -> skip the next line
+         inst(cmd(:ld, mode: :imm), k: 1)]
+      end.flatten + [inst(cmd(:ld, mode: :abs), k: 16),
+                     inst(cmd(:jmp, jmp: :jeq, src: :k), jt: 0, jf: 1, k: 7),
+                     inst(cmd(:ret), k: 0),
+                     inst(cmd(:ret), k: 0x7fff0000)]
+    end
+
+    it 'joins the sides of a jump meeting again into the condition before it' do
+      leaves, truncated = Timeout.timeout(5) { run(diamonds(40)) }
+      expect(truncated).to be false
+      expect(leaves.map { |l| l.path.map { |c| [c.lhs.offset, c.op, c.rhs.val] } })
+        .to eq [[[16, :!=, 7]], [[16, :==, 7]]] # walked in the order the enumerating walk takes
+      expect(rets(leaves)).to eq [0x7fff0000, 0]
+      # every diamond runs its third line on one side only
+      expect(leaves.map { |l| [l.steps, l.max_steps] }).to all(eq [(40 * 2) + 3, (40 * 3) + 3])
+    end
+
+    it 'describes the same inputs as enumerating paths' do
+      enumerated = leaves_of(diamonds(4), exact: true)
+      merged = leaves_of(diamonds(4))
+      expect(enumerated.size).to be 24 # the first diamond's data[16] == 0 contradicts data[16] == 7
+      # each enumerated path implies the merged path of its return, which is as short as it can be
+      enumerated.each do |leaf|
+        expect(merged.find { |m| m.ret == leaf.ret }.path - leaf.path).to eq []
+      end
+      expect(merged.map { |l| [l.steps, l.max_steps] }).to eq(enumerated.map(&:steps).minmax.then { |r| [r, r] })
+    end
+
+    it 'keeps apart states with different registers' do
+      insts = [
+        inst(cmd(:ld, mode: :abs), k: 16),
+        inst(cmd(:jmp, jmp: :jeq, src: :k), jt: 0, jf: 1, k: 1),
+        inst(cmd(:ld, mode: :imm), k: 5), # A = 5 on one side only
+        inst(cmd(:ret, src: :a))
+      ]
+      leaves = leaves_of(insts)
+      expect(leaves.map { |l| l.ret.imm? ? l.ret.val : l.ret.offset }).to eq [16, 5]
+      expect(leaves.map { |l| l.path.map(&:op) }).to eq [[:!=], [:==]]
+    end
+
+    it 'falls back to enumerating paths past the bound' do
+      insts = [
+        inst(cmd(:ld, mode: :abs), k: 16),
+        inst(cmd(:jmp, jmp: :jeq, src: :k), jt: 0, jf: 1, k: 1),
+        inst(cmd(:jmp, jmp: :ja), k: 0), # both sides meet on the next line, and merge
+        inst(cmd(:ld, mode: :abs), k: 20),
+        inst(cmd(:jmp, jmp: :jeq, src: :k), jt: 0, jf: 1, k: 2),
+        inst(cmd(:ld, mode: :imm), k: 5), # A differs on the sides meeting on the return
+        inst(cmd(:ret, src: :a))
+      ]
+      expect(leaves_of(insts).size).to be 2
+      stub_const('SeccompTools::Symbolic::Executor::MERGE_BOUND', 1)
+      expect(leaves_of(insts).size).to be 4
+    end
+  end
+
   context 'feasibility pruning' do
     it 'drops a path that requires one word to equal two different values' do
       # if A == 1 { if A == 2 { ALLOW } }  -- both eqs can never hold together
@@ -121,5 +121,14 @@ describe SeccompTools::Symbolic::Expr do
       e = described_class.data(0).apply(:&, described_class.imm(1))
       expect({ e => 1 }[described_class.data(0).apply(:&, described_class.imm(1))]).to be 1
     end
+
+    it 'interns: equal expressions are one object with one id' do
+      a = described_class.data(0).apply(:-, described_class.data(4))
+      b = described_class.data(0).apply(:-, described_class.data(4))
+      expect(a).to be b
+      expect(a.id).not_to eq described_class.data(4).apply(:-, described_class.data(0)).id
+      # the same field values under different kinds stay apart
+      expect(described_class.imm(4)).not_to be described_class.data(4)
+    end
   end
 end
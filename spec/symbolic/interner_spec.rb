@@ -0,0 +1,26 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/symbolic/interner'
+
+describe SeccompTools::Symbolic::Interner do
+  it 'returns the one object built for a signature while it is alive' do
+    table = described_class.new
+    obj = table.fetch([1, 2]) { |id| [id] }
+    expect(table.fetch([1, 2]) { raise 'built twice' }).to be obj
+    expect(table.fetch([2, 1]) { |id| [id] }).to eq [obj.first + 1]
+  end
+
+  it 'forgets the objects nothing refers to' do
+    table = described_class.new
+    # collected as it goes, so that each sweep finds the objects built before it dead, whenever the
+    # GC would run on its own
+    20.times do |c|
+      1000.times { |i| table.fetch([(c * 1000) + i]) { |id| [id] } }
+      GC.start
+    end
+    # what a conservative GC still sees on the stack may survive, not everything
+    expect(table.size).to be < 20_000
+    # and the ids are never handed out again
+    expect(table.fetch([-1]) { |id| [id] }).to eq [20_000]
+  end
+end
@@ -0,0 +1,36 @@
+# frozen_string_literal: true
+
+require 'seccomp-tools/symbolic/path'
+
+describe SeccompTools::Symbolic::Path do
+  def expr = SeccompTools::Symbolic::Expr
+  def fact(k) = SeccompTools::Symbolic::Constraint.new(expr.data(0), :==, expr.imm(k))
+
+  it 'lists its constraints oldest first' do
+    path = described_class.empty.add(fact(1)).add(fact(2))
+    expect(path.to_a).to eq [fact(1), fact(2)]
+    expect(path.size).to be 2
+    expect(path.first).to be fact(1)
+    expect(path.last).to be fact(2)
+    expect(described_class.empty).to be_empty
+    expect(described_class.empty.to_a).to eq []
+  end
+
+  it 'shares the prefix between the paths extending it' do
+    base = described_class.empty.add(fact(1))
+    taken = base.add(fact(2))
+    other = base.add(fact(3))
+    expect(taken.parent).to be base
+    expect(other.parent).to be base
+    expect(base.to_a).to eq [fact(1)] # untouched
+  end
+
+  it 'interns: the same constraints in the same order are one path' do
+    a = described_class.empty.add(fact(1)).add(fact(2))
+    expect(described_class.empty.add(fact(1)).add(fact(2))).to be a
+    expect(described_class[[fact(1), fact(2)]]).to be a
+    expect(described_class[a]).to be a
+    expect(described_class.empty.add(fact(2)).add(fact(1))).not_to be a
+    expect(a).to eq [fact(1), fact(2)]
+  end
+end
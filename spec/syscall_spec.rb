@@ -31,4 +31,85 @@ describe SeccompTools::Syscall do
       EOS
     end
   end
+
+  describe '.trap_bpf' do
+    it 'traces only seccomp installations' do
+      require 'seccomp-tools/emulator'
+
+      insts = SeccompTools::Disasm.to_bpf(described_class.trap_bpf(:amd64), :amd64).map(&:inst)
+      action = lambda do |arch, nr, arg0 = 0|
+        SeccompTools::Emulator.new(insts, sys_nr: nr, args: [arg0], arch:).run[:ret]
+      end
+      trace = SeccompTools::Const::BPF::ACTION[:TRACE]
+      allow = SeccompTools::Const::BPF::ACTION[:ALLOW]
+      # an amd64 host runs amd64 and i386 processes
+      described_class::ABI.slice(:amd64, :i386).each do |arch, abi|
+        expect(action.call(arch, abi[:SYS_seccomp])).to be trace
+        expect(action.call(arch, abi[:SYS_prctl], 22)).to be trace
+        expect(action.call(arch, abi[:SYS_prctl], 38)).to be allow
+        expect(action.call(arch, 0)).to be allow
+      end
+    end
+  end
+
+  describe '.new' do
+    it 'decodes the syscall of a stopped process' do
+      skip_unless_amd64
+
+      pid = fork do
+        SeccompTools::Ptrace.traceme_and_stop
+        exit!(0)
+      end
+      begin
+        Process.waitpid(pid)
+        SeccompTools::Ptrace.setoptions(pid, 0, SeccompTools::Ptrace::O_TRACESYSGOOD)
+        # a signal-delivery stop is not a syscall, so the registers are read with the ABI layout
+        layout = nil
+        info = SeccompTools::Ptrace.syscall_info(pid) { layout = [64, 120, 80, 112, 104, 96, 56, 72, 44] }
+        expect(layout).not_to be_nil
+        expect(info[1].size).to be 6
+        expect(info[3]).to be_nil
+
+        SeccompTools::Ptrace.syscall(pid, 0, 0)
+        Process.waitpid(pid)
+        sys = described_class.new(pid)
+        expect(sys.arch).to be :amd64
+        expect(sys.abi).to be described_class::ABI[:amd64]
+        expect(sys.args.size).to be >= 6
+      ensure
+        Process.kill('KILL', pid)
+        Process.waitpid(pid)
+      end
+    end
+  end
+
+  describe '#dump_bpf' do
+    it 'reads the filter from the traced process' do
+      skip_unless_amd64
+      require 'fiddle'
+
+      # a forked child shares our address space layout, so it has these bytes at the same addresses
+      bpf = "\x20\x00\x00\x00\x00\x00\x00\x00\x06\x00\x00\x00\x00\x00\xff\x7f".b
+      fprog = [2, Fiddle::Pointer[bpf].to_i].pack('Sx6Q')
+      pid = fork do
+        SeccompTools::Ptrace.traceme_and_stop
+        exit!(0)
+      end
+      begin
+        Process.waitpid(pid)
+        sys = described_class.allocate
+        sys.instance_variable_set(:@pid, pid)
+        sys.instance_variable_set(:@arch, :amd64)
+        sys.instance_variable_set(:@abi, described_class::ABI[:amd64])
+        sys.instance_variable_set(:@number, described_class::ABI[:amd64][:SYS_seccomp])
+        args = [SeccompTools::Const::BPF::SECCOMP_SET_MODE_FILTER, 0, Fiddle::Pointer[fprog].to_i]
+        sys.instance_variable_set(:@args, args)
+        expect(sys.dump_bpf).to eq bpf
+        expect { SeccompTools::Ptrace.read_memory(pid, 8, 8) }.to raise_error(SystemCallError)
+      ensure
+        Process.kill('KILL', pid)
+        Process.waitpid(pid)
+      end
+    end
+  end
 end